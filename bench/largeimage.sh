@@ -0,0 +1,49 @@
+#!/bin/bash
+# -------------------------------------------------------------------------------------------------
+# largeimage.sh
+#
+# Times ImgGradient on a synthetic image larger than 16384 pixels on a side, 30000 x 10000 by
+# default, with the sorting modes which fit into the default memory budget, and the counting mode
+# once more with a progressive output, to compare its encoding cost. The image is generated once by
+# SynthJPG and kept in the work directory.
+#
+# Usage: ./largeimage.sh <ImgGradient> <SynthJPG> [width] [height]
+# Work directory: $BENCH_DIR, default $TMPDIR/imggradient-bench or /tmp/imggradient-bench.
+# -------------------------------------------------------------------------------------------------
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 <ImgGradient> <SynthJPG> [width] [height]"
+    exit 2
+fi
+program=$1
+synth=$2
+width=${3:-30000}
+height=${4:-10000}
+dir=${BENCH_DIR:-${TMPDIR:-/tmp}/imggradient-bench}
+input=$dir/synth-${width}x${height}.jpg
+output=$dir/out.jpg
+
+mkdir -p "$dir" || exit 2
+if [ ! -f "$input" ]; then
+    echo "Generating $input"
+    "$synth" "$input" "$width" "$height" || exit 2
+fi
+
+TIMEFORMAT=%R
+status=0
+printf "%-40s %10s\n" "${width}x${height}" "seconds"
+for run in "lightness --sort counting" \
+           "lightness --sort counting --progressive" \
+           "lightness --sort histogram" \
+           "lightness --sort external" \
+           "lightness --sort approximate" \
+           "hue --sort counting --stream"; do
+    seconds=$( { time "$program" "$input" "$output" $run > /dev/null; } 2>&1 )
+    if [ $? -ne 0 ]; then
+        seconds=failed
+        status=1
+    fi
+    printf "%-40s %10s\n" "$run" "$seconds"
+done
+rm -f "$output"
+exit $status
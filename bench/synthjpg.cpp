@@ -0,0 +1,64 @@
+/* -------------------------------------------------------------------------------------------------
+ * synthjpg.cpp
+ *
+ * Writes a synthetic jpg file of any size for the benchmarks (see largeimage.sh). The rows are
+ * generated and encoded one at a time, so the image is never held in memory.
+ *
+ * Usage: ./SynthJPG <output.jpg> <width> <height>
+ * ------------------------------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <jpgd/jpge.h>
+
+/* -------------------------------------------------------------------------------------------------
+ * Returns a pseudo random byte for a block of the image.
+ * ------------------------------------------------------------------------------------------------- */
+static unsigned char noise( unsigned int x, unsigned int y )
+{
+    unsigned int h = x * 374761393u + y * 668265263u;
+    h = ( h ^ ( h >> 13 ) ) * 1274126177u;
+    return ( h ^ ( h >> 16 ) ) & 0xFF;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * The main program. The image is a horizontal red and a vertical green gradient, with blue noise in
+ * 8 x 8 blocks, so that both the sorting keys and the jpg data vary over the whole image.
+ * ------------------------------------------------------------------------------------------------- */
+int main( int argc, char* argv[] )
+{
+    if( argc != 4 ) {
+        std::cout << "Usage: " << argv[ 0 ] << " <output.jpg> <width> <height>" << std::endl;
+        return 2;
+    }
+    int w = atoi( argv[ 2 ] );
+    int h = atoi( argv[ 3 ] );
+
+    // The default parameters encode in a single pass, which only keeps a few rows in memory.
+    jpge::cfile_stream stream;
+    jpge::jpeg_encoder encoder;
+    if( w < 1 || h < 1 || !stream.open( argv[ 1 ] ) || !encoder.init( &stream, w, h, 3 ) ) {
+        std::cout << "Cannot write " << argv[ 1 ] << std::endl;
+        return 2;
+    }
+
+    std::vector< unsigned char > line( (size_t)w * 3 );
+    for( int y = 0 ; y < h ; y++ ) {
+        for( int x = 0 ; x < w ; x++ ) {
+            line[ x * 3     ] = (unsigned char)( (long long)x * 255 / ( w > 1 ? w - 1 : 1 ) );
+            line[ x * 3 + 1 ] = (unsigned char)( (long long)y * 255 / ( h > 1 ? h - 1 : 1 ) );
+            line[ x * 3 + 2 ] = noise( x / 8, y / 8 );
+        }
+        if( !encoder.process_scanline( &line[ 0 ] ) ) {
+            std::cout << "Cannot write " << argv[ 1 ] << std::endl;
+            return 2;
+        }
+    }
+    if( !encoder.process_scanline( 0 ) ) {
+        std::cout << "Cannot write " << argv[ 1 ] << std::endl;
+        return 2;
+    }
+    encoder.deinit();
+    return stream.close() ? 0 : 2;
+}
@@ -0,0 +1,173 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stddef.h>
+
+/**
+ * @brief The BoundedQueue class passes items between threads, any number of producers and
+ *        consumers, through a ring of a fixed number of slots, without locks. Each slot has a
+ *        sequence number telling whether it is free for the producer of a round of the ring or
+ *        filled for its consumer, so producers and consumers only contend on their own counter.
+ *
+ *        BoundedQueue::push() waits while the queue is full, which slows down the producers to the
+ *        pace of the consumers (back-pressure), and BoundedQueue::pop() waits while it is empty.
+ *        Both spin briefly, then yield, then sleep, so that waiting stages leave the cores to the
+ *        busy ones.
+ */
+template< class T >
+class BoundedQueue
+{
+public: /* methods */
+    /**
+     * @brief BoundedQueue constructor. Constructs an empty queue.
+     * @param [in]  capacity    Maximum number of items, rounded up to a power of two, at least 2.
+     *                          With a single slot, its sequence number could not tell a filled
+     *                          slot from a free one of the next round.
+     */
+    BoundedQueue( size_t capacity ) : mEnqueue( 0 ), mDequeue( 0 )
+    {
+        size_t slots = 2;
+        while( slots < capacity ) {
+            slots *= 2;
+        }
+        mSlots = std::vector< Slot >( slots );
+        for( size_t i = 0 ; i < slots ; i++ ) {
+            mSlots[ i ].sequence.store( i, std::memory_order_relaxed );
+        }
+        mMask = slots - 1;
+    }
+
+    /**
+     * @brief Adds an item, unless the queue is full.
+     * @param [in]  item    The item.
+     * @return True if the item was added, false if the queue is full.
+     */
+    bool tryPush( const T& item )
+    {
+        size_t pos = mEnqueue.load( std::memory_order_relaxed );
+        for( ;; ) {
+            Slot& slot = mSlots[ pos & mMask ];
+            size_t sequence = slot.sequence.load( std::memory_order_acquire );
+            if( sequence == pos ) {
+                if( mEnqueue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    slot.item = item;
+                    slot.sequence.store( pos + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( sequence < pos ) {
+                return false;
+            }
+            else {
+                pos = mEnqueue.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /**
+     * @brief Removes the oldest item, unless the queue is empty.
+     * @param [out] item    Receives the item.
+     * @return True if an item was removed, false if the queue is empty.
+     */
+    bool tryPop( T* item )
+    {
+        size_t pos = mDequeue.load( std::memory_order_relaxed );
+        for( ;; ) {
+            Slot& slot = mSlots[ pos & mMask ];
+            size_t sequence = slot.sequence.load( std::memory_order_acquire );
+            if( sequence == pos + 1 ) {
+                if( mDequeue.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                    *item = slot.item;
+                    slot.sequence.store( pos + mMask + 1, std::memory_order_release );
+                    return true;
+                }
+            }
+            else if( sequence < pos + 1 ) {
+                return false;
+            }
+            else {
+                pos = mDequeue.load( std::memory_order_relaxed );
+            }
+        }
+    }
+
+    /**
+     * @brief Adds an item, waiting while the queue is full.
+     * @param [in]  item    The item.
+     */
+    void push( const T& item )
+    {
+        for( int tries = 0 ; !tryPush( item ) ; tries++ ) {
+            wait( tries );
+        }
+    }
+
+    /**
+     * @brief Removes the oldest item, waiting while the queue is empty.
+     * @return The item.
+     */
+    T pop()
+    {
+        T item;
+        for( int tries = 0 ; !tryPop( &item ) ; tries++ ) {
+            wait( tries );
+        }
+        return item;
+    }
+
+private: /* types */
+    /**
+     * @brief A slot of the ring. It is free for the producer of position p when its sequence is p,
+     *        and holds the item of position p for the consumer when its sequence is p + 1.
+     */
+    struct Slot
+    {
+        std::atomic< size_t > sequence;
+        T item;
+    };
+
+private: /* static methods */
+    /**
+     * @brief Waits before the next try of a full or empty queue, longer after more tries.
+     * @param [in]  tries   Number of tries so far.
+     */
+    static void wait( int tries )
+    {
+        if( tries < 64 ) {
+            return;
+        }
+        if( tries < 128 ) {
+            std::this_thread::yield();
+            return;
+        }
+        std::this_thread::sleep_for( std::chrono::microseconds( 200 ) );
+    }
+
+private: /* member variables */
+    /**
+     * @brief The slots, a power of two of them.
+     */
+    std::vector< Slot > mSlots;
+
+    /**
+     * @brief Number of slots minus one, to wrap positions.
+     */
+    size_t mMask;
+
+    /**
+     * @brief Position of the next item to add. Padded, so that producers and consumers do not
+     *        share a cache line.
+     */
+    alignas( 64 ) std::atomic< size_t > mEnqueue;
+
+    /**
+     * @brief Position of the next item to remove.
+     */
+    alignas( 64 ) std::atomic< size_t > mDequeue;
+};
+
+#endif // BOUNDEDQUEUE_H
@@ -0,0 +1,200 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "cachefile.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define CACHEFILE_SUPPORT_MMAP 1
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#else
+  #define CACHEFILE_SUPPORT_MMAP 0
+#endif
+
+/**
+ * @brief Header of a cache file. The table follows the header.
+ */
+struct CacheFileHeader
+{
+    char magic[ 8 ];
+    unsigned int byteOrder;
+    unsigned int version;
+};
+
+static const unsigned int CACHEFILE_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief Fills in the header of a table.
+ */
+static void makeHeader( CacheFileHeader* header, const char* magic, unsigned int version )
+{
+    memset( header, 0, sizeof( CacheFileHeader ) );
+    memcpy( header->magic, magic, sizeof( header->magic ) );
+    header->byteOrder = CACHEFILE_BYTE_ORDER;
+    header->version = version;
+}
+
+/**
+ * @brief CacheFile constructor. Constructs an object without a mapped file.
+ */
+CacheFile::CacheFile() : mMapping( 0 ), mSize( 0 )
+{
+}
+
+/* Destructor */
+CacheFile::~CacheFile()
+{
+    unmap();
+}
+
+/**
+ * @brief Maps (or reads, where memory mapping is not supported) a table from the cache directory.
+ *        A table mapped before by this object is released first.
+ * @param [in]  name    File name of the table in the cache directory.
+ * @param [in]  magic   The 8 byte magic tag of the table.
+ * @param [in]  size    The size of the table in bytes.
+ * @param [in]  version Version of the table, which the file must have been written with.
+ * @return True if the file exists and holds a valid table, otherwise false.
+ */
+bool CacheFile::map( const std::string& name, const char* magic, size_t size, unsigned int version )
+{
+    unmap();
+    std::string dir = directory();
+    if( dir.empty() ) {
+        return false;
+    }
+    std::string path = dir + "/" + name;
+    CacheFileHeader expected;
+    makeHeader( &expected, magic, version );
+    size += sizeof( CacheFileHeader );
+
+#if CACHEFILE_SUPPORT_MMAP
+    int fd = open( path.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && (size_t)st.st_size == size ) {
+        mapping = mmap( 0, size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    close( fd );
+    if( mapping == MAP_FAILED ) {
+        return false;
+    }
+    if( memcmp( mapping, &expected, sizeof( CacheFileHeader ) ) != 0 ) {
+        munmap( mapping, size );
+        return false;
+    }
+#else
+    FILE* file = fopen( path.c_str(), "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    void* mapping = malloc( size );
+    bool ok = mapping && fread( mapping, size, 1, file ) == 1 && fgetc( file ) == EOF &&
+              memcmp( mapping, &expected, sizeof( CacheFileHeader ) ) == 0;
+    fclose( file );
+    if( !ok ) {
+        free( mapping );
+        return false;
+    }
+#endif
+    mMapping = mapping;
+    mSize = size;
+    return true;
+}
+
+/**
+ * @brief Releases the mapped table.
+ */
+void CacheFile::unmap()
+{
+    if( mMapping == 0 ) {
+        return;
+    }
+#if CACHEFILE_SUPPORT_MMAP
+    munmap( mMapping, mSize );
+#else
+    free( mMapping );
+#endif
+    mMapping = 0;
+    mSize = 0;
+}
+
+/**
+ * @brief Returns the mapped table.
+ * @return The table, or a null pointer if no table is mapped.
+ */
+const void* CacheFile::data()
+{
+    return mMapping ? (const char*)mMapping + sizeof( CacheFileHeader ) : 0;
+}
+
+/**
+ * @brief Writes a table to the cache directory. The file is written under a temporary name and
+ *        renamed when complete, so that concurrent runs never map a partially written table.
+ * @param [in]  name    File name of the table in the cache directory.
+ * @param [in]  magic   The 8 byte magic tag of the table.
+ * @param [in]  data    The table.
+ * @param [in]  size    The size of the table in bytes.
+ * @param [in]  version Version of the table.
+ * @return True on write success, otherwise false.
+ */
+bool CacheFile::write( const std::string& name, const char* magic, const void* data, size_t size,
+                       unsigned int version )
+{
+    std::string dir = directory();
+    if( dir.empty() ) {
+        return false;
+    }
+    std::string path = dir + "/" + name;
+#if CACHEFILE_SUPPORT_MMAP
+    // Create the cache directory and its parent (e.g. ~/.cache) if they do not exist yet.
+    mkdir( dir.substr( 0, dir.rfind( '/' ) ).c_str(), 0755 );
+    mkdir( dir.c_str(), 0755 );
+    char suffix[ 32 ];
+    std::sprintf( suffix, ".%d.tmp", (int)getpid() );
+    std::string tmp = path + suffix;
+#else
+    std::string tmp = path + ".tmp";
+#endif
+
+    CacheFileHeader header;
+    makeHeader( &header, magic, version );
+    FILE* file = fopen( tmp.c_str(), "wb" );
+    if( file == 0 ) {
+        return false;
+    }
+    bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1 && fwrite( data, size, 1, file ) == 1;
+    ok = ( fclose( file ) == 0 ) && ok;
+    if( !ok || rename( tmp.c_str(), path.c_str() ) != 0 ) {
+        remove( tmp.c_str() );
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the cache directory: $IMGGRADIENT_CACHE, $XDG_CACHE_HOME/imggradient or
+ *        $HOME/.cache/imggradient, whichever is set first.
+ * @return The directory, or an empty string if none of the variables is set.
+ */
+std::string CacheFile::directory()
+{
+    const char* dir = getenv( "IMGGRADIENT_CACHE" );
+    if( dir && *dir ) {
+        return dir;
+    }
+    dir = getenv( "XDG_CACHE_HOME" );
+    if( dir && *dir ) {
+        return std::string( dir ) + "/imggradient";
+    }
+    dir = getenv( "HOME" );
+    if( dir && *dir ) {
+        return std::string( dir ) + "/.cache/imggradient";
+    }
+    return "";
+}
@@ -0,0 +1,81 @@
+#ifndef CACHEFILE_H
+#define CACHEFILE_H
+
+#include <string>
+#include <stddef.h>
+
+/**
+ * @brief The CacheFile class stores precomputed tables (see KeyTable and Layout) in the cache
+ *        directory and memory maps them on later runs. Each file starts with a header holding a
+ *        magic tag, which identifies the kind of table, a byte order mark, which rejects files
+ *        written on machines with a different byte order, and a version, which rejects files
+ *        written before the way the table is computed changed. A file is only accepted if its size
+ *        matches the expected size of the table too.
+ */
+class CacheFile
+{
+public: /* methods */
+    /**
+     * @brief CacheFile constructor. Constructs an object without a mapped file.
+     */
+    CacheFile();
+
+    /* Destructor */
+    ~CacheFile();
+
+    /**
+     * @brief Maps (or reads, where memory mapping is not supported) a table from the cache directory.
+     *        A table mapped before by this object is released first.
+     * @param [in]  name    File name of the table in the cache directory.
+     * @param [in]  magic   The 8 byte magic tag of the table.
+     * @param [in]  size    The size of the table in bytes.
+     * @param [in]  version Version of the table, which the file must have been written with.
+     * @return True if the file exists and holds a valid table, otherwise false.
+     */
+    bool map( const std::string& name, const char* magic, size_t size, unsigned int version );
+
+    /**
+     * @brief Releases the mapped table.
+     */
+    void unmap();
+
+    /**
+     * @brief Returns the mapped table.
+     * @return The table, or a null pointer if no table is mapped.
+     */
+    const void* data();
+
+public: /* static methods */
+    /**
+     * @brief Writes a table to the cache directory. The file is written under a temporary name and
+     *        renamed when complete, so that concurrent runs never map a partially written table.
+     * @param [in]  name    File name of the table in the cache directory.
+     * @param [in]  magic   The 8 byte magic tag of the table.
+     * @param [in]  data    The table.
+     * @param [in]  size    The size of the table in bytes.
+     * @param [in]  version Version of the table.
+     * @return True on write success, otherwise false.
+     */
+    static bool write( const std::string& name, const char* magic, const void* data, size_t size,
+                       unsigned int version );
+
+    /**
+     * @brief Returns the cache directory: $IMGGRADIENT_CACHE, $XDG_CACHE_HOME/imggradient or
+     *        $HOME/.cache/imggradient, whichever is set first.
+     * @return The directory, or an empty string if none of the variables is set.
+     */
+    static std::string directory();
+
+private: /* member variables */
+    /**
+     * @brief Start of the mapped (or allocated) file, including the header.
+     */
+    void* mMapping;
+
+    /**
+     * @brief Size of the mapped file.
+     */
+    size_t mSize;
+};
+
+#endif // CACHEFILE_H
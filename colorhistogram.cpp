@@ -0,0 +1,121 @@
+#include <algorithm>
+#include "colorhistogram.h"
+
+/**
+ * @brief Returns the number of set bits in a 64-bit word.
+ */
+static inline unsigned int popcount( unsigned long long bits )
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll( bits );
+#else
+    unsigned int n = 0;
+    for( ; bits ; bits &= bits - 1 ) n++;
+    return n;
+#endif
+}
+
+/**
+ * @brief Orders color indices by a precomputed key, see ColorHistogram::sort().
+ */
+class KeyOrder
+{
+public:
+    KeyOrder( const std::vector< double >& keys ) : mKeys( keys ) { }
+    bool operator()( int i, int j ) const { return mKeys[ i ] < mKeys[ j ]; }
+private:
+    const std::vector< double >& mKeys;
+};
+
+/**
+ * @brief ColorHistogram constructor. Counts the colors of a pixel buffer.
+ * @param [in]  pixels  Packed RGB pixel buffer of n * 3 bytes.
+ * @param [in]  n       Number of pixels.
+ */
+ColorHistogram::ColorHistogram( const uint8* pixels, long n )
+{
+    // Mark the colors which are present, one bit for each of the 2^24 colors.
+    std::vector< unsigned long long > present( 1 << 18, 0 );
+    for( long i = 0 ; i < n ; i++ ) {
+        const uint8* px = pixels + i * 3;
+        unsigned int c = ( px[ 0 ] << 16 ) | ( px[ 1 ] << 8 ) | px[ 2 ];
+        present[ c >> 6 ] |= 1ULL << ( c & 63 );
+    }
+
+    // Collect the present colors in ascending order. The index of a color in this list is the
+    // number of present colors before it: the number of bits set in all previous words (which
+    // is stored in "before") plus those set below the color's own bit in its word.
+    std::vector< unsigned int > before( 1 << 18 );
+    unsigned int total = 0;
+    for( int w = 0 ; w < ( 1 << 18 ) ; w++ ) {
+        before[ w ] = total;
+        total += popcount( present[ w ] );
+    }
+    mColors.reserve( total );
+    for( int w = 0 ; w < ( 1 << 18 ) ; w++ ) {
+        for( unsigned long long bits = present[ w ] ; bits ; bits &= bits - 1 ) {
+            mColors.push_back( ( w << 6 ) | popcount( ( bits & ( ~bits + 1 ) ) - 1 ) );
+        }
+    }
+
+    // Count the pixels of each color.
+    mCounts.assign( total, 0 );
+    for( long i = 0 ; i < n ; i++ ) {
+        const uint8* px = pixels + i * 3;
+        unsigned int c = ( px[ 0 ] << 16 ) | ( px[ 1 ] << 8 ) | px[ 2 ];
+        unsigned long long below = present[ c >> 6 ] & ( ( 1ULL << ( c & 63 ) ) - 1 );
+        mCounts[ before[ c >> 6 ] + popcount( below ) ]++;
+    }
+}
+
+/**
+ * @brief Sorts the distinct colors in ascending order of precomputed keys.
+ * @param [in]  keys    The key of each distinct color.
+ */
+void ColorHistogram::sortByKeys( const std::vector< double >& keys )
+{
+    int n = size();
+    std::vector< int > order( n );
+    for( int i = 0 ; i < n ; i++ ) {
+        order[ i ] = i;
+    }
+    std::sort( order.begin(), order.end(), KeyOrder( keys ) );
+
+    std::vector< unsigned int > colors( n ), counts( n );
+    for( int i = 0 ; i < n ; i++ ) {
+        colors[ i ] = mColors[ order[ i ] ];
+        counts[ i ] = mCounts[ order[ i ] ];
+    }
+    mColors.swap( colors );
+    mCounts.swap( counts );
+}
+
+/**
+ * @brief Returns the number of distinct colors.
+ * @return The number of distinct colors.
+ */
+int ColorHistogram::size()
+{
+    return (int)mColors.size();
+}
+
+/**
+ * @brief Returns a distinct color as 0xRRGGBB. Colors are ordered by their RGB value
+ *        until ColorHistogram::sort() is called.
+ * @param [in]  i       Index of the color (0 to size() - 1).
+ * @return The color.
+ */
+unsigned int ColorHistogram::color( int i )
+{
+    return mColors[ i ];
+}
+
+/**
+ * @brief Returns the number of pixels which have a color.
+ * @param [in]  i       Index of the color (0 to size() - 1).
+ * @return The number of pixels.
+ */
+unsigned int ColorHistogram::count( int i )
+{
+    return mCounts[ i ];
+}
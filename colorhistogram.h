@@ -0,0 +1,78 @@
+#ifndef COLORHISTOGRAM_H
+#define COLORHISTOGRAM_H
+
+#include <vector>
+#include "rgbpixel.h"
+
+/**
+ * @brief The ColorHistogram class counts the distinct colors of a packed RGB pixel buffer.
+ *        The presence of each of the 2^24 possible colors is tracked in a bitmap, so the histogram
+ *        costs 3 MiB of temporary tables plus 8 bytes per distinct color, no matter how many pixels
+ *        the image has. Sorting the histogram sorts only the distinct colors.
+ */
+class ColorHistogram
+{
+public: /* methods */
+    /**
+     * @brief ColorHistogram constructor. Counts the colors of a pixel buffer.
+     * @param [in]  pixels  Packed RGB pixel buffer of n * 3 bytes.
+     * @param [in]  n       Number of pixels.
+     */
+    ColorHistogram( const uint8* pixels, long n );
+
+    /**
+     * @brief Sorts the distinct colors in ascending order of a sorting key (see sortkey.h).
+     *        The key is computed once per distinct color.
+     */
+    template< class Key >
+    void sort()
+    {
+        std::vector< double > keys( mColors.size() );
+        for( size_t i = 0 ; i < mColors.size() ; i++ ) {
+            unsigned int c = mColors[ i ];
+            keys[ i ] = Key::key( c >> 16, ( c >> 8 ) & 0xFF, c & 0xFF );
+        }
+        sortByKeys( keys );
+    }
+
+    /**
+     * @brief Returns the number of distinct colors.
+     * @return The number of distinct colors.
+     */
+    int size();
+
+    /**
+     * @brief Returns a distinct color as 0xRRGGBB. Colors are ordered by their RGB value
+     *        until ColorHistogram::sort() is called.
+     * @param [in]  i       Index of the color (0 to size() - 1).
+     * @return The color.
+     */
+    unsigned int color( int i );
+
+    /**
+     * @brief Returns the number of pixels which have a color.
+     * @param [in]  i       Index of the color (0 to size() - 1).
+     * @return The number of pixels.
+     */
+    unsigned int count( int i );
+
+private: /* methods */
+    /**
+     * @brief Sorts the distinct colors in ascending order of precomputed keys.
+     * @param [in]  keys    The key of each distinct color.
+     */
+    void sortByKeys( const std::vector< double >& keys );
+
+private: /* member variables */
+    /**
+     * @brief The distinct colors as 0xRRGGBB.
+     */
+    std::vector< unsigned int > mColors;
+
+    /**
+     * @brief The number of pixels of each color in mColors.
+     */
+    std::vector< unsigned int > mCounts;
+};
+
+#endif // COLORHISTOGRAM_H
@@ -0,0 +1,266 @@
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+  #include <process.h>
+  #define externalSortSeek( file, offset ) _fseeki64( file, offset, SEEK_SET )
+  #define externalSortPid() _getpid()
+#else
+  #include <unistd.h>
+  #define externalSortSeek( file, offset ) fseeko( file, (off_t)( offset ), SEEK_SET )
+  #define externalSortPid() getpid()
+#endif
+
+/**
+ * @brief The ExternalSort class sorts more records than fit into memory. Records are collected in a
+ *        buffer of bounded size. Each time the buffer is full, it is sorted and appended to a scratch
+ *        file as a sorted run. Once all records have been added, the runs are merged while they are
+ *        read back, so the sorted records come out one at a time. If all records fit into the buffer,
+ *        the scratch file is never created.
+ *
+ *        Record must be a plain type which can be written to a file as is. Order is a comparison
+ *        functor, as for std::sort().
+ */
+template< class Record, class Order >
+class ExternalSort
+{
+public: /* methods */
+    /**
+     * @brief ExternalSort constructor.
+     * @param [in]  directory   Directory of the scratch file.
+     * @param [in]  memory      Memory limit in bytes. The run buffer, and later the read buffers of
+     *                          the runs while merging, take at most this much memory.
+     * @param [in]  order       Comparison of two records.
+     */
+    ExternalSort( const std::string& directory, size_t memory, Order order = Order() ) :
+        mDirectory( directory ), mMemory( memory ), mOrder( order ), mFile( 0 ), mMerging( false ), mNext( 0 )
+    {
+        mCapacity = std::max( memory / sizeof( Record ), (size_t)1024 );
+    }
+
+    /* Destructor */
+    ~ExternalSort()
+    {
+        if( mFile ) {
+            fclose( mFile );
+            remove( mPath.c_str() );
+        }
+    }
+
+    /**
+     * @brief Adds a record. Must not be called after ExternalSort::finish().
+     * @param [in]  record  The record.
+     * @return False if a run could not be written to the scratch file, otherwise true.
+     */
+    bool add( const Record& record )
+    {
+        if( mBuffer.size() == mCapacity && !spill() ) {
+            return false;
+        }
+        if( mBuffer.size() == mBuffer.capacity() ) {
+            // Grow the buffer like std::vector would, but never beyond the memory limit.
+            mBuffer.reserve( std::min( std::max( mBuffer.capacity() * 2, (size_t)4096 ), mCapacity ) );
+        }
+        mBuffer.push_back( record );
+        return true;
+    }
+
+    /**
+     * @brief Sorts the last run and starts merging. Call ExternalSort::next() to read the sorted records.
+     * @return False if the last run could not be written to the scratch file, otherwise true.
+     */
+    bool finish()
+    {
+        if( mRuns.empty() ) {
+            std::sort( mBuffer.begin(), mBuffer.end(), mOrder );
+        }
+        else {
+            if( !mBuffer.empty() && !spill() ) {
+                return false;
+            }
+            std::vector< Record >().swap( mBuffer );
+        }
+        mMerging = true;
+        return rewind();
+    }
+
+    /**
+     * @brief Returns the next record in sorted order.
+     * @param [out] record  The record.
+     * @return False if there are no records left or on a read error, otherwise true.
+     */
+    bool next( Record* record )
+    {
+        if( mRuns.empty() ) {
+            if( mNext >= mBuffer.size() ) {
+                return false;
+            }
+            *record = mBuffer[ mNext++ ];
+            return true;
+        }
+
+        // The heap holds the indices of the runs with records left, ordered by their first record.
+        if( mHeap.empty() ) {
+            return false;
+        }
+        std::pop_heap( mHeap.begin(), mHeap.end(), HeapOrder( this ) );
+        Run& run = mRuns[ mHeap.back() ];
+        *record = run.buffer[ run.position++ ];
+        if( run.position == run.buffer.size() && !fill( run ) ) {
+            return false;
+        }
+        if( run.buffer.empty() ) {
+            mHeap.pop_back();
+        }
+        else {
+            std::push_heap( mHeap.begin(), mHeap.end(), HeapOrder( this ) );
+        }
+        return true;
+    }
+
+    /**
+     * @brief Restarts reading the sorted records from the first one. Only valid after ExternalSort::finish().
+     * @return False on a read error, otherwise true.
+     */
+    bool rewind()
+    {
+        if( !mMerging ) {
+            return false;
+        }
+        mNext = 0;
+        if( mRuns.empty() ) {
+            return true;
+        }
+
+        // Share the memory limit among the read buffers of the runs.
+        size_t perRun = std::max( mMemory / sizeof( Record ) / mRuns.size(), (size_t)256 );
+        mHeap.clear();
+        for( size_t i = 0 ; i < mRuns.size() ; i++ ) {
+            Run& run = mRuns[ i ];
+            run.read = 0;
+            run.bufferSize = perRun;
+            if( !fill( run ) ) {
+                return false;
+            }
+            if( !run.buffer.empty() ) {
+                mHeap.push_back( i );
+            }
+        }
+        std::make_heap( mHeap.begin(), mHeap.end(), HeapOrder( this ) );
+        return true;
+    }
+
+    /**
+     * @brief Returns the number of sorted runs written to the scratch file.
+     * @return The number of runs, 0 if all records fit into memory.
+     */
+    size_t runs()
+    {
+        return mRuns.size();
+    }
+
+private: /* types */
+    /**
+     * @brief A sorted run in the scratch file.
+     */
+    struct Run
+    {
+        long long offset;               // Offset of the first record in the scratch file.
+        long long count;                // Number of records.
+        long long read;                 // Number of records read into the buffer so far.
+        size_t bufferSize;              // Number of records to read at once.
+        std::vector< Record > buffer;   // Records read but not returned yet, from position.
+        size_t position;
+    };
+
+    /**
+     * @brief Orders the heap of runs so that the run with the smallest first record is on top.
+     */
+    class HeapOrder
+    {
+    public:
+        HeapOrder( ExternalSort* sort ) : mSort( sort ) { }
+        bool operator()( size_t a, size_t b ) const
+        {
+            const Run& ra = mSort->mRuns[ a ];
+            const Run& rb = mSort->mRuns[ b ];
+            return mSort->mOrder( rb.buffer[ rb.position ], ra.buffer[ ra.position ] );
+        }
+    private:
+        ExternalSort* mSort;
+    };
+
+private: /* methods */
+    /**
+     * @brief Sorts the buffer and appends it to the scratch file as a run.
+     */
+    bool spill()
+    {
+        if( mFile == 0 ) {
+            // The address of this object tells the scratch files of concurrent sorts apart.
+            char name[ 64 ];
+            std::sprintf( name, "/imggradient-%d-%p.run", (int)externalSortPid(), (void*)this );
+            mPath = mDirectory + name;
+            mFile = fopen( mPath.c_str(), "w+b" );
+            if( mFile == 0 ) {
+                return false;
+            }
+            mEnd = 0;
+        }
+        std::sort( mBuffer.begin(), mBuffer.end(), mOrder );
+        Run run;
+        run.offset = mEnd;
+        run.count = mBuffer.size();
+        run.read = 0;
+        run.bufferSize = 0;
+        run.position = 0;
+        if( externalSortSeek( mFile, mEnd ) != 0 ||
+            fwrite( &mBuffer[ 0 ], sizeof( Record ), mBuffer.size(), mFile ) != mBuffer.size() ) {
+            return false;
+        }
+        mEnd += (long long)mBuffer.size() * sizeof( Record );
+        mRuns.push_back( run );
+        mBuffer.clear();
+        return true;
+    }
+
+    /**
+     * @brief Reads the next records of a run into its buffer. The buffer is left empty at the end of the run.
+     */
+    bool fill( Run& run )
+    {
+        size_t count = (size_t)std::min( (long long)run.bufferSize, run.count - run.read );
+        run.buffer.resize( count );
+        run.position = 0;
+        if( count == 0 ) {
+            return true;
+        }
+        if( externalSortSeek( mFile, run.offset + run.read * (long long)sizeof( Record ) ) != 0 ||
+            fread( &run.buffer[ 0 ], sizeof( Record ), count, mFile ) != count ) {
+            return false;
+        }
+        run.read += count;
+        return true;
+    }
+
+private: /* member variables */
+    std::string mDirectory;         // Directory of the scratch file.
+    size_t mMemory;                 // Memory limit in bytes.
+    Order mOrder;                   // Comparison of two records.
+    size_t mCapacity;               // Number of records in a run.
+    std::vector< Record > mBuffer;  // Records of the current run, or all records if there are no runs.
+    std::vector< Run > mRuns;       // Runs in the scratch file.
+    std::vector< size_t > mHeap;    // Runs with records left while merging.
+    std::string mPath;              // Path of the scratch file.
+    FILE* mFile;                    // The scratch file, or a null pointer until the first run.
+    long long mEnd;                 // Size of the scratch file.
+    bool mMerging;                  // True after finish().
+    size_t mNext;                   // Next record of mBuffer to return if there are no runs.
+};
+
+#endif // EXTERNALSORT_H
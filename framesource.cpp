@@ -0,0 +1,233 @@
+#include <cstring>
+#include "framesource.h"
+
+/**
+ * @brief FrameSource constructor. Constructs a source without an open input.
+ */
+FrameSource::FrameSource() : mFile( 0 ), mIndex( 0 ), mFailed( false )
+{
+}
+
+/* Destructor */
+FrameSource::~FrameSource()
+{
+    if( mFile && mFile != stdin ) {
+        fclose( mFile );
+    }
+}
+
+/**
+ * @brief Opens the input.
+ * @param [in]  input   A frame name pattern (see FrameSource::isPattern()), an MJPEG filename or "-"
+ *                      for an MJPEG stream on the standard input.
+ * @return True on success, otherwise false.
+ */
+bool FrameSource::open( const char* input )
+{
+    if( isPattern( input ) ) {
+        mPattern = input;
+        FILE* first = fopen( frameName( input, 0 ).c_str(), "rb" );
+        mIndex = first ? -1 : 0;
+        if( first ) {
+            fclose( first );
+        }
+        return true;
+    }
+
+    mFile = ( strcmp( input, "-" ) == 0 ) ? stdin : fopen( input, "rb" );
+    mIndex = 0;
+    return mFile != 0;
+}
+
+/**
+ * @brief Reads the next frame.
+ * @param [out] jpg     Buffer receiving the jpg data of the frame. Its memory is reused.
+ * @return True if a frame was read, false at the end of the input or on an error.
+ */
+bool FrameSource::next( std::vector< uint8 >* jpg )
+{
+    if( mFailed ) {
+        return false;
+    }
+    if( mPattern.empty() ) {
+        return nextMJPEG( jpg );
+    }
+
+    // The first missing file ends the sequence.
+    FILE* file = fopen( frameName( mPattern.c_str(), mIndex + 1 ).c_str(), "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    mIndex++;
+    long size = -1;
+    if( fseek( file, 0, SEEK_END ) == 0 ) {
+        size = ftell( file );
+    }
+    if( size <= 0 || fseek( file, 0, SEEK_SET ) != 0 ) {
+        fclose( file );
+        mFailed = true;
+        return false;
+    }
+    jpg->resize( size );
+    mFailed = fread( &( *jpg )[ 0 ], 1, size, file ) != (size_t)size;
+    fclose( file );
+    return !mFailed;
+}
+
+/**
+ * @brief Reads the next jpg file of the MJPEG stream.
+ *
+ * Anything before the start of image marker, such as the part headers of an HTTP stream, is
+ * skipped. The marker segments are then copied by their length up to the end of image marker.
+ * Embedded thumbnails have markers of their own, which are skipped along with their segment. The
+ * entropy coded data after a start of scan marker has no length, it ends at the first marker that
+ * is neither a stuffed 0xFF byte nor a restart marker.
+ *
+ * @param [out] jpg     Buffer receiving the jpg data.
+ * @return True if a frame was read, otherwise false.
+ */
+bool FrameSource::nextMJPEG( std::vector< uint8 >* jpg )
+{
+    jpg->clear();
+    int prev = 0;
+    int c;
+    while( ( c = getc( mFile ) ) != EOF && !( prev == 0xFF && c == 0xD8 ) ) {
+        prev = c;
+    }
+    if( c == EOF ) {
+        return false;
+    }
+    jpg->push_back( 0xFF );
+    jpg->push_back( 0xD8 );
+
+    // Marker code already read by the scan of the entropy coded data, or -1.
+    int pending = -1;
+    mFailed = true;
+    for( ;; ) {
+        int marker = pending;
+        if( marker < 0 ) {
+            if( getc( mFile ) != 0xFF ) {
+                return false;
+            }
+            while( ( marker = getc( mFile ) ) == 0xFF );
+        }
+        pending = -1;
+        if( marker == EOF ) {
+            return false;
+        }
+        jpg->push_back( 0xFF );
+        jpg->push_back( marker );
+        if( marker == 0xD9 ) {
+            break;
+        }
+        if( marker == 0x01 || ( marker >= 0xD0 && marker <= 0xD7 ) ) {
+            continue;
+        }
+
+        // Copy the segment, including its length.
+        int hi = getc( mFile );
+        int lo = getc( mFile );
+        if( hi == EOF || lo == EOF || ( ( hi << 8 ) | lo ) < 2 ) {
+            return false;
+        }
+        size_t length = ( ( hi << 8 ) | lo ) - 2;
+        jpg->push_back( hi );
+        jpg->push_back( lo );
+        size_t start = jpg->size();
+        jpg->resize( start + length );
+        if( length > 0 && fread( &( *jpg )[ start ], 1, length, mFile ) != length ) {
+            return false;
+        }
+        if( marker != 0xDA ) {
+            continue;
+        }
+
+        // Copy the entropy coded data up to the next marker.
+        for( ;; ) {
+            c = getc( mFile );
+            if( c == EOF ) {
+                return false;
+            }
+            if( c != 0xFF ) {
+                jpg->push_back( c );
+                continue;
+            }
+            int code;
+            while( ( code = getc( mFile ) ) == 0xFF );
+            if( code == EOF ) {
+                return false;
+            }
+            if( code != 0x00 && !( code >= 0xD0 && code <= 0xD7 ) ) {
+                pending = code;
+                break;
+            }
+            jpg->push_back( 0xFF );
+            jpg->push_back( code );
+        }
+    }
+
+    mFailed = false;
+    mIndex++;
+    return true;
+}
+
+/**
+ * @brief Returns the number of the frame last read.
+ * @return The frame number.
+ */
+int FrameSource::index()
+{
+    return mIndex;
+}
+
+/**
+ * @brief Tells whether reading stopped because of an error rather than at the end of the input.
+ * @return True on an error, otherwise false.
+ */
+bool FrameSource::failed()
+{
+    return mFailed;
+}
+
+/**
+ * @brief Tests whether a filename is a frame name pattern, which holds exactly one decimal
+ *        conversion like "%d" or "%04d". "%%" stands for a percent sign.
+ * @param [in]  name    The filename.
+ * @return True if it is a pattern, otherwise false.
+ */
+bool FrameSource::isPattern( const char* name )
+{
+    // Only these conversions are accepted, since the pattern is used as a printf format.
+    int conversions = 0;
+    for( const char* p = name ; *p ; p++ ) {
+        if( *p != '%' ) {
+            continue;
+        }
+        p++;
+        if( *p == '%' ) {
+            continue;
+        }
+        while( *p >= '0' && *p <= '9' ) p++;
+        if( *p != 'd' ) {
+            return false;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+/**
+ * @brief Returns the filename of a frame.
+ * @param [in]  pattern A frame name pattern (see FrameSource::isPattern()).
+ * @param [in]  index   The frame number.
+ * @return The filename.
+ */
+std::string FrameSource::frameName( const char* pattern, int index )
+{
+    if( !isPattern( pattern ) ) {
+        return pattern;
+    }
+    std::vector< char > name( strlen( pattern ) + 64 );
+    snprintf( &name[ 0 ], name.size(), pattern, index );
+    return &name[ 0 ];
+}
@@ -0,0 +1,103 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "rgbpixel.h"
+
+/**
+ * @brief The FrameSource class reads the frames of an animation one at a time, as compressed jpg
+ *        data. The frames are either numbered jpg files, named by a pattern like "frame%04d.jpg",
+ *        or the concatenated jpg files of an MJPEG stream, which are split at their start and end
+ *        of image markers.
+ */
+class FrameSource
+{
+public: /* methods */
+    /**
+     * @brief FrameSource constructor. Constructs a source without an open input.
+     */
+    FrameSource();
+
+    /* Destructor */
+    ~FrameSource();
+
+    /**
+     * @brief Opens the input. Numbered files start with frame 0, or with frame 1 if there is no
+     *        frame 0, and end before the first missing number. MJPEG frames are numbered from 1.
+     * @param [in]  input   A frame name pattern (see FrameSource::isPattern()), an MJPEG filename or "-"
+     *                      for an MJPEG stream on the standard input.
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* input );
+
+    /**
+     * @brief Reads the next frame.
+     * @param [out] jpg     Buffer receiving the jpg data of the frame. Its memory is reused.
+     * @return True if a frame was read, false at the end of the input or on an error.
+     * @see FrameSource::failed()
+     */
+    bool next( std::vector< uint8 >* jpg );
+
+    /**
+     * @brief Returns the number of the frame last read.
+     * @return The frame number.
+     */
+    int index();
+
+    /**
+     * @brief Tells whether reading stopped because of an error rather than at the end of the input,
+     *        for example in the middle of a truncated MJPEG frame.
+     * @return True on an error, otherwise false.
+     */
+    bool failed();
+
+public: /* static methods */
+    /**
+     * @brief Tests whether a filename is a frame name pattern, which holds exactly one decimal
+     *        conversion like "%d" or "%04d". "%%" stands for a percent sign.
+     * @param [in]  name    The filename.
+     * @return True if it is a pattern, otherwise false.
+     */
+    static bool isPattern( const char* name );
+
+    /**
+     * @brief Returns the filename of a frame.
+     * @param [in]  pattern A frame name pattern (see FrameSource::isPattern()).
+     * @param [in]  index   The frame number.
+     * @return The filename.
+     */
+    static std::string frameName( const char* pattern, int index );
+
+private: /* methods */
+    /**
+     * @brief Reads the next jpg file of the MJPEG stream.
+     * @param [out] jpg     Buffer receiving the jpg data.
+     * @return True if a frame was read, otherwise false.
+     */
+    bool nextMJPEG( std::vector< uint8 >* jpg );
+
+private: /* member variables */
+    /**
+     * @brief The frame name pattern, empty for an MJPEG stream.
+     */
+    std::string mPattern;
+
+    /**
+     * @brief The MJPEG stream, or a null pointer.
+     */
+    FILE* mFile;
+
+    /**
+     * @brief Number of the frame last read.
+     */
+    int mIndex;
+
+    /**
+     * @brief True if reading stopped on an error.
+     */
+    bool mFailed;
+};
+
+#endif // FRAMESOURCE_H
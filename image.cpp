@@ -28,7 +28,7 @@ Image::Image( int width, int height ) :
 Image::Image( uint8* im, int width, int height ) :
     mData( new RGBPixelData ), mWidth( width ), mHeight( height )
 {
-    int i = 0;
+    size_t i = 0;
     // Unsigned integer input 1D array holds width * height * 3 pixel data.
     // Put it in this images 2D pixel data array.
     for( int y = 0 ; y < height ; y++ ) {
@@ -52,7 +52,7 @@ Image::Image( uint8* im, int width, int height ) :
 Image::Image( std::vector< RGBPixel* >* im, int width, int height) :
     mData( new RGBPixelData ), mWidth( width ), mHeight( height )
 {
-    int i = 0;
+    size_t i = 0;
     // 1D input list holds width * height * 3 pixel data.
     // Put it in this images 2D pixel data array.
     for( int y = 0 ; y < height ; y++ ) {
@@ -3,16 +3,37 @@
 
 #include <vector>
 #include <string>
+#include <cstring>
 
 #include <jpgd/jpgd.h>
 #include <jpgd/jpge.h>
 #include "rgbpixel.h"
+#include "imageformat.h"
+#include "jpgreader.h"
+#include "qualitysearch.h"
 
 /**
  * @brief RGBPixelData is a 2D array of RGBPixels. It represents pixels collection of an image.
  */
 typedef std::vector< std::vector< RGBPixel* > > RGBPixelData;
 
+/**
+ * @brief JPGSettings holds the settings of the output jpg files chosen on the command line. They
+ *        are passed to each write, so that threads writing at the same time may use their own
+ *        (see Image::jpgParams()).
+ */
+struct JPGSettings
+{
+    JPGSettings() : restartRows( 0 ), progressive( false ), targetSize( 0 ) {}
+
+    int restartRows;        // MCU rows between the restart markers, so that readers can decode
+                            // bands of rows in parallel (see JPGReader::decode()). 0 for none.
+    bool progressive;       // Progressive files, refined scan by scan while they load. The encoder
+                            // keeps the quantized coefficients of the whole image in memory.
+    size_t targetSize;      // Maximum file size in bytes. Files are written at the highest quality
+                            // which fits (see QualitySearch). 0 for none, the default quality.
+};
+
 /**
  * @brief The Image class represents an image which contains pixel data.
  * @author Mango
@@ -97,42 +118,62 @@ public: /* methods */
 
 public: /* static methods */
     /**
-     * @brief Reads a jpg file and returns a new image object.
-     * @param [in]  filename    The jpg filename.
+     * @brief Returns the jpg compression parameters used for all output files.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [in]  settings    Settings of the output jpg files.
+     * @return The compression parameters.
+     */
+    static jpge::params jpgParams( int comps, const JPGSettings& settings )
+    {
+        // Use optimized Huffman tables. The encoder caches the quantized coefficients of the first
+        // pass, so this only costs an extra entropy coding pass instead of a second full encode.
+        jpge::params params;
+        params.m_two_pass_flag = true;
+        params.m_restart_rows = settings.restartRows;
+        params.m_progressive_flag = settings.progressive;
+        if( comps == 1 ) {
+            params.m_subsampling = jpge::Y_ONLY;
+        }
+        return params;
+    }
+
+    /**
+     * @brief Reads an image file of any known format (see ImageFormat) and returns a new image
+     *        object, shrunk by an integer factor.
+     * @param [in]  filename    The image filename.
+     * @param [in]  scale       Shrink factor (see Image::decode()).
      * @return An image object containing pixel data.
-     * @see Image::toJPG()
+     * @see Image::toFile()
      */
-    static Image* fromJPG( char* filename )
+    static Image* fromFile( char* filename, int scale )
     {
-        int w, h, comp;
-        uint8* out = jpgd::decompress_jpeg_image_from_file( filename, &w, &h, &comp, 3 );
+        int w, h;
+        uint8* out = decode( filename, 3, scale, &w, &h );
         if ( out == 0 ) {
             return 0;
         }
-        else {
-            Image* im = new Image( out, w, h );
-            free( out );
-            return im;
-        }
+        Image* im = new Image( out, w, h );
+        free( out );
+        return im;
     }
 
     /**
-     * @brief Writes a jpg file from an image object.
+     * @brief Writes an image file from an image object, in the format of its extension (see
+     *        ImageFormat).
      * @param [in]  im          The image object.
      * @param [out] filename    Output filename.
+     * @param [in]  settings    Settings of jpg files.
+     * @param [out] tooLarge    Set to true if a jpg file does not fit into the target size even at
+     *                          quality 1, or a null pointer.
      * @return True on write success, otherwise false.
-     * @see Image::fromJPG()
+     * @see Image::fromFile()
      */
-    static bool toJPG( Image* im, char* filename )
+    static bool toFile( Image* im, char* filename, const JPGSettings& settings, bool* tooLarge = 0 )
     {
         int w = im->width();
         int h = im->height();
-        int i = 0;
-
-        // Loops each columns and rows of an image and put the pixel data into a
-        // 1D unsigned integer array. The size of the array is width * height * 3
-        // because each pixel holds 3 color components (RGB).
-        uint8* in = new uint8[ w * h * 3 ];
+        std::vector< uint8 > in( (size_t)w * h * 3 );
+        size_t i = 0;
         for( int y = 0 ; y < h ; y++ ) {
             for( int x = 0 ; x < w ; x++ ) {
                 RGBPixel* px = im->getPixel( x, y );
@@ -142,8 +183,82 @@ public: /* static methods */
                 i += 3;
             }
         }
-        bool ok = jpge::compress_image_to_jpeg_file( filename, w, h, 3, in );
-        delete[] in;
+        return encode( &in[ 0 ], w, h, 3, filename, settings, tooLarge );
+    }
+
+    /**
+     * @brief Decodes an image file of any known format (see ImageFormat) into a packed pixel buffer,
+     *        optionally shrunk by an integer factor. When shrinking, scanlines are averaged into a
+     *        single row of sums as they come out of the decoder, so the full size image is never held
+     *        in memory (see JPGReader). Files which hold their pixels as they are returned are copied
+     *        without decoding (see ImageReader::pixels()).
+     * @param [in]  filename    The image filename.
+     * @param [in]  comps       Number of color components per pixel in the buffer: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+     *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+     * @param [out] width       Width of the decoded image.
+     * @param [out] height      Height of the decoded image.
+     * @param [in]  callback    Function called for each row, or a null pointer.
+     * @param [in]  user        Pointer passed to the callback.
+     * @return A buffer of width * height * comps bytes, which must be released with free(),
+     *         or a null pointer on error.
+     * @see Image::encode()
+     */
+    static uint8* decode( char* filename, int comps, int scale, int* width, int* height,
+                          RowCallback callback = 0, void* user = 0 )
+    {
+        ImageReader* reader = ImageFormat::openReader( filename, comps, scale );
+        if( reader == 0 ) {
+            return 0;
+        }
+        int w = reader->width();
+        int h = reader->height();
+        uint8* out = (uint8*)malloc( (size_t)w * h * comps );
+        if( out && !reader->decode( out, comps, callback, user ) ) {
+            free( out );
+            out = 0;
+        }
+        delete reader;
+
+        *width = w;
+        *height = h;
+        return out;
+    }
+
+    /**
+     * @brief Writes an image file from a packed pixel buffer, in the format of its extension (see
+     *        ImageFormat). Jpg files are kept within the target size, if
+     *        there is one (see JPGSettings).
+     * @param [in]  pixels      Pixel buffer of width * height * comps bytes.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [out] filename    Output filename.
+     * @param [in]  settings    Settings of jpg files.
+     * @param [out] tooLarge    Set to true if a jpg file does not fit into the target size even at
+     *                          quality 1, or a null pointer.
+     * @return True on write success, otherwise false.
+     * @see Image::decode()
+     */
+    static bool encode( const uint8* pixels, int width, int height, int comps, char* filename,
+                        const JPGSettings& settings, bool* tooLarge = 0 )
+    {
+        if( settings.targetSize > 0 && strcmp( ImageFormat::forOutput( filename )->name, "JPG" ) == 0 ) {
+            return QualitySearch::write( pixels, width, height, comps, jpgParams( comps, settings ), settings.targetSize, filename, tooLarge );
+        }
+        ImageWriter* writer = ImageFormat::openWriter( filename, width, height, comps, jpgParams( comps, settings ) );
+        if( writer == 0 ) {
+            return false;
+        }
+        bool ok = true;
+        for( int pass = 0 ; ok && pass < writer->passes() ; pass++ ) {
+            for( int y = 0 ; ok && y < height ; y++ ) {
+                ok = writer->write( pixels + (size_t)y * width * comps );
+            }
+            ok = ok && writer->endPass();
+        }
+        ok = writer->close() && ok;
+        delete writer;
         return ok;
     }
 
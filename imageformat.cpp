@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+  #include <io.h>
+  #include <fcntl.h>
+#endif
+#include "imageformat.h"
+#include "jpgreader.h"
+#include "jpgwriter.h"
+#include "pnmreader.h"
+#include "pnmwriter.h"
+#include "qoireader.h"
+#include "qoiwriter.h"
+
+/**
+ * @brief Returns the pixels of the file without copying them. Most formats need to be decoded.
+ * @return A null pointer.
+ */
+const uint8* ImageReader::pixels()
+{
+    return 0;
+}
+
+/**
+ * @brief Decodes all remaining rows into a buffer of the caller.
+ * @param [out] buffer      Buffer of width() * height() * comps bytes.
+ * @param [in]  comps       Number of color components per pixel, as passed to ImageReader::open().
+ * @param [in]  callback    Function called for each row, or a null pointer.
+ * @param [in]  user        Pointer passed to the callback.
+ * @return True on success, otherwise false.
+ */
+bool ImageReader::decode( uint8* buffer, int comps, RowCallback callback, void* user )
+{
+    int w = width();
+    int h = height();
+    size_t rowBytes = (size_t)w * comps;
+    const uint8* mapped = pixels();
+    if( mapped ) {
+        memcpy( buffer, mapped, rowBytes * h );
+    }
+    for( int y = 0 ; y < h ; y++ ) {
+        uint8* row = buffer + rowBytes * y;
+        if( !mapped && !read( row ) ) {
+            return false;
+        }
+        if( callback ) {
+            callback( row, w, y, user );
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the number of times all rows have to be written. Most formats need one pass.
+ * @return 1.
+ */
+int ImageWriter::passes()
+{
+    return 1;
+}
+
+/**
+ * @brief Ends the current pass. Most formats have nothing to do here.
+ * @return True.
+ */
+bool ImageWriter::endPass()
+{
+    return true;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * The formats.
+ * ------------------------------------------------------------------------------------------------- */
+
+static bool matchesJPG( const uint8* head, size_t size )
+{
+    return size >= 3 && head[ 0 ] == 0xFF && head[ 1 ] == 0xD8 && head[ 2 ] == 0xFF;
+}
+
+static bool probeJPG( const char* filename, jpgd::jpeg_header_info* info )
+{
+    return jpgd::probe_jpeg_header_from_file( filename, info );
+}
+
+static bool probeJPGData( const uint8* data, size_t size, jpgd::jpeg_header_info* info )
+{
+    return size <= 0x7FFFFFFF && jpgd::probe_jpeg_header_from_memory( data, (int)size, info );
+}
+
+static ImageReader* newJPGReader()
+{
+    return new JPGReader();
+}
+
+static ImageWriter* newJPGWriter( const jpge::params& params )
+{
+    return new JPGWriter( params );
+}
+
+static bool matchesPNM( const uint8* head, size_t size )
+{
+    return size >= 2 && head[ 0 ] == 'P' && ( head[ 1 ] == '5' || head[ 1 ] == '6' || head[ 1 ] == '7' );
+}
+
+static bool probePNM( const char* filename, jpgd::jpeg_header_info* info )
+{
+    // Netpbm files are memory mapped instead of decoded, the decoder needs no memory.
+    info->m_progressive_flag = false;
+    return PNMReader::probe( filename, &info->m_width, &info->m_height, &info->m_comps );
+}
+
+static bool probePNMData( const uint8* data, size_t size, jpgd::jpeg_header_info* info )
+{
+    info->m_progressive_flag = false;
+    return PNMReader::probe( data, size, &info->m_width, &info->m_height, &info->m_comps );
+}
+
+static ImageReader* newPNMReader()
+{
+    return new PNMReader();
+}
+
+static ImageWriter* newPNMWriter( const jpge::params& )
+{
+    return new PNMWriter();
+}
+
+static bool matchesQOI( const uint8* head, size_t size )
+{
+    return size >= 4 && memcmp( head, "qoif", 4 ) == 0;
+}
+
+static bool probeQOI( const char* filename, jpgd::jpeg_header_info* info )
+{
+    // QOI files are decoded in a single pass with a buffer of one row.
+    info->m_progressive_flag = false;
+    info->m_comps = 3;
+    return QOIReader::probe( filename, &info->m_width, &info->m_height );
+}
+
+static bool probeQOIData( const uint8* data, size_t size, jpgd::jpeg_header_info* info )
+{
+    info->m_progressive_flag = false;
+    info->m_comps = 3;
+    return QOIReader::probe( data, size, &info->m_width, &info->m_height );
+}
+
+static ImageReader* newQOIReader()
+{
+    return new QOIReader();
+}
+
+static ImageWriter* newQOIWriter( const jpge::params& )
+{
+    return new QOIWriter();
+}
+
+/**
+ * @brief The known formats. The first one is used for files which match no format.
+ */
+static const ImageFormat formats[] = {
+    { "JPG", { "jpg", "jpeg", "jpe", "jfif", 0 }, matchesJPG, probeJPG, probeJPGData, newJPGReader, newJPGWriter },
+    { "PNM", { "ppm", "pgm", "pnm", "pam", 0 }, matchesPNM, probePNM, probePNMData, newPNMReader, newPNMWriter },
+    { "QOI", { "qoi", 0 }, matchesQOI, probeQOI, probeQOIData, newQOIReader, newQOIWriter }
+};
+
+static const int formatCount = sizeof( formats ) / sizeof( formats[ 0 ] );
+
+/**
+ * @brief Tests whether a filename has one of the extensions of the format. Case is ignored.
+ * @param [in]  filename    The filename.
+ * @return True if it has one of the extensions, otherwise false.
+ */
+bool ImageFormat::hasExtension( const char* filename ) const
+{
+    const char* dot = strrchr( filename, '.' );
+    if( dot == 0 || strchr( dot, '/' ) ) {
+        return false;
+    }
+    for( int i = 0 ; extensions[ i ] ; i++ ) {
+        const char* a = dot + 1;
+        const char* b = extensions[ i ];
+        while( *a && tolower( (unsigned char)*a ) == *b ) {
+            a++;
+            b++;
+        }
+        if( *a == 0 && *b == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the format of an input file, recognized by its first bytes or its extension.
+ * @param [in]  filename    The input filename.
+ * @return The format. It is never a null pointer.
+ */
+const ImageFormat* ImageFormat::forInput( const char* filename )
+{
+    uint8 head[ 4 ];
+    size_t size = 0;
+    if( isStandardStream( filename ) ) {
+        const std::vector< uint8 >& data = standardInput();
+        size = std::min( data.size(), sizeof( head ) );
+        if( size > 0 ) {
+            memcpy( head, &data[ 0 ], size );
+        }
+    }
+    else if( FILE* file = fopen( filename, "rb" ) ) {
+        size = fread( head, 1, sizeof( head ), file );
+        fclose( file );
+    }
+    for( int i = 0 ; i < formatCount ; i++ ) {
+        if( formats[ i ].matches( head, size ) ) {
+            return &formats[ i ];
+        }
+    }
+    return forOutput( filename );
+}
+
+/**
+ * @brief Returns the format of an output file, chosen by its extension.
+ * @param [in]  filename    The output filename.
+ * @return The format. It is never a null pointer.
+ */
+const ImageFormat* ImageFormat::forOutput( const char* filename )
+{
+    for( int i = 0 ; i < formatCount ; i++ ) {
+        if( formats[ i ].hasExtension( filename ) ) {
+            return &formats[ i ];
+        }
+    }
+    return &formats[ 0 ];
+}
+
+/**
+ * @brief Reads only the header of an input file in its format (see ImageFormat::forInput()).
+ * @param [in]  filename    The input filename, or "-" for the standard input.
+ * @param [out] info        Size, number of color components and progressiveness of the file.
+ * @return True if the file is a supported file of its format, otherwise false.
+ */
+bool ImageFormat::probeInput( const char* filename, jpgd::jpeg_header_info* info )
+{
+    const ImageFormat* format = forInput( filename );
+    if( isStandardStream( filename ) ) {
+        const std::vector< uint8 >& data = standardInput();
+        return !data.empty() && format->probeData( &data[ 0 ], data.size(), info );
+    }
+    return format->probe( filename, info );
+}
+
+/**
+ * @brief Opens an input file with a reader of its format (see ImageFormat::forInput()).
+ * @param [in]  filename    The input filename.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor (see ImageReader::open()).
+ * @return The open reader, which must be released with delete, or a null pointer on error.
+ */
+ImageReader* ImageFormat::openReader( const char* filename, int comps, int scale )
+{
+    ImageReader* reader = forInput( filename )->newReader();
+    bool ok;
+    if( isStandardStream( filename ) ) {
+        const std::vector< uint8 >& data = standardInput();
+        ok = !data.empty() && reader->open( &data[ 0 ], data.size(), comps, scale );
+    }
+    else {
+        ok = reader->open( filename, comps, scale );
+    }
+    if( !ok ) {
+        delete reader;
+        return 0;
+    }
+    return reader;
+}
+
+/**
+ * @brief Creates an output file with a writer of its format (see ImageFormat::forOutput()).
+ * @param [in]  filename    Output filename.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @param [in]  params      Compression parameters of jpg files (see Image::jpgParams()).
+ * @return The open writer, which must be released with delete, or a null pointer on error.
+ */
+ImageWriter* ImageFormat::openWriter( const char* filename, int width, int height, int comps,
+                                      const jpge::params& params )
+{
+    ImageWriter* writer = forOutput( filename )->newWriter( params );
+    if( !writer->open( filename, width, height, comps ) ) {
+        delete writer;
+        return 0;
+    }
+    return writer;
+}
+
+/**
+ * @brief Tests whether a filename stands for the standard input or output: "-", or "-." followed
+ *        by an extension which chooses the format of the output, like "-.qoi".
+ * @param [in]  filename    The filename.
+ * @return True for the standard streams, otherwise false.
+ */
+bool ImageFormat::isStandardStream( const char* filename )
+{
+    return filename[ 0 ] == '-' && ( filename[ 1 ] == 0 || ( filename[ 1 ] == '.' && strchr( filename, '/' ) == 0 ) );
+}
+
+/**
+ * @brief Returns the whole standard input. It is read into memory on the first call, so that its
+ *        header can be probed before it is decoded. Later calls return the same data.
+ * @return The data of the standard input.
+ */
+const std::vector< uint8 >& ImageFormat::standardInput()
+{
+    static std::vector< uint8 > data;
+    static bool read = false;
+    if( !read ) {
+        read = true;
+#ifdef _WIN32
+        _setmode( _fileno( stdin ), _O_BINARY );
+#endif
+        // Grow the buffer geometrically, pipes do not tell their size.
+        size_t size = 0;
+        data.resize( 1 << 20 );
+        for( ;; ) {
+            size_t got = fread( &data[ size ], 1, data.size() - size, stdin );
+            size += got;
+            if( size < data.size() ) {
+                break;
+            }
+            data.resize( data.size() * 2 );
+        }
+        data.resize( size );
+    }
+    return data;
+}
+
+/**
+ * @brief Opens an output file for the writers, with a large buffer so that their small writes
+ *        are gathered into large ones. The standard output is used for "-".
+ * @param [in]  filename    Output filename.
+ * @return The file, or a null pointer on error.
+ */
+FILE* ImageFormat::openOutput( const char* filename )
+{
+    FILE* file;
+    if( isStandardStream( filename ) ) {
+#ifdef _WIN32
+        _setmode( _fileno( stdout ), _O_BINARY );
+#endif
+        file = stdout;
+    }
+    else {
+        file = fopen( filename, "wb" );
+    }
+    if( file ) {
+        setvbuf( file, 0, _IOFBF, 1 << 20 );
+    }
+    return file;
+}
+
+/**
+ * @brief Closes a file opened by ImageFormat::openOutput(). The standard output is only flushed.
+ * @param [in]  file        The file.
+ * @return True if all data was written, otherwise false.
+ */
+bool ImageFormat::closeOutput( FILE* file )
+{
+    if( file == stdout ) {
+        return fflush( file ) == 0 && !ferror( file );
+    }
+    return fclose( file ) == 0;
+}
@@ -0,0 +1,285 @@
+#ifndef IMAGEFORMAT_H
+#define IMAGEFORMAT_H
+
+#include <stddef.h>
+#include <cstdio>
+#include <vector>
+#include <jpgd/jpgd.h>
+#include <jpgd/jpge.h>
+#include "rgbpixel.h"
+
+/**
+ * @brief RowCallback is called by ImageReader::decode() for each row of the decoded image as soon as
+ *        it is complete, while it is still in the cache.
+ * @param [in]  row     The packed pixels of the row.
+ * @param [in]  width   Number of pixels in the row.
+ * @param [in]  y       Index of the row.
+ * @param [in]  user    The user pointer passed to ImageReader::decode().
+ */
+typedef void ( *RowCallback )( const uint8* row, int width, int y, void* user );
+
+/**
+ * @brief The ImageReader class is the interface of the image decoders. Rows are read one at a time,
+ *        optionally shrunk by an integer factor, so that no format needs the whole image in memory.
+ * @see ImageFormat
+ */
+class ImageReader
+{
+public: /* methods */
+    /* Destructor */
+    virtual ~ImageReader() {}
+
+    /**
+     * @brief Opens a file and reads its header.
+     * @param [in]  filename    The filename.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+     *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+     * @return True on success, otherwise false.
+     */
+    virtual bool open( const char* filename, int comps, int scale ) = 0;
+
+    /**
+     * @brief Same as ImageReader::open() above, but reads a file which is already in memory, such as
+     *        the standard input (see ImageFormat::standardInput()). The data must outlive the reader.
+     * @param [in]  data        The file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor (see ImageReader::open() above).
+     * @return True on success, otherwise false.
+     */
+    virtual bool open( const uint8* data, size_t size, int comps, int scale ) = 0;
+
+    /**
+     * @brief Returns the width of the rows.
+     * @return The width in pixels.
+     */
+    virtual int width() = 0;
+
+    /**
+     * @brief Returns the number of rows.
+     * @return The height in pixels.
+     */
+    virtual int height() = 0;
+
+    /**
+     * @brief Returns the number of color components of the file.
+     * @return 1 for grayscale, 3 for color files.
+     */
+    virtual int components() = 0;
+
+    /**
+     * @brief Reads the next row.
+     * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+     * @return True on success, otherwise false.
+     */
+    virtual bool read( uint8* row ) = 0;
+
+    /**
+     * @brief Returns the pixels of the file without copying them, if the file stores them exactly as
+     *        ImageReader::read() would return them.
+     * @return The packed pixels of all rows, or a null pointer if they need to be decoded.
+     */
+    virtual const uint8* pixels();
+
+    /**
+     * @brief Decodes all remaining rows into a buffer of the caller. The pixels are copied in one go
+     *        if the file holds them as they are (see ImageReader::pixels()).
+     * @param [out] buffer      Buffer of width() * height() * comps bytes.
+     * @param [in]  comps       Number of color components per pixel, as passed to ImageReader::open().
+     * @param [in]  callback    Function called for each row, or a null pointer.
+     * @param [in]  user        Pointer passed to the callback.
+     * @return True on success, otherwise false.
+     */
+    virtual bool decode( uint8* buffer, int comps, RowCallback callback, void* user );
+};
+
+/**
+ * @brief The ImageWriter class is the interface of the image encoders. Rows are written one at a
+ *        time. Some encoders need the rows more than once (see jpge::params), so callers write all
+ *        rows in each of passes() passes.
+ * @see ImageFormat
+ */
+class ImageWriter
+{
+public: /* methods */
+    /* Destructor */
+    virtual ~ImageWriter() {}
+
+    /**
+     * @brief Creates a file.
+     * @param [in]  filename    Output filename.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @return True on success, otherwise false.
+     */
+    virtual bool open( const char* filename, int width, int height, int comps ) = 0;
+
+    /**
+     * @brief Returns the number of times all rows have to be written.
+     * @return The number of passes.
+     */
+    virtual int passes();
+
+    /**
+     * @brief Writes the next row of the current pass.
+     * @param [in]  row     The width * comps packed pixels of the row.
+     * @return True on success, otherwise false.
+     */
+    virtual bool write( const uint8* row ) = 0;
+
+    /**
+     * @brief Ends the current pass, after all rows have been written.
+     * @return True on success, otherwise false.
+     */
+    virtual bool endPass();
+
+    /**
+     * @brief Closes the file, after all passes.
+     * @return True on success, otherwise false.
+     */
+    virtual bool close() = 0;
+};
+
+/**
+ * @brief ImageFormat describes a file format which the program reads and writes. The formats are
+ *        kept in a table (see imageformat.cpp). Input files are recognized by their first bytes,
+ *        or by their extension if these match no format, and output files by their extension.
+ *        Files which match nothing are treated as jpg files. Adding a format only takes a reader,
+ *        a writer and an entry in the table. The filename "-" stands for the standard input or
+ *        output (see ImageFormat::isStandardStream()).
+ */
+struct ImageFormat
+{
+    /**
+     * @brief Name of the format.
+     */
+    const char* name;
+
+    /**
+     * @brief Lower case filename extensions of the format, without the dot, ended by a null pointer.
+     */
+    const char* extensions[ 5 ];
+
+    /**
+     * @brief Tests whether the first bytes of a file are those of the format.
+     * @param [in]  head    The first bytes of the file.
+     * @param [in]  size    Number of bytes, at least 4 unless the file is shorter.
+     * @return True if the file is in this format, otherwise false.
+     */
+    bool ( *matches )( const uint8* head, size_t size );
+
+    /**
+     * @brief Reads only the header of a file, without allocating memory for its pixels.
+     * @param [in]  filename    The filename.
+     * @param [out] info        Size, number of color components and, for jpg files, whether it is
+     *                          progressive.
+     * @return True if the file is a supported file of the format, otherwise false.
+     */
+    bool ( *probe )( const char* filename, jpgd::jpeg_header_info* info );
+
+    /**
+     * @brief Same as probe() above, but reads the header of a file which is already in memory.
+     * @param [in]  data        The file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [out] info        Size, number of color components and progressiveness of the file.
+     * @return True if the data is a supported file of the format, otherwise false.
+     */
+    bool ( *probeData )( const uint8* data, size_t size, jpgd::jpeg_header_info* info );
+
+    /**
+     * @brief Creates a reader of the format.
+     * @return A new reader, which must be released with delete.
+     */
+    ImageReader* ( *newReader )();
+
+    /**
+     * @brief Creates a writer of the format.
+     * @param [in]  params  Compression parameters, used by jpg writers (see Image::jpgParams()).
+     * @return A new writer, which must be released with delete.
+     */
+    ImageWriter* ( *newWriter )( const jpge::params& params );
+
+    /**
+     * @brief Tests whether a filename has one of the extensions of the format. Case is ignored.
+     * @param [in]  filename    The filename.
+     * @return True if it has one of the extensions, otherwise false.
+     */
+    bool hasExtension( const char* filename ) const;
+
+    /**
+     * @brief Returns the format of an input file, recognized by its first bytes or its extension.
+     * @param [in]  filename    The input filename.
+     * @return The format. It is never a null pointer.
+     */
+    static const ImageFormat* forInput( const char* filename );
+
+    /**
+     * @brief Returns the format of an output file, chosen by its extension.
+     * @param [in]  filename    The output filename.
+     * @return The format. It is never a null pointer.
+     */
+    static const ImageFormat* forOutput( const char* filename );
+
+    /**
+     * @brief Reads only the header of an input file in its format (see ImageFormat::forInput()).
+     * @param [in]  filename    The input filename, or "-" for the standard input.
+     * @param [out] info        Size, number of color components and progressiveness of the file.
+     * @return True if the file is a supported file of its format, otherwise false.
+     */
+    static bool probeInput( const char* filename, jpgd::jpeg_header_info* info );
+
+    /**
+     * @brief Opens an input file with a reader of its format (see ImageFormat::forInput()).
+     * @param [in]  filename    The input filename.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor (see ImageReader::open()).
+     * @return The open reader, which must be released with delete, or a null pointer on error.
+     */
+    static ImageReader* openReader( const char* filename, int comps, int scale );
+
+    /**
+     * @brief Creates an output file with a writer of its format (see ImageFormat::forOutput()).
+     * @param [in]  filename    Output filename.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [in]  params      Compression parameters of jpg files (see Image::jpgParams()).
+     * @return The open writer, which must be released with delete, or a null pointer on error.
+     */
+    static ImageWriter* openWriter( const char* filename, int width, int height, int comps,
+                                    const jpge::params& params );
+
+    /**
+     * @brief Tests whether a filename stands for the standard input or output: "-", or "-." followed
+     *        by an extension which chooses the format of the output, like "-.qoi".
+     * @param [in]  filename    The filename.
+     * @return True for the standard streams, otherwise false.
+     */
+    static bool isStandardStream( const char* filename );
+
+    /**
+     * @brief Returns the whole standard input. It is read into memory on the first call, so that its
+     *        header can be probed before it is decoded. Later calls return the same data.
+     * @return The data of the standard input.
+     */
+    static const std::vector< uint8 >& standardInput();
+
+    /**
+     * @brief Opens an output file for the writers, with a large buffer so that their small writes
+     *        are gathered into large ones. The standard output is used for "-".
+     * @param [in]  filename    Output filename.
+     * @return The file, or a null pointer on error.
+     */
+    static FILE* openOutput( const char* filename );
+
+    /**
+     * @brief Closes a file opened by ImageFormat::openOutput(). The standard output is only flushed.
+     * @param [in]  file        The file.
+     * @return True if all data was written, otherwise false.
+     */
+    static bool closeOutput( FILE* file );
+};
+
+#endif // IMAGEFORMAT_H
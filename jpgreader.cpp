@@ -0,0 +1,403 @@
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include "jpgreader.h"
+
+/**
+ * @brief Where the restart intervals of a baseline jpg file are, see indexRestarts().
+ */
+struct RestartIndex
+{
+    size_t headerEnd;               // Offset of the entropy coded data, after the SOS segment.
+    size_t heightOffset;            // Offset of the image height in the SOF segment.
+    int height;                     // Image height in pixels.
+    int intervalRows;               // Pixel rows per restart interval.
+    std::vector< size_t > starts;   // Offset of the data of each interval, after its RSTn marker.
+    size_t end;                     // Offset of the marker ending the data, usually EOI.
+};
+
+/**
+ * @brief Converts a decoded scanline to packed pixels.
+ * @param [in]  line    The scanline, 1 (grayscale) or 4 (RGBA) bytes per pixel.
+ * @param [in]  bpp     Bytes per pixel of the scanline.
+ * @param [out] row     Buffer of width * comps bytes.
+ * @param [in]  width   Number of pixels.
+ * @param [in]  comps   Number of color components per pixel of the row: 1 (luma) or 3 (RGB).
+ */
+static void convertLine( const uint8* line, int bpp, uint8* row, int width, int comps )
+{
+    for( int x = 0 ; x < width ; x++ ) {
+        const uint8* px = line + x * bpp;
+        if( comps == 1 ) {
+            // Same luma weights as the decoder uses.
+            row[ x ] = ( bpp == 1 ) ? px[ 0 ] : ( px[ 0 ] * 19595 + px[ 1 ] * 38470 + px[ 2 ] * 7471 + 32768 ) >> 16;
+        }
+        else {
+            row[ x * 3     ] = px[ 0 ];
+            row[ x * 3 + 1 ] = px[ bpp == 1 ? 0 : 1 ];
+            row[ x * 3 + 2 ] = px[ bpp == 1 ? 0 : 2 ];
+        }
+    }
+}
+
+/**
+ * @brief Finds the restart intervals of a baseline jpg file with a single scan, whose restart
+ *        interval is a whole number of MCU rows. Each interval then covers a band of the image
+ *        which can be decoded on its own.
+ * @param [in]  data    The jpg file data.
+ * @param [in]  size    Size of the data in bytes.
+ * @param [out] index   Receives the intervals.
+ * @return True if the file has such intervals, otherwise false.
+ */
+static bool indexRestarts( const uint8* data, size_t size, RestartIndex* index )
+{
+    if( size < 4 || data[ 0 ] != 0xFF || data[ 1 ] != 0xD8 ) {
+        return false;
+    }
+    int width = 0, comps = 0, mcuWidth = 8, mcuHeight = 8, interval = 0;
+    index->height = 0;
+    index->headerEnd = 0;
+    size_t pos = 2;
+    while( index->headerEnd == 0 ) {
+        if( pos + 4 > size || data[ pos ] != 0xFF ) {
+            return false;
+        }
+        int marker = data[ pos + 1 ];
+        if( marker == 0xFF ) {
+            pos++;
+            continue;
+        }
+        size_t length = ( data[ pos + 2 ] << 8 ) | data[ pos + 3 ];
+        const uint8* segment = data + pos + 4;
+        if( length < 2 || pos + 2 + length > size ) {
+            return false;
+        }
+        if( marker == 0xC0 || marker == 0xC1 ) {
+            if( length < 8 ) {
+                return false;
+            }
+            index->heightOffset = pos + 5;
+            index->height = ( segment[ 1 ] << 8 ) | segment[ 2 ];
+            width = ( segment[ 3 ] << 8 ) | segment[ 4 ];
+            comps = segment[ 5 ];
+            if( length < 8 + 3 * (size_t)comps ) {
+                return false;
+            }
+            // A single component is coded in 8x8 blocks, whatever its sampling factors.
+            for( int c = 0 ; c < comps && comps > 1 ; c++ ) {
+                mcuWidth = std::max( mcuWidth, 8 * ( segment[ 7 + 3 * c ] >> 4 ) );
+                mcuHeight = std::max( mcuHeight, 8 * ( segment[ 7 + 3 * c ] & 0x0F ) );
+            }
+        }
+        else if( marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC ) {
+            return false;   // Progressive, lossless or arithmetic coding.
+        }
+        else if( marker == 0xDD && length >= 4 ) {
+            interval = ( segment[ 0 ] << 8 ) | segment[ 1 ];
+        }
+        else if( marker == 0xDA ) {
+            if( segment[ 0 ] != comps ) {
+                return false;   // Not all components in one scan.
+            }
+            index->headerEnd = pos + 2 + length;
+        }
+        pos += 2 + length;
+    }
+    int mcusPerRow = ( width + mcuWidth - 1 ) / mcuWidth;
+    if( index->height == 0 || mcusPerRow == 0 || interval == 0 || interval % mcusPerRow != 0 ) {
+        return false;
+    }
+    index->intervalRows = interval / mcusPerRow * mcuHeight;
+
+    // The entropy coded data only contains 0xFF bytes followed by a zero byte, fill bytes and the
+    // RSTn markers, until the marker ending the scan.
+    index->starts.assign( 1, index->headerEnd );
+    pos = index->headerEnd;
+    for( ;; ) {
+        const uint8* ff = (const uint8*)memchr( data + pos, 0xFF, size - pos );
+        if( ff == 0 || ff + 1 >= data + size ) {
+            return false;
+        }
+        pos = ff - data;
+        int marker = data[ pos + 1 ];
+        if( marker == 0x00 ) {
+            pos += 2;
+        }
+        else if( marker == 0xFF ) {
+            pos++;
+        }
+        else if( marker >= 0xD0 && marker <= 0xD7 ) {
+            pos += 2;
+            index->starts.push_back( pos );
+        }
+        else {
+            break;
+        }
+    }
+    index->end = pos;
+    size_t intervals = ( index->height + index->intervalRows - 1 ) / index->intervalRows;
+    return index->starts.size() == intervals;
+}
+
+/**
+ * @brief Decodes a band of restart intervals of a jpg file. The band is copied into a jpg file of
+ *        its own: the header of the file with the height of the band, the intervals with their
+ *        restart markers numbered from RST0, and an EOI marker.
+ * @param [in]  data    The jpg file data.
+ * @param [in]  index   The restart intervals of the file (see indexRestarts()).
+ * @param [in]  first   Index of the first interval of the band.
+ * @param [in]  last    Index of the interval after the band.
+ * @param [out] buffer  Buffer receiving the packed pixels of the whole image.
+ * @param [in]  width   Image width.
+ * @param [in]  comps   Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @param [out] ok      Set to true if the band was decoded.
+ */
+static void decodeBand( const uint8* data, const RestartIndex* index, size_t first, size_t last,
+                        uint8* buffer, int width, int comps, bool* ok )
+{
+    *ok = false;
+    int y0 = first * index->intervalRows;
+    int y1 = std::min( (int)( last * index->intervalRows ), index->height );
+    std::vector< uint8 > band( data, data + index->headerEnd );
+    band[ index->heightOffset ] = ( y1 - y0 ) >> 8;
+    band[ index->heightOffset + 1 ] = ( y1 - y0 ) & 0xFF;
+    for( size_t i = first ; i < last ; i++ ) {
+        if( i > first ) {
+            band.push_back( 0xFF );
+            band.push_back( 0xD0 + ( ( i - first - 1 ) & 7 ) );
+        }
+        size_t end = ( i + 1 < index->starts.size() ) ? index->starts[ i + 1 ] - 2 : index->end;
+        band.insert( band.end(), data + index->starts[ i ], data + end );
+    }
+    band.push_back( 0xFF );
+    band.push_back( 0xD9 );
+
+    jpgd::jpeg_decoder_mem_stream stream( &band[ 0 ], (jpgd::uint)band.size() );
+    jpgd::jpeg_decoder* decoder = new jpgd::jpeg_decoder( &stream );
+    if( decoder->get_error_code() == jpgd::JPGD_SUCCESS && decoder->begin_decoding() == jpgd::JPGD_SUCCESS ) {
+        int bpp = decoder->get_bytes_per_pixel();
+        int y = y0;
+        for( ; y < y1 ; y++ ) {
+            const uint8* line;
+            jpgd::uint len;
+            if( decoder->decode( (const void**)&line, &len ) != jpgd::JPGD_SUCCESS ) {
+                break;
+            }
+            convertLine( line, bpp, buffer + (size_t)y * width * comps, width, comps );
+        }
+        *ok = ( y == y1 );
+    }
+    delete decoder;
+}
+
+/**
+ * @brief JPGReader constructor. Constructs a reader without an open file.
+ */
+JPGReader::JPGReader() : mData( 0 ), mSize( 0 ), mDecoder( 0 ), mComps( 3 ), mScale( 1 ), mWidth( 0 ), mHeight( 0 )
+{
+}
+
+/* Destructor */
+JPGReader::~JPGReader()
+{
+    delete mDecoder;
+}
+
+/**
+ * @brief Opens a jpg file and reads its header.
+ * @param [in]  filename    The jpg filename.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+ *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+ * @return True on success, otherwise false.
+ */
+bool JPGReader::open( const char* filename, int comps, int scale )
+{
+    if( mDecoder || !mStream.open( filename ) ) {
+        return false;
+    }
+    mData = mStream.get_data();
+    mSize = mStream.get_size();
+    return begin( &mStream, comps, scale );
+}
+
+/**
+ * @brief Same as JPGReader::open() above, but reads a jpg file which is already in memory.
+ * @param [in]  data        The jpg file data.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor (see JPGReader::open() above).
+ * @return True on success, otherwise false.
+ */
+bool JPGReader::open( const uint8* data, size_t size, int comps, int scale )
+{
+    if( mDecoder || size > 0x7FFFFFFF || !mMemStream.open( data, (jpgd::uint)size ) ) {
+        return false;
+    }
+    mData = data;
+    mSize = size;
+    return begin( &mMemStream, comps, scale );
+}
+
+/**
+ * @brief Closes the file, so that the reader can open another one. The row buffers are kept.
+ */
+void JPGReader::close()
+{
+    delete mDecoder;
+    mDecoder = 0;
+    mStream.close();
+    mMemStream.close();
+    mData = 0;
+    mSize = 0;
+}
+
+/**
+ * @brief Creates the decoder on an opened stream and reads the header.
+ * @param [in]  stream      The input stream.
+ * @param [in]  comps       Number of color components per pixel of the rows.
+ * @param [in]  scale       Shrink factor.
+ * @return True on success, otherwise false.
+ */
+bool JPGReader::begin( jpgd::jpeg_decoder_stream* stream, int comps, int scale )
+{
+    mDecoder = new jpgd::jpeg_decoder( stream );
+    if( mDecoder->get_error_code() != jpgd::JPGD_SUCCESS || mDecoder->begin_decoding() != jpgd::JPGD_SUCCESS ) {
+        return false;
+    }
+
+    mComps = comps;
+    mScale = scale < 1 ? 1 : scale;
+    mWidth = mDecoder->get_width() / mScale;
+    mHeight = mDecoder->get_height() / mScale;
+    mSums.assign( mWidth * mComps, 0 );
+    return mWidth >= 1 && mHeight >= 1;
+}
+
+/**
+ * @brief Returns the width of the decoded rows.
+ * @return The width in pixels.
+ */
+int JPGReader::width()
+{
+    return mWidth;
+}
+
+/**
+ * @brief Returns the number of rows.
+ * @return The height in pixels.
+ */
+int JPGReader::height()
+{
+    return mHeight;
+}
+
+/**
+ * @brief Returns the number of color components of the jpg file.
+ * @return 1 for grayscale, 3 for color files.
+ */
+int JPGReader::components()
+{
+    return mDecoder ? mDecoder->get_num_components() : 0;
+}
+
+/**
+ * @brief Decodes the next row.
+ * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+ * @return True on success, false on a decoding error.
+ */
+bool JPGReader::read( uint8* row )
+{
+    if( mDecoder == 0 ) {
+        return false;
+    }
+
+    // The decoder returns either 1 (grayscale) or 4 (RGBA) bytes per pixel.
+    int bpp = mDecoder->get_bytes_per_pixel();
+    int w = mWidth;
+    int comps = mComps;
+    for( int y = 0 ; y < mScale ; y++ ) {
+        const uint8* line;
+        jpgd::uint len;
+        if( mDecoder->decode( (const void**)&line, &len ) != jpgd::JPGD_SUCCESS ) {
+            return false;
+        }
+
+        // Without shrinking, the scanline is converted straight into the row.
+        if( mScale == 1 ) {
+            convertLine( line, bpp, row, w, comps );
+            return true;
+        }
+
+        // Add the scanline to the sums of the row.
+        for( int x = 0 ; x < w * mScale ; x++ ) {
+            const uint8* px = line + x * bpp;
+            unsigned int* sum = &mSums[ ( x / mScale ) * comps ];
+            if( comps == 1 ) {
+                sum[ 0 ] += ( bpp == 1 ) ? px[ 0 ] : ( px[ 0 ] * 19595 + px[ 1 ] * 38470 + px[ 2 ] * 7471 + 32768 ) >> 16;
+            }
+            else {
+                sum[ 0 ] += px[ 0 ];
+                sum[ 1 ] += px[ bpp == 1 ? 0 : 1 ];
+                sum[ 2 ] += px[ bpp == 1 ? 0 : 2 ];
+            }
+        }
+    }
+
+    // After scale scanlines the row is complete.
+    int area = mScale * mScale;
+    for( int i = 0 ; i < w * comps ; i++ ) {
+        row[ i ] = ( mSums[ i ] + area / 2 ) / area;
+        mSums[ i ] = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes all rows into a buffer. Files in memory (or mapped) whose restart intervals
+ *        span whole MCU rows are split into bands of intervals, which are decoded on one thread
+ *        per core, each by its own decoder. Other files, shrunk images and files which fail to
+ *        decode in bands are decoded row by row (see ImageReader::decode()).
+ * @param [out] buffer      Buffer of width() * height() * comps bytes receiving the packed pixels.
+ * @param [in]  comps       Number of color components per pixel, as passed to open().
+ * @param [in]  callback    Function called for each row in row order, after all rows are decoded
+ *                          when decoding in bands, or a null pointer.
+ * @param [in]  user        User data passed to the callback.
+ * @return True on success, false on a decoding error.
+ */
+bool JPGReader::decode( uint8* buffer, int comps, RowCallback callback, void* user )
+{
+    RestartIndex index;
+    size_t threads = std::thread::hardware_concurrency();
+    if( mDecoder == 0 || mScale != 1 || threads < 2 || mData == 0 || !indexRestarts( mData, mSize, &index ) ||
+        index.starts.size() < 2 ) {
+        return ImageReader::decode( buffer, comps, callback, user );
+    }
+
+    // Give each thread an equal share of the intervals, in row order.
+    size_t intervals = index.starts.size();
+    size_t bands = std::min( threads, intervals );
+    std::vector< std::thread > workers;
+    bool ok[ 64 ];
+    bands = std::min( bands, sizeof( ok ) / sizeof( ok[ 0 ] ) );
+    for( size_t b = 1 ; b < bands ; b++ ) {
+        workers.push_back( std::thread( decodeBand, mData, &index, b * intervals / bands, ( b + 1 ) * intervals / bands,
+                                        buffer, mWidth, comps, &ok[ b ] ) );
+    }
+    decodeBand( mData, &index, 0, intervals / bands, buffer, mWidth, comps, &ok[ 0 ] );
+    bool all = ok[ 0 ];
+    for( size_t b = 1 ; b < bands ; b++ ) {
+        workers[ b - 1 ].join();
+        all = all && ok[ b ];
+    }
+
+    // The decoder of the reader has only read the header so far, so it can still decode the file
+    // row by row if a band failed.
+    if( !all ) {
+        return ImageReader::decode( buffer, comps, callback, user );
+    }
+    for( int y = 0 ; callback && y < mHeight ; y++ ) {
+        callback( buffer + (size_t)y * mWidth * comps, mWidth, y, user );
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+#ifndef JPGREADER_H
+#define JPGREADER_H
+
+#include <vector>
+#include <jpgd/jpgd.h>
+#include "rgbpixel.h"
+#include "imageformat.h"
+
+/**
+ * @brief The JPGReader class decodes a jpg file one row at a time, optionally shrunk by an integer
+ *        factor. Only the current row is held in memory, so images of any size can be read as long
+ *        as the caller does not keep them (see Image::decode() for the whole image at once).
+ *        Files with restart markers at MCU row boundaries are decoded in parallel bands when the
+ *        whole image is read at once (see JPGReader::decode()).
+ */
+class JPGReader : public ImageReader
+{
+public: /* methods */
+    /**
+     * @brief JPGReader constructor. Constructs a reader without an open file.
+     */
+    JPGReader();
+
+    /* Destructor */
+    ~JPGReader();
+
+    /**
+     * @brief Opens a jpg file and reads its header.
+     * @param [in]  filename    The jpg filename.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+     *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int comps, int scale );
+
+    /**
+     * @brief Same as JPGReader::open() above, but reads a jpg file which is already in memory, for
+     *        example a frame of an MJPEG stream (see FrameSource) or the standard input. The data must
+     *        stay valid until the reader is closed.
+     * @param [in]  data        The jpg file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor (see JPGReader::open() above).
+     * @return True on success, otherwise false.
+     */
+    bool open( const uint8* data, size_t size, int comps, int scale );
+
+    /**
+     * @brief Closes the file, so that the reader can open another one. The row buffers are kept.
+     */
+    void close();
+
+    /**
+     * @brief Returns the width of the decoded rows.
+     * @return The width in pixels.
+     */
+    int width();
+
+    /**
+     * @brief Returns the number of rows.
+     * @return The height in pixels.
+     */
+    int height();
+
+    /**
+     * @brief Returns the number of color components of the jpg file.
+     * @return 1 for grayscale, 3 for color files.
+     */
+    int components();
+
+    /**
+     * @brief Decodes the next row.
+     * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+     * @return True on success, false on a decoding error.
+     */
+    bool read( uint8* row );
+
+    /**
+     * @brief Decodes all rows into a buffer. Files in memory (or mapped) whose restart intervals
+     *        span whole MCU rows are split into bands of intervals, which are decoded on one thread
+     *        per core, each by its own decoder. Other files, shrunk images and files which fail to
+     *        decode in bands are decoded row by row (see ImageReader::decode()).
+     * @param [out] buffer      Buffer of width() * height() * comps bytes receiving the packed pixels.
+     * @param [in]  comps       Number of color components per pixel, as passed to open().
+     * @param [in]  callback    Function called for each row in row order, after all rows are decoded
+     *                          when decoding in bands, or a null pointer.
+     * @param [in]  user        User data passed to the callback.
+     * @return True on success, false on a decoding error.
+     */
+    bool decode( uint8* buffer, int comps, RowCallback callback, void* user );
+
+private: /* methods */
+    /**
+     * @brief Creates the decoder on an opened stream and reads the header.
+     * @param [in]  stream      The input stream.
+     * @param [in]  comps       Number of color components per pixel of the rows.
+     * @param [in]  scale       Shrink factor.
+     * @return True on success, otherwise false.
+     */
+    bool begin( jpgd::jpeg_decoder_stream* stream, int comps, int scale );
+
+private: /* member variables */
+    /**
+     * @brief The input file.
+     */
+    jpgd::jpeg_decoder_mmap_stream mStream;
+
+    /**
+     * @brief The input data of a jpg file in memory.
+     */
+    jpgd::jpeg_decoder_mem_stream mMemStream;
+
+    /**
+     * @brief The jpg file data if it is in memory or mapped, otherwise a null pointer.
+     */
+    const uint8* mData;
+
+    /**
+     * @brief Size of the jpg file data in bytes.
+     */
+    size_t mSize;
+
+    /**
+     * @brief The decoder, or a null pointer if no file is open.
+     */
+    jpgd::jpeg_decoder* mDecoder;
+
+    /**
+     * @brief Number of color components per pixel of the rows.
+     */
+    int mComps;
+
+    /**
+     * @brief Shrink factor.
+     */
+    int mScale;
+
+    /**
+     * @brief Width of the decoded rows.
+     */
+    int mWidth;
+
+    /**
+     * @brief Number of rows.
+     */
+    int mHeight;
+
+    /**
+     * @brief Sums of the input pixels of a row while shrinking.
+     */
+    std::vector< unsigned int > mSums;
+};
+
+#endif // JPGREADER_H
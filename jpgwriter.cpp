@@ -0,0 +1,98 @@
+#include "jpgwriter.h"
+
+/**
+ * @brief JPGWriter constructor. Constructs a writer without an open file.
+ * @param [in]  params  Compression parameters (see Image::jpgParams()).
+ */
+JPGWriter::JPGWriter( const jpge::params& params ) : mParams( params )
+{
+}
+
+/**
+ * @brief Creates a jpg file.
+ * @param [in]  filename    Output filename.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::open( const char* filename, int width, int height, int comps )
+{
+    return mStream.open( filename ) && mEncoder.init( &mStream, width, height, comps, mParams );
+}
+
+/**
+ * @brief Returns the number of times all rows have to be written.
+ * @return The number of passes of the encoder.
+ */
+int JPGWriter::passes()
+{
+    return mEncoder.get_total_passes();
+}
+
+/**
+ * @brief Encodes the next row of the current pass.
+ * @param [in]  row     The width * comps packed pixels of the row.
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::write( const uint8* row )
+{
+    return mEncoder.process_scanline( row );
+}
+
+/**
+ * @brief Ends the current pass, after all rows have been written.
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::endPass()
+{
+    return mEncoder.process_scanline( 0 );
+}
+
+/**
+ * @brief Closes the file, after all passes.
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::close()
+{
+    mEncoder.deinit();
+    return mStream.close();
+}
+
+/**
+ * @brief Opens the output file.
+ * @param [in]  filename    Output filename, or "-" for the standard output.
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::FileStream::open( const char* filename )
+{
+    close();
+    mFile = ImageFormat::openOutput( filename );
+    mOk = mFile != 0;
+    return mOk;
+}
+
+/**
+ * @brief Closes the output file.
+ * @return True if all data was written, otherwise false.
+ */
+bool JPGWriter::FileStream::close()
+{
+    if( mFile ) {
+        mOk = ImageFormat::closeOutput( mFile ) && mOk;
+        mFile = 0;
+    }
+    return mOk;
+}
+
+/**
+ * @brief Writes encoded data.
+ * @param [in]  buf     The data.
+ * @param [in]  len     Size of the data in bytes.
+ * @return True on success, otherwise false.
+ */
+bool JPGWriter::FileStream::put_buf( const void* buf, int len )
+{
+    mOk = mOk && fwrite( buf, len, 1, mFile ) == 1;
+    return mOk;
+}
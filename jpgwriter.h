@@ -0,0 +1,91 @@
+#ifndef JPGWRITER_H
+#define JPGWRITER_H
+
+#include <jpgd/jpge.h>
+#include "imageformat.h"
+
+/**
+ * @brief The JPGWriter class encodes a jpg file one row at a time. With optimized Huffman tables
+ *        the encoder needs the rows twice, unless it caches their coefficients (see jpge::params).
+ */
+class JPGWriter : public ImageWriter
+{
+public: /* methods */
+    /**
+     * @brief JPGWriter constructor. Constructs a writer without an open file.
+     * @param [in]  params  Compression parameters (see Image::jpgParams()).
+     */
+    JPGWriter( const jpge::params& params );
+
+    /**
+     * @brief Creates a jpg file.
+     * @param [in]  filename    Output filename.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int width, int height, int comps );
+
+    /**
+     * @brief Returns the number of times all rows have to be written.
+     * @return The number of passes of the encoder.
+     */
+    int passes();
+
+    /**
+     * @brief Encodes the next row of the current pass.
+     * @param [in]  row     The width * comps packed pixels of the row.
+     * @return True on success, otherwise false.
+     */
+    bool write( const uint8* row );
+
+    /**
+     * @brief Ends the current pass, after all rows have been written.
+     * @return True on success, otherwise false.
+     */
+    bool endPass();
+
+    /**
+     * @brief Closes the file, after all passes.
+     * @return True on success, otherwise false.
+     */
+    bool close();
+
+private: /* types */
+    /**
+     * @brief Output stream of the encoder over a file opened by ImageFormat::openOutput(), which
+     *        may be the standard output.
+     */
+    class FileStream : public jpge::output_stream
+    {
+    public:
+        FileStream() : mFile( 0 ), mOk( false ) {}
+        ~FileStream() { close(); }
+        bool open( const char* filename );
+        bool close();
+        bool put_buf( const void* buf, int len );
+
+    private:
+        FILE* mFile;
+        bool mOk;
+    };
+
+private: /* member variables */
+    /**
+     * @brief The compression parameters.
+     */
+    jpge::params mParams;
+
+    /**
+     * @brief The output file of the encoder.
+     */
+    FileStream mStream;
+
+    /**
+     * @brief The encoder.
+     */
+    jpge::jpeg_encoder mEncoder;
+};
+
+#endif // JPGWRITER_H
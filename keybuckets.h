@@ -0,0 +1,151 @@
+#ifndef KEYBUCKETS_H
+#define KEYBUCKETS_H
+
+#include <vector>
+#include <algorithm>
+#include "rgbpixel.h"
+
+/**
+ * @brief The KeyBuckets class summarizes the colors of an image by sorting key, in memory which does
+ *        not depend on the number of pixels. The key buckets of a sorting key (see sortkey.h) are
+ *        merged into at most MAX_BUCKETS coarse buckets, and each bucket accumulates the number of
+ *        its pixels and the sum of their colors. With detail enabled, each bucket is further split
+ *        into CELLS cells by the two most significant bits of each color component, so that the
+ *        different hues of equally bright pixels are kept apart.
+ *
+ *        The summary approximates the sorted pixels: KeyBuckets::color() returns the mean color of
+ *        the cell which the n-th pixel in descending key order belongs to.
+ */
+template< class Key >
+class KeyBuckets
+{
+public: /* methods */
+    /**
+     * @brief KeyBuckets constructor. Constructs an empty summary.
+     * @param [in]  detail  True to split the buckets into cells.
+     */
+    KeyBuckets( bool detail ) : mShift( 0 ), mCellsPerBucket( detail ? CELLS : 1 )
+    {
+        while( ( ( Key::BUCKETS - 1 ) >> mShift ) + 1 > MAX_BUCKETS ) mShift++;
+        mCells.resize( ( ( ( Key::BUCKETS - 1 ) >> mShift ) + 1 ) * mCellsPerBucket );
+    }
+
+    /**
+     * @brief Adds the pixels of a row.
+     * @param [in]  row     Packed RGB pixels.
+     * @param [in]  width   Number of pixels.
+     */
+    void add( const uint8* row, int width )
+    {
+        for( int x = 0 ; x < width ; x++ ) {
+            const uint8* px = row + x * 3;
+            long i = (long)( Key::bucket( px[ 0 ], px[ 1 ], px[ 2 ] ) >> mShift ) * mCellsPerBucket;
+            if( mCellsPerBucket > 1 ) {
+                i += ( ( px[ 0 ] >> 6 ) << 4 ) | ( ( px[ 1 ] >> 6 ) << 2 ) | ( px[ 2 ] >> 6 );
+            }
+            Cell& cell = mCells[ i ];
+            cell.count++;
+            cell.sum[ 0 ] += px[ 0 ];
+            cell.sum[ 1 ] += px[ 1 ];
+            cell.sum[ 2 ] += px[ 2 ];
+        }
+    }
+
+    /**
+     * @brief Orders the cells by descending key. Must be called after all pixels have been added.
+     */
+    void finish()
+    {
+        // Each bucket is a key range, so the buckets are in key order already. Cells of a bucket
+        // are ordered by the key of their mean color.
+        mEnds.clear();
+        mColors.clear();
+        std::vector< std::pair< double, long > > cells;
+        for( long b = (long)( mCells.size() / mCellsPerBucket ) - 1 ; b >= 0 ; b-- ) {
+            cells.clear();
+            for( long i = b * mCellsPerBucket ; i < ( b + 1 ) * mCellsPerBucket ; i++ ) {
+                const Cell& cell = mCells[ i ];
+                if( cell.count ) {
+                    uint8 rgb[ 3 ];
+                    mean( cell, rgb );
+                    cells.push_back( std::make_pair( -Key::key( rgb[ 0 ], rgb[ 1 ], rgb[ 2 ] ), i ) );
+                }
+            }
+            std::sort( cells.begin(), cells.end() );
+            for( size_t c = 0 ; c < cells.size() ; c++ ) {
+                const Cell& cell = mCells[ cells[ c ].second ];
+                uint8 rgb[ 3 ];
+                mean( cell, rgb );
+                mEnds.push_back( ( mEnds.empty() ? 0 : mEnds.back() ) + cell.count );
+                mColors.push_back( rgb[ 0 ] );
+                mColors.push_back( rgb[ 1 ] );
+                mColors.push_back( rgb[ 2 ] );
+            }
+        }
+    }
+
+    /**
+     * @brief Returns the approximate color of a pixel in descending key order.
+     * @param [in]  rank    Index of the pixel in descending key order (0 to count() - 1).
+     * @param [out] rgb     The R, G and B components of the color.
+     */
+    inline void color( long long rank, uint8* rgb ) const
+    {
+        size_t i = std::upper_bound( mEnds.begin(), mEnds.end(), (unsigned long long)rank ) - mEnds.begin();
+        if( i >= mEnds.size() ) {
+            i = mEnds.size() - 1;
+        }
+        rgb[ 0 ] = mColors[ i * 3 ];
+        rgb[ 1 ] = mColors[ i * 3 + 1 ];
+        rgb[ 2 ] = mColors[ i * 3 + 2 ];
+    }
+
+    /**
+     * @brief Returns the memory used by a summary in bytes.
+     * @param [in]  detail  True if the buckets are split into cells.
+     * @return The memory used, at most.
+     */
+    static size_t memoryUsage( bool detail )
+    {
+        return MAX_BUCKETS * ( detail ? CELLS : 1 ) * ( sizeof( Cell ) + sizeof( unsigned long long ) + 3 );
+    }
+
+public: /* constants */
+    /**
+     * @brief Maximum number of buckets.
+     */
+    static const int MAX_BUCKETS = 1024;
+
+    /**
+     * @brief Number of cells per bucket with detail enabled.
+     */
+    static const int CELLS = 64;
+
+private: /* types */
+    /**
+     * @brief Number of pixels and sum of their colors.
+     */
+    struct Cell
+    {
+        Cell() : count( 0 ) { sum[ 0 ] = sum[ 1 ] = sum[ 2 ] = 0; }
+        unsigned long long count;
+        unsigned long long sum[ 3 ];
+    };
+
+private: /* methods */
+    static void mean( const Cell& cell, uint8* rgb )
+    {
+        for( int c = 0 ; c < 3 ; c++ ) {
+            rgb[ c ] = (uint8)( ( cell.sum[ c ] + cell.count / 2 ) / cell.count );
+        }
+    }
+
+private: /* member variables */
+    int mShift;                                 // Right shift merging key buckets into coarse buckets.
+    int mCellsPerBucket;                        // 1, or CELLS with detail enabled.
+    std::vector< Cell > mCells;                 // The cells of all buckets.
+    std::vector< unsigned long long > mEnds;    // Cumulative pixel counts of the non-empty cells by descending key.
+    std::vector< uint8 > mColors;               // Mean colors of the non-empty cells by descending key.
+};
+
+#endif // KEYBUCKETS_H
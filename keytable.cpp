@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "keytable.h"
+
+/**
+ * @brief Magic tag of cached key tables (see CacheFile).
+ */
+static const char KEYTABLE_MAGIC[ 8 ] = { 'I', 'G', 'K', 'E', 'Y', 'L', 'U', 'T' };
+
+/**
+ * @brief Layout of the table entries. Increase it when the quantization or the indexing changes.
+ */
+static const unsigned int KEYTABLE_FORMAT = 1;
+
+/**
+ * @brief Quantizes a key from 0 to 1 to a table entry.
+ */
+static unsigned short quantize( double key )
+{
+    key = key < 0 ? 0 : ( key > 1 ? 1 : key );
+    return (unsigned short)( key * 65535 + 0.5 );
+}
+
+/**
+ * @brief Returns the version of the table of a key function: a hash (FNV-1a) of the table format
+ *        and size and of the entries of 4096 colors spread over the RGB cube. A table cached before
+ *        the key function changed gets another version, so it is built again instead of mapped.
+ * @param [in]  function    Function computing the key of a color.
+ * @return The version.
+ */
+static unsigned int tableVersion( KeyTable::KeyFunction function )
+{
+    unsigned int hash = 2166136261u;
+    unsigned int words[ 2 ] = { KEYTABLE_FORMAT, (unsigned int)KeyTable::BYTES };
+    for( int i = 0 ; i < 2 ; i++ ) {
+        hash = ( hash ^ words[ i ] ) * 16777619u;
+    }
+    for( int r = 0 ; r < 256 ; r += 17 ) {
+        for( int g = 0 ; g < 256 ; g += 17 ) {
+            for( int b = 0 ; b < 256 ; b += 17 ) {
+                hash = ( hash ^ quantize( function( r, g, b ) ) ) * 16777619u;
+            }
+        }
+    }
+    return hash;
+}
+
+/**
+ * @brief KeyTable constructor. Loads the table from the cache directory, or builds and stores it.
+ * @param [in]  name        Name of the key, used as the name of the cached file.
+ * @param [in]  function    Function computing the key of a color.
+ */
+KeyTable::KeyTable( const char* name, KeyFunction function ) : mTable( 0 ), mBuilt( 0 )
+{
+    std::string file = std::string( name ) + ".lut";
+    unsigned int version = tableVersion( function );
+    if( mFile.map( file, KEYTABLE_MAGIC, BYTES, version ) ) {
+        mTable = (const unsigned short*)mFile.data();
+        return;
+    }
+    build( function );
+    CacheFile::write( file, KEYTABLE_MAGIC, mTable, BYTES, version );
+}
+
+/* Destructor */
+KeyTable::~KeyTable()
+{
+    free( mBuilt );
+}
+
+/**
+ * @brief Computes the key of every color.
+ * @param [in]  function    Function computing the key of a color.
+ */
+void KeyTable::build( KeyFunction function )
+{
+    unsigned short* table = (unsigned short*)malloc( BYTES );
+    if( table == 0 ) {
+        std::fprintf( stderr, "Out of memory while building a key table\n" );
+        exit( 2 );
+    }
+    for( long c = 0 ; c < ENTRIES ; c++ ) {
+        table[ c ] = quantize( function( c >> 16, ( c >> 8 ) & 0xFF, c & 0xFF ) );
+    }
+    mTable = mBuilt = table;
+}
+
+/**
+ * @brief Converts an sRGB color component to linear light, from 0 to 1.
+ */
+static double linearize( uint8 c )
+{
+    static double table[ 256 ];
+    static bool initialized = false;
+    if( !initialized ) {
+        for( int i = 0 ; i < 256 ; i++ ) {
+            double v = i / 255.0;
+            table[ i ] = ( v <= 0.04045 ) ? v / 12.92 : std::pow( ( v + 0.055 ) / 1.055, 2.4 );
+        }
+        initialized = true;
+    }
+    return table[ c ];
+}
+
+/**
+ * @brief CIE 1976 lightness L* of an sRGB color, scaled from 0 to 1.
+ */
+double cieLightness( uint8 r, uint8 g, uint8 b )
+{
+    // Relative luminance Y of the D65 white point, then L* = 116 f(Y) - 16.
+    double y = 0.2126729 * linearize( r ) + 0.7151522 * linearize( g ) + 0.0721750 * linearize( b );
+    double f = ( y > 216.0 / 24389 ) ? std::pow( y, 1.0 / 3 ) : ( 24389.0 / 27 * y + 16 ) / 116;
+    return ( 116 * f - 16 ) / 100;
+}
+
+/**
+ * @brief OKLab lightness L of an sRGB color, from 0 to 1.
+ */
+double oklabLightness( uint8 r, uint8 g, uint8 b )
+{
+    // Linear sRGB to the LMS cone responses, cube root, then the lightness row of the OKLab matrix.
+    double lr = linearize( r ), lg = linearize( g ), lb = linearize( b );
+    double l = 0.4122214708 * lr + 0.5363325363 * lg + 0.0514459929 * lb;
+    double m = 0.2119034982 * lr + 0.6806995451 * lg + 0.1073969566 * lb;
+    double s = 0.0883024619 * lr + 0.2817188376 * lg + 0.6299787005 * lb;
+    return 0.2104542553 * std::pow( l, 1.0 / 3 ) + 0.7936177850 * std::pow( m, 1.0 / 3 ) -
+           0.0040720468 * std::pow( s, 1.0 / 3 );
+}
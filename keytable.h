@@ -0,0 +1,92 @@
+#ifndef KEYTABLE_H
+#define KEYTABLE_H
+
+#include <string>
+#include <stddef.h>
+#include "rgbpixel.h"
+#include "cachefile.h"
+
+/**
+ * @brief The KeyTable class holds the precomputed sorting key of every 24-bit color, quantized to
+ *        16 bits. It makes sorting keys which are expensive to compute (see cieLightness() and
+ *        oklabLightness()) cost a single table lookup per pixel.
+ *
+ *        A table is 32 MiB. It is built the first time it is needed and stored in the cache
+ *        directory (see CacheFile::directory()), from where later runs memory map it instead
+ *        of building it again, unless the keys of a sample of colors show that the key function
+ *        changed since. If the cache directory cannot be used, the table is only built in memory.
+ */
+class KeyTable
+{
+public: /* types */
+    /**
+     * @brief Function computing the key of a color, from 0 to 1. It must not decrease where the
+     *        exact key increases, so that the quantized keys keep their order.
+     */
+    typedef double ( *KeyFunction )( uint8 r, uint8 g, uint8 b );
+
+public: /* methods */
+    /**
+     * @brief KeyTable constructor. Loads the table from the cache directory, or builds and stores it.
+     * @param [in]  name        Name of the key, used as the name of the cached file.
+     * @param [in]  function    Function computing the key of a color.
+     */
+    KeyTable( const char* name, KeyFunction function );
+
+    /* Destructor */
+    ~KeyTable();
+
+    /**
+     * @brief Returns the quantized key of a color, from 0 to 65535.
+     * @param [in]  r   The R color component (0-255).
+     * @param [in]  g   The G color component (0-255).
+     * @param [in]  b   The B color component (0-255).
+     * @return The quantized key.
+     */
+    inline unsigned short at( uint8 r, uint8 g, uint8 b ) const
+    {
+        return mTable[ ( r << 16 ) | ( g << 8 ) | b ];
+    }
+
+public: /* constants */
+    /**
+     * @brief Number of entries of a table, one per 24-bit color.
+     */
+    static const long ENTRIES = 1L << 24;
+
+    /**
+     * @brief Memory used by a table in bytes.
+     */
+    static const size_t BYTES = ENTRIES * sizeof( unsigned short );
+
+private: /* methods */
+    void build( KeyFunction function );
+
+private: /* member variables */
+    /**
+     * @brief The table, either mapped (mFile) or allocated (mBuilt).
+     */
+    const unsigned short* mTable;
+
+    /**
+     * @brief The mapped cache file.
+     */
+    CacheFile mFile;
+
+    /**
+     * @brief The table if it has been built by this object, otherwise a null pointer.
+     */
+    unsigned short* mBuilt;
+};
+
+/**
+ * @brief CIE 1976 lightness L* of an sRGB color, scaled from 0 to 1.
+ */
+double cieLightness( uint8 r, uint8 g, uint8 b );
+
+/**
+ * @brief OKLab lightness L of an sRGB color, from 0 to 1.
+ */
+double oklabLightness( uint8 r, uint8 g, uint8 b );
+
+#endif // KEYTABLE_H
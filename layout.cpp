@@ -0,0 +1,434 @@
+#include <map>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <mutex>
+#include "layout.h"
+#include "spiral.h"
+
+/**
+ * @brief Names of the layout types, with the version of their permutations in the cache directory.
+ *        Increase the version of a layout when its algorithm changes, so that permutations cached
+ *        before are built again instead of mapped (see CacheFile).
+ */
+static const struct { const char* name; int type; unsigned int version; } LAYOUT_NAMES[] = {
+    { "spiral", 0, 1 }, { "rings", 1, 1 }, { "hilbert", 2, 1 }, { "zorder", 3, 1 }, { "diagonal", 4, 1 }, { "scanline", 5, 1 }
+};
+
+/**
+ * @brief Magic tag of cached permutations (see CacheFile).
+ */
+static const char LAYOUT_MAGIC[ 8 ] = { 'I', 'G', 'L', 'A', 'Y', 'O', 'U', 'T' };
+
+/**
+ * @brief Memory limit of the cached layouts, see Layout::setCacheLimit().
+ */
+static size_t layoutCacheLimit = 256 * 1024 * 1024;
+
+/**
+ * @brief Lock of the layout cache for threads sharing it, see Layout::acquire().
+ */
+static std::mutex layoutLock;
+
+/**
+ * @brief True if permutations are stored in the cache directory, see Layout::setDiskCache().
+ */
+static bool layoutDiskCache = false;
+
+/**
+ * @brief Returns the cache of layouts, by type, canvas size and start position.
+ */
+static std::map< std::string, Layout* >& layoutCache()
+{
+    static std::map< std::string, Layout* > cache;
+    return cache;
+}
+
+/**
+ * @brief Position of a canvas with its distance to the start position, see Layout::buildRings().
+ */
+struct RingPosition
+{
+    long long distance;     // Squared Euclidean distance.
+    float angle;            // Angle around the start position, -pi to pi.
+    unsigned int position;  // y * width + x.
+
+    bool operator<( const RingPosition& other ) const
+    {
+        return distance < other.distance || ( distance == other.distance && angle < other.angle );
+    }
+};
+
+/**
+ * @brief Layout constructor. The permutation is built when it is first needed.
+ * @param [in]  type    The layout type.
+ * @param [in]  width   Canvas width.
+ * @param [in]  height  Canvas height.
+ * @param [in]  x       Start position in x axis.
+ * @param [in]  y       Start position in y axis.
+ */
+Layout::Layout( Type type, int width, int height, int x, int y ) :
+    mType( type ), mWidth( width ), mHeight( height ), mX( x ), mY( y ), mOrderData( 0 ), mLastUse( 0 ), mUsers( 0 )
+{
+}
+
+/**
+ * @brief Returns the canvas width.
+ * @return The canvas width.
+ */
+int Layout::width()
+{
+    return mWidth;
+}
+
+/**
+ * @brief Returns the canvas height.
+ * @return The canvas height.
+ */
+int Layout::height()
+{
+    return mHeight;
+}
+
+/**
+ * @brief Returns the number of canvas positions.
+ * @return The number of positions, width * height.
+ */
+long Layout::size()
+{
+    return (long)mWidth * mHeight;
+}
+
+/**
+ * @brief Returns the permutation of the canvas positions. Each position is stored as y * width + x.
+ *        The permutation is mapped from the cache directory or built on the first call.
+ * @return The size() positions in the order in which they receive the sorted pixels.
+ */
+const unsigned int* Layout::order()
+{
+    if( mOrderData ) {
+        return mOrderData;
+    }
+    size_t bytes = size() * sizeof( unsigned int );
+    if( layoutDiskCache && mFile.map( fileName(), LAYOUT_MAGIC, bytes, LAYOUT_NAMES[ mType ].version ) ) {
+        mOrderData = (const unsigned int*)mFile.data();
+        return mOrderData;
+    }
+    build();
+    mOrderData = &mOrder[ 0 ];
+    if( layoutDiskCache ) {
+        CacheFile::write( fileName(), LAYOUT_MAGIC, mOrderData, bytes, LAYOUT_NAMES[ mType ].version );
+    }
+    return mOrderData;
+}
+
+/**
+ * @brief Returns the index of a position in the permutation, which makes it the inverse of
+ *        Layout::order(). The spiral computes it in closed form (see Spiral::rank()), other layouts
+ *        build an inverse table on the first call.
+ * @param [in]  x       Position inside the canvas in x axis.
+ * @param [in]  y       Position inside the canvas in y axis.
+ * @return The index of the position in the permutation.
+ */
+long Layout::rank( int x, int y )
+{
+    if( mType == SPIRAL ) {
+        return Spiral::rank( mWidth, mHeight, mX, mY, x, y );
+    }
+    if( mRanks.empty() ) {
+        const unsigned int* positions = order();
+        mRanks.resize( size() );
+        for( long i = 0 ; i < size() ; i++ ) {
+            mRanks[ positions[ i ] ] = i;
+        }
+    }
+    return mRanks[ (long)y * mWidth + x ];
+}
+
+/**
+ * @brief Returns the memory used by the tables of this layout, in bytes.
+ * @return The memory used.
+ */
+size_t Layout::memoryUsage()
+{
+    size_t mapped = mFile.data() ? size() : 0;
+    return ( mapped + mOrder.capacity() + mRanks.capacity() ) * sizeof( unsigned int );
+}
+
+/**
+ * @brief Returns the layout of a canvas. Layouts are cached, so each permutation is only built
+ *        once per canvas size and start position. The returned object is owned by the cache.
+ * @param [in]  name    Name of the layout type (see Layout).
+ * @param [in]  width   Canvas width.
+ * @param [in]  height  Canvas height.
+ * @param [in]  x       Start position in x axis.
+ * @param [in]  y       Start position in y axis.
+ * @return The layout, or a null pointer if there is no layout type with that name.
+ */
+Layout* Layout::get( const std::string& name, int width, int height, int x, int y )
+{
+    Type type;
+    if( !typeOf( name, &type ) ) {
+        return 0;
+    }
+    char key[ 96 ];
+    std::sprintf( key, "%d:%d:%d:%d:%d", (int)type, width, height, x, y );
+    static unsigned long calls = 0;
+    Layout*& layout = layoutCache()[ key ];
+    if( layout == 0 ) {
+        layout = new Layout( type, width, height, x, y );
+    }
+    layout->mLastUse = ++calls;
+    Layout* result = layout;
+    evict( result );
+    return result;
+}
+
+/**
+ * @brief Same as Layout::get(), for threads which share the cache. The permutation is built
+ *        before the layout is returned (see Layout::order()), and the layout is not evicted
+ *        until each thread which acquired it has released it again.
+ * @param [in]  name    Name of the layout type (see Layout).
+ * @param [in]  width   Canvas width.
+ * @param [in]  height  Canvas height.
+ * @param [in]  x       Start position in x axis.
+ * @param [in]  y       Start position in y axis.
+ * @return The layout, or a null pointer if there is no layout type with that name.
+ */
+Layout* Layout::acquire( const std::string& name, int width, int height, int x, int y )
+{
+    std::lock_guard< std::mutex > lock( layoutLock );
+    Layout* layout = get( name, width, height, x, y );
+    if( layout ) {
+        layout->mUsers++;
+        layout->order();
+    }
+    return layout;
+}
+
+/**
+ * @brief Releases a layout returned by Layout::acquire(), so that it can be evicted.
+ * @param [in]  layout  The layout.
+ */
+void Layout::release( Layout* layout )
+{
+    std::lock_guard< std::mutex > lock( layoutLock );
+    layout->mUsers--;
+}
+
+/**
+ * @brief Returns true if a name is the name of a layout type.
+ * @param [in]  name    The name.
+ * @return True for a layout type, otherwise false.
+ */
+bool Layout::exists( const std::string& name )
+{
+    Type type;
+    return typeOf( name, &type );
+}
+
+/**
+ * @brief Deletes all cached layouts.
+ */
+void Layout::clearCache()
+{
+    std::map< std::string, Layout* >& cache = layoutCache();
+    for( std::map< std::string, Layout* >::iterator it = cache.begin() ; it != cache.end() ; ++it ) {
+        delete it->second;
+    }
+    cache.clear();
+}
+
+/**
+ * @brief Sets the memory limit of the cached layouts. When the limit is exceeded, the least
+ *        recently used layouts are deleted. Default: 256 MiB.
+ * @param [in]  bytes   The memory limit in bytes.
+ */
+void Layout::setCacheLimit( size_t bytes )
+{
+    layoutCacheLimit = bytes;
+}
+
+/**
+ * @brief Enables storing the permutations in the cache directory (see CacheFile). Disabled by
+ *        default, since a permutation takes four bytes per pixel on disk.
+ * @param [in]  enabled True to map and store the permutations, false to build them in memory.
+ */
+void Layout::setDiskCache( bool enabled )
+{
+    layoutDiskCache = enabled;
+}
+
+/**
+ * @brief Deletes the least recently used layouts until the cached layouts fit into the memory limit.
+ *        Layouts which threads have acquired are kept too (see Layout::acquire()).
+ * @param [in]  keep    Layout which must not be deleted.
+ */
+void Layout::evict( Layout* keep )
+{
+    std::map< std::string, Layout* >& cache = layoutCache();
+    std::map< std::string, Layout* >::iterator it;
+    for( ;; ) {
+        size_t total = 0;
+        std::map< std::string, Layout* >::iterator oldest = cache.end();
+        for( it = cache.begin() ; it != cache.end() ; ++it ) {
+            total += it->second->memoryUsage();
+            if( it->second != keep && it->second->mUsers == 0 && ( oldest == cache.end() || it->second->mLastUse < oldest->second->mLastUse ) ) {
+                oldest = it;
+            }
+        }
+        if( total <= layoutCacheLimit || oldest == cache.end() ) {
+            return;
+        }
+        delete oldest->second;
+        cache.erase( oldest );
+    }
+}
+
+/**
+ * @brief Returns the name of the file storing the permutation in the cache directory.
+ * @return The file name.
+ */
+std::string Layout::fileName()
+{
+    char name[ 96 ];
+    std::sprintf( name, "%s-%dx%d-%d-%d.map", LAYOUT_NAMES[ mType ].name, mWidth, mHeight, mX, mY );
+    return name;
+}
+
+/**
+ * @brief Looks up a layout type by name.
+ * @param [in]  name    The name.
+ * @param [out] type    The layout type.
+ * @return True if there is a layout type with that name, otherwise false.
+ */
+bool Layout::typeOf( const std::string& name, Type* type )
+{
+    for( size_t i = 0 ; i < sizeof( LAYOUT_NAMES ) / sizeof( LAYOUT_NAMES[ 0 ] ) ; i++ ) {
+        if( name.compare( LAYOUT_NAMES[ i ].name ) == 0 ) {
+            *type = (Type)LAYOUT_NAMES[ i ].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Builds the permutation.
+ */
+void Layout::build()
+{
+    mOrder.reserve( (long)mWidth * mHeight );
+    switch( mType ) {
+    case SPIRAL:    buildSpiral(); break;
+    case RINGS:     buildRings(); break;
+    case HILBERT:
+    case ZORDER:    buildCurve(); break;
+    case DIAGONAL:  buildDiagonal(); break;
+    case SCANLINE:  buildScanline(); break;
+    }
+}
+
+/**
+ * @brief Builds the permutation of the spiral layout by walking the spiral.
+ */
+void Layout::buildSpiral()
+{
+    Spiral spiral( mWidth, mHeight, mX, mY );
+    int x, y;
+    while( spiral.next( &x, &y ) ) {
+        mOrder.push_back( (unsigned int)y * mWidth + x );
+    }
+}
+
+/**
+ * @brief Builds the permutation of the rings layout by sorting the positions by their distance to
+ *        the start position. Positions at the same distance are ordered by their angle.
+ */
+void Layout::buildRings()
+{
+    std::vector< RingPosition > positions( (long)mWidth * mHeight );
+    for( int y = 0 ; y < mHeight ; y++ ) {
+        for( int x = 0 ; x < mWidth ; x++ ) {
+            RingPosition& p = positions[ (long)y * mWidth + x ];
+            long long dx = x - mX, dy = y - mY;
+            p.distance = dx * dx + dy * dy;
+            p.angle = (float)std::atan2( (double)dy, (double)dx );
+            p.position = (unsigned int)y * mWidth + x;
+        }
+    }
+    std::sort( positions.begin(), positions.end() );
+    for( size_t i = 0 ; i < positions.size() ; i++ ) {
+        mOrder.push_back( positions[ i ].position );
+    }
+}
+
+/**
+ * @brief Builds the permutation of the Hilbert and Z-order layouts. The curve covers the smallest
+ *        power of two square containing the canvas. The positions of the canvas are sorted by their
+ *        index along the curve, which skips the parts of the square outside of the canvas.
+ */
+void Layout::buildCurve()
+{
+    unsigned long long n = 1;
+    while( n < (unsigned long long)mWidth || n < (unsigned long long)mHeight ) n <<= 1;
+
+    std::vector< std::pair< unsigned long long, unsigned int > > positions( (long)mWidth * mHeight );
+    for( int y = 0 ; y < mHeight ; y++ ) {
+        for( int x = 0 ; x < mWidth ; x++ ) {
+            unsigned long long d = 0;
+            if( mType == HILBERT ) {
+                // Descend the quadrants of the curve, rotating the position into each quadrant.
+                unsigned long long cx = x, cy = y;
+                for( unsigned long long s = n / 2 ; s > 0 ; s /= 2 ) {
+                    unsigned long long rx = ( cx & s ) > 0;
+                    unsigned long long ry = ( cy & s ) > 0;
+                    d += s * s * ( ( 3 * rx ) ^ ry );
+                    if( ry == 0 ) {
+                        if( rx == 1 ) {
+                            cx = n - 1 - cx;
+                            cy = n - 1 - cy;
+                        }
+                        std::swap( cx, cy );
+                    }
+                }
+            }
+            else {
+                // Interleave the bits of x and y.
+                for( int bit = 0 ; ( 1ULL << bit ) < n ; bit++ ) {
+                    d |= ( (unsigned long long)( ( x >> bit ) & 1 ) << ( 2 * bit ) ) |
+                         ( (unsigned long long)( ( y >> bit ) & 1 ) << ( 2 * bit + 1 ) );
+                }
+            }
+            positions[ (long)y * mWidth + x ] = std::make_pair( d, (unsigned int)y * mWidth + x );
+        }
+    }
+    std::sort( positions.begin(), positions.end() );
+    for( size_t i = 0 ; i < positions.size() ; i++ ) {
+        mOrder.push_back( positions[ i ].second );
+    }
+}
+
+/**
+ * @brief Builds the permutation of the diagonal layout. Each diagonal runs from its top right to its
+ *        bottom left end.
+ */
+void Layout::buildDiagonal()
+{
+    for( int s = 0 ; s < mWidth + mHeight - 1 ; s++ ) {
+        int x = std::min( s, mWidth - 1 );
+        for( int y = s - x ; x >= 0 && y < mHeight ; x--, y++ ) {
+            mOrder.push_back( (unsigned int)y * mWidth + x );
+        }
+    }
+}
+
+/**
+ * @brief Builds the permutation of the scanline layout.
+ */
+void Layout::buildScanline()
+{
+    for( long i = 0 ; i < size() ; i++ ) {
+        mOrder.push_back( (unsigned int)i );
+    }
+}
@@ -0,0 +1,205 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "cachefile.h"
+
+/**
+ * @brief The Layout class decides where the sorted pixels go on the output canvas. A layout is a
+ *        permutation of the canvas positions: the i-th position of the permutation receives the
+ *        i-th pixel, starting with the pixel with the largest key.
+ *
+ *        Permutations only depend on the layout type, the canvas size and the start position, so
+ *        they are built once and shared by all images of the same size (see Layout::get()). Recently
+ *        used layouts are kept in memory, and the permutations can be stored in the cache directory
+ *        too, from where later runs memory map them (see Layout::setDiskCache()). The available
+ *        layouts are:
+ *
+ *        - spiral:   A square spiral around the start position (see Spiral).
+ *        - rings:    Concentric circles around the start position, by Euclidean distance.
+ *        - hilbert:  A Hilbert curve from the top left corner. Neighboring pixels in the sorted
+ *                    order stay close on the canvas.
+ *        - zorder:   A Z-order (Morton) curve from the top left corner.
+ *        - diagonal: Diagonals from the top left to the bottom right corner.
+ *        - scanline: Rows from top to bottom, each from left to right.
+ */
+class Layout
+{
+public: /* methods */
+    /**
+     * @brief Returns the canvas width.
+     * @return The canvas width.
+     */
+    int width();
+
+    /**
+     * @brief Returns the canvas height.
+     * @return The canvas height.
+     */
+    int height();
+
+    /**
+     * @brief Returns the number of canvas positions.
+     * @return The number of positions, width * height.
+     */
+    long size();
+
+    /**
+     * @brief Returns the permutation of the canvas positions. Each position is stored as y * width + x.
+     *        The permutation is mapped from the cache directory or built on the first call.
+     * @return The size() positions in the order in which they receive the sorted pixels.
+     */
+    const unsigned int* order();
+
+    /**
+     * @brief Returns the index of a position in the permutation, which makes it the inverse of
+     *        Layout::order(). The spiral computes it in closed form (see Spiral::rank()), other layouts
+     *        build an inverse table on the first call.
+     * @param [in]  x       Position inside the canvas in x axis.
+     * @param [in]  y       Position inside the canvas in y axis.
+     * @return The index of the position in the permutation.
+     */
+    long rank( int x, int y );
+
+    /**
+     * @brief Returns the memory used by the tables of this layout, in bytes.
+     * @return The memory used.
+     */
+    size_t memoryUsage();
+
+public: /* static methods */
+    /**
+     * @brief Returns the layout of a canvas. Layouts are cached, so each permutation is only built
+     *        once per canvas size and start position. The returned object is owned by the cache and
+     *        stays valid until the next call, which may evict it (see Layout::setCacheLimit()).
+     * @param [in]  name    Name of the layout type (see Layout).
+     * @param [in]  width   Canvas width.
+     * @param [in]  height  Canvas height.
+     * @param [in]  x       Start position in x axis.
+     * @param [in]  y       Start position in y axis.
+     * @return The layout, or a null pointer if there is no layout type with that name.
+     */
+    static Layout* get( const std::string& name, int width, int height, int x, int y );
+
+    /**
+     * @brief Same as Layout::get(), for threads which share the cache. The permutation is built
+     *        before the layout is returned (see Layout::order()), and the layout is not evicted
+     *        until each thread which acquired it has released it again.
+     * @param [in]  name    Name of the layout type (see Layout).
+     * @param [in]  width   Canvas width.
+     * @param [in]  height  Canvas height.
+     * @param [in]  x       Start position in x axis.
+     * @param [in]  y       Start position in y axis.
+     * @return The layout, or a null pointer if there is no layout type with that name.
+     */
+    static Layout* acquire( const std::string& name, int width, int height, int x, int y );
+
+    /**
+     * @brief Releases a layout returned by Layout::acquire(), so that it can be evicted.
+     * @param [in]  layout  The layout.
+     */
+    static void release( Layout* layout );
+
+    /**
+     * @brief Returns true if a name is the name of a layout type.
+     * @param [in]  name    The name.
+     * @return True for a layout type, otherwise false.
+     */
+    static bool exists( const std::string& name );
+
+    /**
+     * @brief Deletes all cached layouts.
+     */
+    static void clearCache();
+
+    /**
+     * @brief Sets the memory limit of the cached layouts. When the limit is exceeded, the least
+     *        recently used layouts are deleted. Default: 256 MiB.
+     * @param [in]  bytes   The memory limit in bytes.
+     */
+    static void setCacheLimit( size_t bytes );
+
+    /**
+     * @brief Enables storing the permutations in the cache directory (see CacheFile). Disabled by
+     *        default, since a permutation takes four bytes per pixel on disk.
+     * @param [in]  enabled True to map and store the permutations, false to build them in memory.
+     */
+    static void setDiskCache( bool enabled );
+
+private: /* methods */
+    /**
+     * @brief The layout types.
+     */
+    enum Type { SPIRAL, RINGS, HILBERT, ZORDER, DIAGONAL, SCANLINE };
+
+    Layout( Type type, int width, int height, int x, int y );
+    std::string fileName();
+    static void evict( Layout* keep );
+    void build();
+    void buildSpiral();
+    void buildRings();
+    void buildCurve();
+    void buildDiagonal();
+    void buildScanline();
+    static bool typeOf( const std::string& name, Type* type );
+
+private: /* member variables */
+    /**
+     * @brief The layout type.
+     */
+    Type mType;
+
+    /**
+     * @brief Canvas width.
+     */
+    int mWidth;
+
+    /**
+     * @brief Canvas height.
+     */
+    int mHeight;
+
+    /**
+     * @brief Start position in x axis.
+     */
+    int mX;
+
+    /**
+     * @brief Start position in y axis.
+     */
+    int mY;
+
+    /**
+     * @brief The permutation, either mapped (mFile) or built (mOrder), or a null pointer until needed.
+     */
+    const unsigned int* mOrderData;
+
+    /**
+     * @brief The permutation if it has been built by this object.
+     */
+    std::vector< unsigned int > mOrder;
+
+    /**
+     * @brief The permutation mapped from the cache directory.
+     */
+    CacheFile mFile;
+
+    /**
+     * @brief The inverse permutation, empty until built.
+     */
+    std::vector< unsigned int > mRanks;
+
+    /**
+     * @brief When this layout was last returned by Layout::get(), in calls to Layout::get().
+     */
+    unsigned long mLastUse;
+
+    /**
+     * @brief Number of threads using this layout (see Layout::acquire()).
+     */
+    int mUsers;
+};
+
+#endif // LAYOUT_H
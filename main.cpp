@@ -6,23 +6,142 @@
 
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
 #include "image.h"
+#include "colorhistogram.h"
+#include "sortkey.h"
+#include "layout.h"
+#include "spiral.h"
+#include "externalsort.h"
+#include "keybuckets.h"
+#include "framesource.h"
+#include "imageformat.h"
+#include "permutation.h"
+#include "boundedqueue.h"
+
+/* -------------------------------------------------------------------------------------------------
+ * Command line options (see main()).
+ * ------------------------------------------------------------------------------------------------- */
+struct Options
+{
+    std::string key;        // Sorting parameter, one of SORT_KEY_NAMES (see sortkey.h).
+    std::string sort;       // Sorting mode: "pixels", "histogram", "counting", "external" or "approximate".
+    double memBudget;       // Memory budget in bytes, 0 for no limit.
+    bool downscale;         // Shrink images exceeding the memory budget instead of rejecting them.
+    bool stream;            // Stream the output scanlines into the jpg encoder.
+    std::string layout;     // Output layout, see Layout.
+    bool layoutCache;       // Store the layout permutations in the cache directory.
+    double memLimit;        // Memory used by the external sorting mode in bytes.
+    std::string scratch;    // Directory of the scratch files of the external sorting mode.
+    bool detail;            // Split the key buckets of the approximate sorting mode by color.
+    bool sequence;          // The input and output are frame sequences (see gradientSequence()).
+    std::string permutation; // File receiving the source index of each output pixel, or empty.
+    bool permutationDelta;  // Delta-compress the permutation file (see Permutation).
+    std::string apply;      // Permutation file to apply instead of sorting, or empty.
+    JPGSettings jpg;        // Settings of jpg outputs.
+    int stages[ 3 ];        // Threads of the decode, sort and encode stages of a sequence, 0 for automatic.
+    int queueFrames;        // Frames waiting between two stages of a sequence, at most.
+};
 
 /* -------------------------------------------------------------------------------------------------
  * Forward declarations
  * ------------------------------------------------------------------------------------------------- */
-Image* radialize( std::vector< RGBPixel* >* pixels, int w, int h, int x, int y );
-bool lightnessSorter( RGBPixel* px1, RGBPixel* px2 );
-bool valueSorter( RGBPixel* px1, RGBPixel* px2 );
+Image* radialize( std::vector< RGBPixel* >* pixels, Layout* layout );
+bool radializeToFile( std::vector< RGBPixel* >* pixels, Layout* layout, char* filename, const JPGSettings& settings );
+Layout* centeredLayout( const std::string& name, int w, int h );
+bool gradient( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+template< class Key > bool gradient( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+template< class Key > bool gradientPixels( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+template< class Key > bool gradientHistogram( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+template< class Key > bool gradientCounting( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+template< class Key > void countKeys( const uint8* row, int width, int /*y*/, void* user );
+template< class Key > void radializeByCounts( uint8* pixels, uint8* sorted, long n, std::vector< long >* counts,
+                                              const unsigned int* order, unsigned int* sources );
+template< class Key > bool gradientExternal( char* input, char* output, int scale, const Options& options );
+template< class Key > bool gradientApproximate( char* input, char* output, int scale, const Options& options );
+template< class Key > bool gradientSequence( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+bool gradientGray( char* input, char* output, int scale, const Options& options, bool* tooLarge );
+bool writePermutation( const std::vector< unsigned int >& sources, Layout* layout, const Options& options );
+bool applyPermutation( char* input, char* output, Permutation* permutation, int comps, const JPGSettings& settings,
+                       bool* tooLarge );
+bool parseOptions( int argc, char* argv[], Options* options );
+double estimatePeakMemory( const jpgd::jpeg_header_info& info, int scale, const Options& options );
+void printUsage( char* program );
+void printTooLarge( const Options& options );
 
 /* -------------------------------------------------------------------------------------------------
  * The main program.
  *
- * Usage: ./ImgGradient <input.jpg> <output.jpg> <lightness or value>
- * This program will only accept jpg files only.
+ * Usage: ./ImgGradient <input.jpg> <output.jpg> <key> [options]
+ *        ./ImgGradient <input.jpg> <output.jpg> --apply <permutation> [--mem-budget <MiB>] [--restart <rows>]
+ *                      [--progressive] [--target-size <KiB>]
+ * This program will only accept jpg files, raw netpbm files (".ppm", ".pgm", ".pnm" or ".pam") and
+ * lossless QOI files (".qoi"), which skip the jpg codecs for pipelines passing images between
+ * stages. Input files are recognized by their content, output files by their extension (see
+ * ImageFormat). "-" reads the input from the standard input and writes the output to the standard
+ * output, as a jpg file, or in the format of the extension after "-." (like "-.qoi").
  * Parameter "lightness" will sort the pixels by lightness and "value" will sort
- * the pixels by value.
+ * the pixels by value. "luma" (Rec. 709), "hue", "saturation" and "chroma" are also
+ * supported, as well as the perceptual lightness keys "cielab" (CIE L*) and "oklab" (OKLab L),
+ * which are looked up in precomputed tables (see sortkey.h and KeyTable).
+ * "--apply" instead of a sorting parameter reorders the input like the image a permutation file was
+ * written for (see --permutation), without sorting, e.g. to apply the gradient of a master image to
+ * other grades of the same shot. The input must have the size of that image.
+ *
+ * Options:
+ * --mem-budget <MiB>   Maximum estimated memory use. Larger images are rejected before
+ *                      they are decoded. 0 disables the check. Default: 4096.
+ * --downscale          Shrink images that exceed the memory budget instead of rejecting them.
+ * --stream             Generate the output scanlines on demand while writing the jpg file instead
+ *                      of creating the whole output image first (see radializeToFile()).
+ * --sort <mode>        "pixels" sorts every pixel (default). "histogram" sorts only the distinct
+ *                      colors and expands their counts while writing the output, which is much
+ *                      faster and smaller for images with few colors (see gradientHistogram()).
+ *                      "counting" counts the sorting keys while the image is decoded and sorts
+ *                      the pixels with a counting sort (see gradientCounting()).
+ *                      "external" sorts on disk, with bounded memory (see gradientExternal()).
+ *                      "approximate" renders a preview from the mean colors of key ranges, with
+ *                      memory independent of the image size (see gradientApproximate()).
+ * --mem-limit <MiB>    Memory used by the external sorting mode. Default: 1024.
+ * --scratch <dir>      Directory of the scratch files of the external sorting mode.
+ *                      Default: $TMPDIR, or /tmp.
+ * --detail             Keep different colors of a key range apart in the approximate sorting mode.
+ * --layout <name>      Where the sorted pixels go: "spiral" (default), "rings", "hilbert", "zorder",
+ *                      "diagonal" or "scanline" (see Layout).
+ * --layout-cache       Store the layout permutations in the cache directory and memory map them
+ *                      when another image of the same size is processed (see Layout::setDiskCache()).
+ * --sequence           The input is a sequence of numbered jpg files, named by a pattern like
+ *                      "frame%04d.jpg", or an MJPEG stream ("-" for the standard input). The output
+ *                      is a pattern too. Each frame is sorted with the counting sorting mode (see
+ *                      gradientSequence()).
+ * --stages <d>,<s>,<e> Threads decoding, sorting and encoding the frames of a sequence at the same
+ *                      time. Default: derived from the number of cores, most of them encoding.
+ * --queue <frames>     Decoded frames waiting to be sorted and sorted frames waiting to be encoded,
+ *                      at most, which bounds the memory of a sequence. Default: 2.
+ * --permutation <file> Also write where each output pixel came from, as a 32 bit source index per
+ *                      output position (see Permutation). Needs the counting sorting mode.
+ * --permutation-delta <file> Same as --permutation, but delta-compressed in layout order. Only one
+ *                      of the two can be given.
+ * --restart <rows>     Write a restart marker every <rows> MCU rows (16 or 8 pixel rows) into jpg
+ *                      outputs. Readers of such files, including this program, can decode the bands
+ *                      between the markers in parallel (see JPGReader::decode()). Default: 0, none.
+ * --progressive        Write progressive jpg outputs, which show a coarse preview of the whole image
+ *                      while they load and are usually a few percent smaller. The encoder keeps the
+ *                      coefficients of the whole output in memory (see JPGSettings). Not available
+ *                      in the external and approximate sorting modes, whose memory is bounded, nor
+ *                      with --restart.
+ * --target-size <KiB>  Write jpg outputs at the highest quality whose file is at most <KiB> large,
+ *                      searched with trial encodes in memory on all cores (see QualitySearch). The
+ *                      program fails if the file does not fit even at quality 1. Needs the whole
+ *                      output in memory, so not available with --stream, --sort external or
+ *                      --sort approximate. Default: 0, quality 85 whatever the size.
  * ------------------------------------------------------------------------------------------------- */
 int main( int argc, char* argv[] )
 {
@@ -30,150 +149,1368 @@ int main( int argc, char* argv[] )
     // Exit program on invalid number of parameters.
     if( argc < 4 ) {
         std::cout << "Invalid number of parameters" << std::endl;
-        std::cout << "Usage: " << argv[ 0 ] << " <input.jpg> <output.jpg> <lightness|value>" << std::endl;
+        printUsage( argv[ 0 ] );
         return 2;
     }
 
-    // Read the input jpg file into an Image object.
-    Image* im = Image::fromJPG( argv[ 1 ] );
-    if( im == 0 ) {
-        std::cout << "Cannot read JPG file. File exists? Valid JPG file?" << std::endl;
+    // The image goes to the standard output, so the messages go to the standard error instead.
+    if( ImageFormat::isStandardStream( argv[ 2 ] ) ) {
+        std::cout.rdbuf( std::cerr.rdbuf() );
+    }
+
+    // Check the sorting parameter and the optional parameters. Exit program if they are not valid.
+    Options options;
+    if( !parseOptions( argc, argv, &options ) ) {
+        printUsage( argv[ 0 ] );
         return 2;
     }
+    Layout::setDiskCache( options.layoutCache );
 
-    // "Flatten" pixels in 1-dimensional array and sort them based on lightness or value
-    // Depending on the supplied last command line parameter.
-    // Exit program if the parameter is not valid.
-    std::vector< RGBPixel* >* flatPixels = Image::flatten( im );
-    if( std::string( argv[ 3 ] ).compare( "lightness" ) == 0 )  {
-        std::sort( flatPixels->begin(), flatPixels->end(), lightnessSorter );
+    // Frame sequences are read frame by frame, so there is no single header to check against the
+    // memory budget. Frames are usually far smaller than the budget anyway.
+    if( options.sequence ) {
+        if( !FrameSource::isPattern( argv[ 2 ] ) ) {
+            std::cout << "The output of a sequence must be a pattern like frame%04d.jpg" << std::endl;
+            return 2;
+        }
+        bool tooLarge = false;
+        if( !gradient( argv[ 1 ], argv[ 2 ], 1, options, &tooLarge ) ) {
+            if( tooLarge ) {
+                printTooLarge( options );
+                return 2;
+            }
+            std::cout << "Cannot read the frames. Files exist? Valid JPG or MJPEG files?" << std::endl;
+            return 2;
+        }
+        return 0;
     }
-    else if( std::string( argv[ 3 ] ).compare( "value" ) == 0 ) {
-        std::sort( flatPixels->begin(), flatPixels->end(), valueSorter );
+
+    // Read only the jpg header first, so that we know the image size before any pixel memory is
+    // allocated. Hostile or simply huge inputs are rejected, or shrunk while decoding if allowed,
+    // when processing them would exceed the memory budget.
+    jpgd::jpeg_header_info info;
+    if( !ImageFormat::probeInput( argv[ 1 ], &info ) ) {
+        std::cout << "Cannot read the input file. File exists? Valid JPG, PNM or QOI file?" << std::endl;
+        return 2;
     }
-    else {
-        std::cout << "Unknown sorting parameter: " << argv[ 3 ] << std::endl;
-        std::cout << "Usage: " << argv[ 0 ] << " <input.jpg> <output.jpg> <lightness|value>" << std::endl;
+
+    // A saved permutation only fits images of the size it was written for. Its layout and encoding
+    // take the place of the options, so that the memory estimate covers them.
+    Permutation permutation;
+    if( !options.apply.empty() ) {
+        if( !permutation.open( options.apply.c_str() ) ) {
+            std::cout << "Cannot read the permutation file: " << options.apply << std::endl;
+            return 2;
+        }
+        if( permutation.width() != info.m_width || permutation.height() != info.m_height ) {
+            std::cout << "The permutation is for " << permutation.width() << "x" << permutation.height()
+                      << " images, the input is " << info.m_width << "x" << info.m_height << std::endl;
+            return 2;
+        }
+        options.layout = permutation.layoutName();
+        options.permutationDelta = permutation.encoding() == Permutation::DELTA;
+    }
+
+    int scale = 1;
+    while( options.memBudget > 0 && estimatePeakMemory( info, scale, options ) > options.memBudget ) {
+        // Shrinking does not help if the decoder alone does not fit into the budget (see estimatePeakMemory()),
+        // and shrunk images do not fit a saved permutation.
+        if( !options.downscale || !options.apply.empty() || info.m_width / ( scale + 1 ) < 1 || info.m_height / ( scale + 1 ) < 1 ||
+            estimatePeakMemory( info, info.m_width + info.m_height, options ) > options.memBudget ) {
+            std::cout << "Image too large for the memory budget: " << info.m_width << "x" << info.m_height << std::endl;
+            return 2;
+        }
+        scale++;
+    }
+    if( scale > 1 ) {
+        std::cout << "Image exceeds the memory budget, shrinking it by a factor of " << scale << std::endl;
+    }
+
+    // A file which does not fit into the target size is no fault of the input, so it is reported apart.
+    bool tooLarge = false;
+    if( !options.apply.empty() ) {
+        if( !applyPermutation( argv[ 1 ], argv[ 2 ], &permutation, info.m_comps, options.jpg, &tooLarge ) ) {
+            if( tooLarge ) {
+                printTooLarge( options );
+                return 2;
+            }
+            std::cout << "Cannot apply the permutation file: " << options.apply << std::endl;
+            return 2;
+        }
+        return 0;
+    }
+
+    // Both value and lightness of a gray pixel equal its luma, so grayscale images skip the RGB
+    // pipeline altogether and are sorted and written as single channel images. The perceptual
+    // lightness keys grow with the luma of gray pixels too. Hue, saturation and chroma are equal
+    // for all gray pixels, so any order, including this one, is sorted by them.
+    if( info.m_comps == 1 && options.sort.compare( "external" ) != 0 && options.sort.compare( "approximate" ) != 0 ) {
+        if( !gradientGray( argv[ 1 ], argv[ 2 ], scale, options, &tooLarge ) ) {
+            if( tooLarge ) {
+                printTooLarge( options );
+                return 2;
+            }
+            std::cout << "Cannot process grayscale image file." << std::endl;
+            return 2;
+        }
+        return 0;
+    }
+
+    // Sort and "radialize" the pixels with the chosen sorting key and mode, and save to jpg, or to
+    // netpbm for netpbm output filenames.
+    // WARNING: Output file name is not checked at all. Extend if necessary.
+    if( !gradient( argv[ 1 ], argv[ 2 ], scale, options, &tooLarge ) ) {
+        if( tooLarge ) {
+            printTooLarge( options );
+            return 2;
+        }
+        std::cout << "Cannot read the input file. File exists? Valid JPG, PNM or QOI file?" << std::endl;
         return 2;
     }
+    return 0;
+}
 
-    // Determine the start position (x, y) for the radialize function. In this case we want
-    // the start position to be in the middle of the canvas.
-    int x = 0.5 * ( im->width() - 1 );
-    int y = 0.5 * ( im->height() - 1 );
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a color jpg file and writes the result as a jpg file. Chooses the sorting
+ * key by its name. Each key instantiates its own copy of the sorting engines (see sortkey.h).
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::decode()).
+ * [in] options Command line options.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool gradient( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    const std::string& key = options.key;
+    if( key.compare( LightnessKey::name() ) == 0 )  return gradient< LightnessKey >( input, output, scale, options, tooLarge );
+    if( key.compare( ValueKey::name() ) == 0 )      return gradient< ValueKey >( input, output, scale, options, tooLarge );
+    if( key.compare( LumaKey::name() ) == 0 )       return gradient< LumaKey >( input, output, scale, options, tooLarge );
+    if( key.compare( HueKey::name() ) == 0 )        return gradient< HueKey >( input, output, scale, options, tooLarge );
+    if( key.compare( SaturationKey::name() ) == 0 ) return gradient< SaturationKey >( input, output, scale, options, tooLarge );
+    if( key.compare( ChromaKey::name() ) == 0 )     return gradient< ChromaKey >( input, output, scale, options, tooLarge );
+    if( key.compare( CieLightnessKey::name() ) == 0 )   return gradient< CieLightnessKey >( input, output, scale, options, tooLarge );
+    if( key.compare( OklabLightnessKey::name() ) == 0 ) return gradient< OklabLightnessKey >( input, output, scale, options, tooLarge );
+    return false;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a color jpg file by a sorting key, with the chosen sorting mode.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::decode()).
+ * [in] options Command line options.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradient( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    if( options.sequence ) {
+        return gradientSequence< Key >( input, output, scale, options, tooLarge );
+    }
+
+    // The histogram and counting sorting modes work on the decoded pixel buffer instead of Image objects.
+    if( options.sort.compare( "histogram" ) == 0 ) {
+        return gradientHistogram< Key >( input, output, scale, options, tooLarge );
+    }
+    if( options.sort.compare( "counting" ) == 0 ) {
+        return gradientCounting< Key >( input, output, scale, options, tooLarge );
+    }
+    if( options.sort.compare( "external" ) == 0 ) {
+        return gradientExternal< Key >( input, output, scale, options );
+    }
+    if( options.sort.compare( "approximate" ) == 0 ) {
+        return gradientApproximate< Key >( input, output, scale, options );
+    }
+    return gradientPixels< Key >( input, output, scale, options, tooLarge );
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a color jpg file pixel by pixel and writes the result as a jpg file.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::fromFile()).
+ * [in] options Command line options. The layout and streaming are used.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradientPixels( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    // Read the input jpg file into an Image object.
+    Image* im = Image::fromFile( input, scale );
+    if( im == 0 ) {
+        return false;
+    }
+
+    // "Flatten" pixels in 1-dimensional array and sort them based on the sorting key.
+    std::vector< RGBPixel* >* flatPixels = Image::flatten( im );
+    std::sort( flatPixels->begin(), flatPixels->end(), PixelOrder< Key >() );
 
     // "Radialize" pixels and save to jpg.
-    // WARNING: Output file name is not checked at all. Extend if necessary.
-    Image* rad = radialize( flatPixels, im->width(), im->height(), x, y );
-    Image::toJPG( rad, argv[ 2 ] );
+    Layout* layout = centeredLayout( options.layout, im->width(), im->height() );
+    bool ok;
+    if( options.stream ) {
+        ok = radializeToFile( flatPixels, layout, output, options.jpg );
+    }
+    else {
+        Image* rad = radialize( flatPixels, layout );
+        ok = Image::toFile( rad, output, options.jpg, tooLarge );
+        delete rad;
+    }
 
     // Free up used memory blocks.
     delete im;
     delete flatPixels;
-    delete rad;
-    return 0;
+    return ok;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Prints the command line usage.
+ *
+ * [in] program The program name (argv[0]).
+ * ------------------------------------------------------------------------------------------------- */
+void printUsage( char* program )
+{
+    std::cout << "Usage: " << program << " <input.jpg> <output.jpg> <lightness|value|luma|hue|saturation|chroma|cielab|oklab>"
+              << " [--mem-budget <MiB>] [--downscale] [--stream] [--sort <pixels|histogram|counting|external|approximate>]"
+              << " [--mem-limit <MiB>] [--scratch <dir>] [--detail] [--sequence]"
+              << " [--layout <spiral|rings|hilbert|zorder|diagonal|scanline>] [--layout-cache]"
+              << " [--permutation <file>] [--permutation-delta <file>] [--restart <rows>] [--progressive]"
+              << " [--target-size <KiB>] [--stages <decode>,<sort>,<encode>] [--queue <frames>]" << std::endl;
+    std::cout << "       " << program << " <input.jpg> <output.jpg> --apply <permutation> [--mem-budget <MiB>] [--restart <rows>] [--progressive]"
+              << " [--target-size <KiB>]" << std::endl;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Prints that an output jpg file does not fit into the target size even at quality 1 (see
+ * QualitySearch). The input was read, so the run fails for the output alone.
+ *
+ * [in] options Command line options. The target size is used.
+ * ------------------------------------------------------------------------------------------------- */
+void printTooLarge( const Options& options )
+{
+    std::cout << "Output does not fit in " << options.jpg.targetSize / 1024.0 << " KiB even at quality 1" << std::endl;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Parses the sorting parameter and the optional parameters following it. Prints a message for the
+ * first invalid parameter.
+ *
+ * [in] argc    Number of command line arguments, at least 4.
+ * [in] argv    Command line arguments.
+ * [out] options Parsed options.
+ *
+ * Returns true if all parameters are valid, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool parseOptions( int argc, char* argv[], Options* options )
+{
+    options->key = argv[ 3 ];
+    options->sort = "pixels";
+    options->memBudget = 4096.0 * 1024 * 1024;
+    options->downscale = false;
+    options->stream = false;
+    options->layout = "spiral";
+    options->layoutCache = false;
+    options->memLimit = 1024.0 * 1024 * 1024;
+    const char* tmp = getenv( "TMPDIR" );
+    options->scratch = ( tmp && *tmp ) ? tmp : "/tmp";
+    options->detail = false;
+    options->sequence = false;
+    options->permutationDelta = false;
+    options->stages[ 0 ] = options->stages[ 1 ] = options->stages[ 2 ] = 0;
+    options->queueFrames = 2;
+
+    // A saved permutation takes the place of the sorting parameter.
+    int first = 4;
+    if( options->key.compare( "--apply" ) == 0 && argc > 4 ) {
+        options->apply = argv[ 4 ];
+        options->key.clear();
+        first = 5;
+    }
+    else if( !isSortKey( options->key ) ) {
+        std::cout << "Unknown sorting parameter: " << argv[ 3 ] << std::endl;
+        return false;
+    }
+
+    for( int i = first ; i < argc ; i++ ) {
+        std::string opt( argv[ i ] );
+        if( opt.compare( "--mem-budget" ) == 0 && i + 1 < argc ) {
+            options->memBudget = std::atof( argv[ ++i ] ) * 1024 * 1024;
+        }
+        else if( opt.compare( "--downscale" ) == 0 ) {
+            options->downscale = true;
+        }
+        else if( opt.compare( "--stream" ) == 0 ) {
+            options->stream = true;
+        }
+        else if( opt.compare( "--sort" ) == 0 && i + 1 < argc ) {
+            options->sort = argv[ ++i ];
+            if( options->sort.compare( "pixels" ) != 0 && options->sort.compare( "histogram" ) != 0 &&
+                options->sort.compare( "counting" ) != 0 && options->sort.compare( "external" ) != 0 &&
+                options->sort.compare( "approximate" ) != 0 ) {
+                std::cout << "Unknown sorting mode: " << argv[ i ] << std::endl;
+                return false;
+            }
+        }
+        else if( opt.compare( "--mem-limit" ) == 0 && i + 1 < argc ) {
+            options->memLimit = std::atof( argv[ ++i ] ) * 1024 * 1024;
+        }
+        else if( opt.compare( "--scratch" ) == 0 && i + 1 < argc ) {
+            options->scratch = argv[ ++i ];
+        }
+        else if( opt.compare( "--detail" ) == 0 ) {
+            options->detail = true;
+        }
+        else if( opt.compare( "--sequence" ) == 0 ) {
+            options->sequence = true;
+        }
+        else if( ( opt.compare( "--permutation" ) == 0 || opt.compare( "--permutation-delta" ) == 0 ) && i + 1 < argc ) {
+            if( !options->permutation.empty() ) {
+                std::cout << "Only one of --permutation and --permutation-delta can be given: " << argv[ i ] << std::endl;
+                return false;
+            }
+            options->permutation = argv[ ++i ];
+            options->permutationDelta = opt.compare( "--permutation-delta" ) == 0;
+        }
+        else if( opt.compare( "--restart" ) == 0 && i + 1 < argc ) {
+            options->jpg.restartRows = std::atoi( argv[ ++i ] );
+            if( options->jpg.restartRows < 0 ) {
+                std::cout << "Invalid number of restart rows: " << argv[ i ] << std::endl;
+                return false;
+            }
+        }
+        else if( opt.compare( "--progressive" ) == 0 ) {
+            options->jpg.progressive = true;
+        }
+        else if( opt.compare( "--target-size" ) == 0 && i + 1 < argc ) {
+            double kib = std::atof( argv[ ++i ] );
+            if( kib < 0 ) {
+                std::cout << "Invalid target size: " << argv[ i ] << std::endl;
+                return false;
+            }
+            options->jpg.targetSize = (size_t)( kib * 1024 );
+        }
+        else if( opt.compare( "--stages" ) == 0 && i + 1 < argc ) {
+            int* stages = options->stages;
+            char end;
+            if( sscanf( argv[ ++i ], "%d,%d,%d%c", &stages[ 0 ], &stages[ 1 ], &stages[ 2 ], &end ) != 3 ||
+                stages[ 0 ] < 1 || stages[ 1 ] < 1 || stages[ 2 ] < 1 ||
+                stages[ 0 ] > 64 || stages[ 1 ] > 64 || stages[ 2 ] > 64 ) {
+                std::cout << "Invalid stage threads, expected <decode>,<sort>,<encode> from 1 to 64: " << argv[ i ] << std::endl;
+                return false;
+            }
+        }
+        else if( opt.compare( "--queue" ) == 0 && i + 1 < argc ) {
+            options->queueFrames = std::atoi( argv[ ++i ] );
+            if( options->queueFrames < 1 ) {
+                std::cout << "Invalid queue depth: " << argv[ i ] << std::endl;
+                return false;
+            }
+        }
+        else if( opt.compare( "--layout-cache" ) == 0 ) {
+            options->layoutCache = true;
+        }
+        else if( opt.compare( "--layout" ) == 0 && i + 1 < argc ) {
+            options->layout = argv[ ++i ];
+            if( !Layout::exists( options->layout ) ) {
+                std::cout << "Unknown layout: " << argv[ i ] << std::endl;
+                return false;
+            }
+        }
+        else {
+            std::cout << "Unknown option: " << argv[ i ] << std::endl;
+            return false;
+        }
+    }
+
+    // Only the counting sort keeps track of the pixels, in a reproducible order.
+    if( !options->permutation.empty() && ( options->sort.compare( "counting" ) != 0 || options->sequence ) ) {
+        std::cout << "--permutation needs --sort counting and a single image" << std::endl;
+        return false;
+    }
+    if( !options->apply.empty() && ( options->sequence || !options->permutation.empty() ) ) {
+        std::cout << "--apply takes a single image and writes no permutation" << std::endl;
+        return false;
+    }
+    if( options->jpg.progressive && ( options->sort.compare( "external" ) == 0 || options->sort.compare( "approximate" ) == 0 ) ) {
+        std::cout << "--progressive keeps the whole output in memory, which --sort external and --sort approximate avoid" << std::endl;
+        return false;
+    }
+    if( options->jpg.progressive && options->jpg.restartRows > 0 ) {
+        std::cout << "--progressive files have no restart markers, --restart can not be used with it" << std::endl;
+        return false;
+    }
+    if( options->jpg.targetSize > 0 && ( options->stream || options->sort.compare( "external" ) == 0 ||
+                                     options->sort.compare( "approximate" ) == 0 ) ) {
+        std::cout << "--target-size encodes the whole output several times, which --stream, --sort external"
+                  << " and --sort approximate can not" << std::endl;
+        return false;
+    }
+    if( ( options->stages[ 0 ] > 0 || options->queueFrames != 2 ) && !options->sequence ) {
+        std::cout << "--stages and --queue only apply to --sequence" << std::endl;
+        return false;
+    }
+    return true;
 }
 
 /* -------------------------------------------------------------------------------------------------
- * Walk from the start position of the image to the right, bottom, left, up while coloring
- * each pixel and repeats such movement step until all image pixels are colored.
+ * Estimates the peak memory needed to process an image, in bytes. The estimate is the larger of
+ * the two phases of the program:
+ *
+ * - Decoding: the decoder itself (a progressive jpg keeps the coefficients of the whole image,
+ *   two bytes per sample, which does not shrink when decoding with a scale factor), the decoded
+ *   pixel buffer (only at full size) and the input Image object.
+ * - Sorting and writing: the input Image object, the flattened pixel array, the output Image
+ *   object and the pixel buffer handed to the jpg encoder. The latter two are not needed when the
+ *   output is streamed.
+ *
+ * Each pixel of an Image object costs a pointer plus a heap allocated RGBPixel, which takes a
+ * minimum sized malloc chunk (about four pointers) rather than its 3 bytes.
+ *
+ * Grayscale images only need the decoder and a single byte per pixel (see gradientGray()). The
+ * histogram sorting mode needs the decoder, three bytes per pixel and the color histogram, which
+ * is 3 MiB of tables plus 8 bytes per distinct color at worst (see gradientHistogram()). The
+ * counting sorting mode needs the decoder and two buffers of three bytes per pixel
+ * (see gradientCounting()). Perceptual sorting keys add their table (see KeyTable) to each mode.
+ *
+ * The external sorting mode needs the decoder and its memory limit, whatever the size of the image
+ * (see gradientExternal()). The approximate sorting mode only needs the decoder and the key
+ * buckets (see gradientApproximate()).
+ *
+ * Applying a permutation file needs the decoder, the input and the output pixel buffers and the
+ * source indices, four bytes per pixel, which are mapped from RAW files. DELTA files need their
+ * layout to be decoded (see applyPermutation()).
+ *
+ * Every mode adds the layout permutation, four bytes per pixel, plus the temporary table of 16
+ * bytes per pixel which the sorted layouts need while they are built (see Layout). Streaming needs
+ * the inverse permutation instead, except for the spiral, which needs no tables at all.
+ *
+ * [in] info    Header information of the input image.
+ * [in] scale   Shrink factor applied while decoding (see Image::fromFile()).
+ * [in] options Command line options. The sorting mode, layout and streaming affect the estimate.
+ *
+ * Returns the estimated peak memory in bytes.
+ * ------------------------------------------------------------------------------------------------- */
+double estimatePeakMemory( const jpgd::jpeg_header_info& info, int scale, const Options& options )
+{
+    const double pixelObjectBytes = sizeof( RGBPixel* ) + 4 * sizeof( void* );
+
+    double fullPixels = (double)info.m_width * info.m_height;
+    double pixels = (double)( info.m_width / scale ) * ( info.m_height / scale );
+
+    double decoder = info.m_progressive_flag ? fullPixels * info.m_comps * 2 : 0;
+    // A progressive jpg output keeps its coefficients too, with chroma subsampled to half a sample per pixel.
+    double samples = pixels * ( info.m_comps == 1 ? 1 : 1.5 );
+    double encoder = options.jpg.progressive ? samples * 2 : 0;
+    // The quality search keeps the DCT of all blocks, and each concurrent trial its coefficients
+    // (about a byte per pixel unless progressive) and its file.
+    if( options.jpg.targetSize > 0 ) {
+        double trial = ( options.jpg.progressive ? encoder : pixels ) + options.jpg.targetSize;
+        encoder = samples * 2 + std::max( 1u, std::thread::hardware_concurrency() ) * trial;
+    }
+    const std::string& name = options.layout;
+    double layout = pixels * 4;
+    if( name.compare( "rings" ) == 0 || name.compare( "hilbert" ) == 0 || name.compare( "zorder" ) == 0 ) {
+        layout += pixels * 16;
+    }
+    double table = isTableKey( options.key ) ? KeyTable::BYTES : 0;
+    if( !options.apply.empty() ) {
+        return decoder + encoder + pixels * info.m_comps * 2 + pixels * 4 + ( options.permutationDelta ? layout : 0 );
+    }
+    if( options.sort.compare( "external" ) == 0 ) {
+        return decoder + options.memLimit + table + ( name.compare( "spiral" ) == 0 ? 0 : layout );
+    }
+    if( options.sort.compare( "approximate" ) == 0 ) {
+        return decoder + encoder + KeyBuckets< ValueKey >::memoryUsage( options.detail ) + table +
+               ( name.compare( "spiral" ) == 0 ? 0 : layout + pixels * 4 );
+    }
+    // The permutation is gathered by rank and scattered by position while it is written.
+    double permutation = options.permutation.empty() ? 0 : pixels * ( options.permutationDelta ? 4 : 8 );
+    if( info.m_comps == 1 ) {
+        return decoder + encoder + pixels + layout + permutation;
+    }
+    if( options.sort.compare( "histogram" ) == 0 ) {
+        return decoder + encoder + pixels * 3 + 3.0 * 1024 * 1024 + std::min( pixels, 16777216.0 ) * 8 + table + layout;
+    }
+    if( options.sort.compare( "counting" ) == 0 ) {
+        return decoder + encoder + pixels * 6 + table + layout + permutation;
+    }
+    if( options.stream ) {
+        layout = ( name.compare( "spiral" ) == 0 ) ? 0 : layout + pixels * 4;
+    }
+    double decoded = ( scale == 1 ) ? pixels * 3 : 0;
+    double decoding = decoder + decoded + pixels * pixelObjectBytes;
+    double sorting = pixels * ( pixelObjectBytes + sizeof( RGBPixel* ) ) + table + layout + encoder;
+    if( !options.stream ) {
+        sorting += pixels * ( pixelObjectBytes + 3 );
+    }
+    return std::max( decoding, sorting );
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Returns the layout of a canvas with the start position in the middle of the canvas.
+ *
+ * [in] name    Name of the layout type (see Layout).
+ * [in] w       Canvas width.
+ * [in] h       Canvas height.
+ *
+ * Returns the layout, which is owned by the layout cache (see Layout::get()).
+ * ------------------------------------------------------------------------------------------------- */
+Layout* centeredLayout( const std::string& name, int w, int h )
+{
+    return Layout::get( name, w, h, 0.5 * ( w - 1 ), 0.5 * ( h - 1 ) );
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Walks the positions of the canvas in the order of a layout, by default a spiral from the start
+ * position to the right, bottom, left, up, while coloring each position, until all image pixels
+ * are colored.
  *
  * [in] pixels  Input pixel data, which is a 1D RGBPixel array.
  *              Because of the number of components in the RGB colorspace,
  *              the size of this array should be image width * image height * 3.
- * [in] w       Image width.
- * [in] h       Image height.
- * [in] x       Start position in x axis.
- * [in] y       Start position in y axis.
+ * [in] layout  The layout of the output canvas.
  *
  * Returns a new image object.
  * ------------------------------------------------------------------------------------------------- */
-Image* radialize( std::vector< RGBPixel* >* pixels, int w, int h, int x, int y )
-{
-    // -------------------------------------------------------------------------------------------------
-    // Define the directions first. Basically the radial movement is:
-    //                           RIGHT -> DOWN -> LEFT -> UP -> repeat.
-    //
-    // We define the first direction is RIGHT and the movement step is 0, which will be incremented
-    // AFTER each DOWN and UP steps.
-    //
-    // Movement example (5 x 5) pixels from the middle of canvas:
-    //
-    // Empty          0 step         1 step RIGHT   1 step DOWN    2 steps LEFT   2 steps UP     3 steps RIGHT
-    // pixels         (step = 0)     (step = 1)     (step = 1)     (step = 2)     (step = 2)     (step = 3)
-    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .
-    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . 6 . . .      . 6 7 8 9
-    // . . . . .  ->  . . 0 . .  ->  . . 0 1 .  ->  . . 0 1 .  ->  . . 0 1 .  ->  . 5 0 1 .  ->  . 5 0 1 .  ->  and so on..
-    // . . . . .      . . . . .      . . . . .      . . . 2 .      . 4 3 2 .      . 4 3 2 .      . 4 3 2 .
-    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .
-    //
-    // -------------------------------------------------------------------------------------------------
-    enum directions { RIGHT, DOWN, LEFT, UP };
-    directions dir = RIGHT;
-    int steps = 0;
-
-    // Create an empty canvas and color the first pixel with the first color in pixel std::vector.
-    Image* im = new Image( w, h );
-    im->setPixel( pixels->back(), x, y );
-    pixels->pop_back();
-
-    // Begin the radial loop. Loop and color pixels as long as there are
-    // still pixels available in the pixel std::vector.
-    while( pixels->size() ) {
-        // Walk to the directions for n steps
-        for( int i = 0 ; i < steps ; i++ ) {
-            // Set the x and y position based on the direction.
-            if      ( dir == RIGHT  )  x++;
-            else if ( dir == DOWN   )  y++;
-            else if ( dir == LEFT   )  x--;
-            else if ( dir == UP     )  y--;
-
-            // If setPixel returns false, then the (x, y) coordinate is out of bounds.
-            // Do not color the pixel if this position is out of bounds.
-            // Otherwise, remove the last pixel element from the list because we have
-            // used this pixel data to color the pixel in position (x, y).
-            if( pixels->size() && im->setPixel( pixels->back(), x, y ) ) {
-                pixels->pop_back();
-            }
-        }
-
-        // If after going down or going up, the number of steps should be incremented.
-        if( dir == DOWN || dir == UP ) steps++;
-
-        // Change direction: RIGHT -> DOWN -> LEFT -> UP -> repeat.
-        if      ( dir == RIGHT  ) dir = DOWN;
-        else if ( dir == DOWN   ) dir = LEFT;
-        else if ( dir == LEFT   ) dir = UP;
-        else if ( dir == UP     ) dir = RIGHT;
+Image* radialize( std::vector< RGBPixel* >* pixels, Layout* layout )
+{
+    // Create an empty canvas and walk its positions in the order of the layout (see Layout::order()),
+    // coloring each position with the last pixel in the pixel std::vector. Remove the last pixel
+    // element from the list once it has been used.
+    int w = layout->width();
+    Image* im = new Image( w, layout->height() );
+    const unsigned int* order = layout->order();
+    for( long i = 0 ; i < layout->size() && pixels->size() ; i++ ) {
+        im->setPixel( pixels->back(), order[ i ] % w, order[ i ] / w );
+        pixels->pop_back();
     }
 
     return im;
 }
 
 /* -------------------------------------------------------------------------------------------------
- * A comparison function to sort two RGBPixel objects by lightness component in HSL colorspace.
- * This custom function is used by std::sort() function.
+ * Does the same as radialize() followed by Image::toFile(), without creating the output image.
+ * Each output scanline is generated when the writer asks for it (see ImageWriter): the color of a position is
+ * looked up in the sorted pixel array by the order in which the layout visits that position (see
+ * Layout::rank()). For the spiral layout this is computed in closed form, without any tables.
+ *
+ * [in] pixels  Input pixel data, sorted (see radialize()). Unlike radialize(), this function
+ *              leaves the array untouched.
+ * [in] layout  The layout of the output canvas.
+ * [in] filename Output jpg or netpbm filename.
+ * [in] settings Settings of jpg outputs.
+ *
+ * Returns true on write success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool radializeToFile( std::vector< RGBPixel* >* pixels, Layout* layout, char* filename, const JPGSettings& settings )
+{
+    int w = layout->width();
+    int h = layout->height();
+    std::unique_ptr< ImageWriter > writer( ImageFormat::openWriter( filename, w, h, 3, Image::jpgParams( 3, settings ) ) );
+    if( !writer ) {
+        return false;
+    }
+
+    // Like radialize(), color the positions starting with the last pixel.
+    long last = (long)pixels->size() - 1;
+    std::vector< uint8 > line( w * 3 );
+    for( int pass = 0 ; pass < writer->passes() ; pass++ ) {
+        for( int py = 0 ; py < h ; py++ ) {
+            for( int px = 0 ; px < w ; px++ ) {
+                RGBPixel* p = pixels->at( last - layout->rank( px, py ) );
+                line[ px * 3     ] = p->r();
+                line[ px * 3 + 1 ] = p->g();
+                line[ px * 3 + 2 ] = p->b();
+            }
+            if( !writer->write( &line[ 0 ] ) ) {
+                return false;
+            }
+        }
+        if( !writer->endPass() ) {
+            return false;
+        }
+    }
+
+    return writer->close();
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a grayscale jpg file and writes the result as a grayscale jpg file.
+ *
+ * The image is decoded to a single byte (luma) per pixel. Since there are only 256 possible luma
+ * values, sorting is a counting sort: the histogram of the luma values is all we need to know.
+ * The sorted values are then written back in the order of the layout from the brightest to the
+ * darkest, reusing the decoded buffer.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::decode()).
+ * [in] options Command line options. The layout is used.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool gradientGray( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    int w, h;
+    uint8* pixels = Image::decode( input, 1, scale, &w, &h );
+    if( pixels == 0 ) {
+        return false;
+    }
+
+    unsigned int histogram[ 256 ] = { 0 };
+    long n = (long)w * h;
+    for( long i = 0 ; i < n ; i++ ) {
+        histogram[ pixels[ i ] ]++;
+    }
+
+    // The permutation ranks the pixels from the brightest to the darkest, in input order.
+    std::vector< unsigned int > sources( options.permutation.empty() ? 0 : n );
+    if( !sources.empty() ) {
+        long starts[ 256 ];
+        long start = 0;
+        for( int luma = 255 ; luma >= 0 ; luma-- ) {
+            starts[ luma ] = start;
+            start += histogram[ luma ];
+        }
+        for( long i = 0 ; i < n ; i++ ) {
+            sources[ starts[ pixels[ i ] ]++ ] = i;
+        }
+    }
+
+    Layout* layout = centeredLayout( options.layout, w, h );
+    const unsigned int* order = layout->order();
+    int luma = 255;
+    for( long i = 0 ; i < n ; i++ ) {
+        while( histogram[ luma ] == 0 ) luma--;
+        pixels[ order[ i ] ] = luma;
+        histogram[ luma ]--;
+    }
+
+    bool ok = Image::encode( pixels, w, h, 1, output, options.jpg, tooLarge );
+    free( pixels );
+    if( ok && !sources.empty() ) {
+        ok = writePermutation( sources, layout, options );
+    }
+    return ok;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Writes the permutation file requested by the options (see Permutation). Prints a message if the
+ * file cannot be written, since the output image already was.
+ *
+ * [in] sources Source index of the pixel of each rank of the layout.
+ * [in] layout  The layout of the output image.
+ * [in] options Command line options. The permutation file and its encoding are used.
+ *
+ * Returns true on write success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool writePermutation( const std::vector< unsigned int >& sources, Layout* layout, const Options& options )
+{
+    Permutation::Encoding encoding = options.permutationDelta ? Permutation::DELTA : Permutation::RAW;
+    if( !Permutation::write( options.permutation.c_str(), &sources[ 0 ], layout, options.layout, encoding ) ) {
+        std::cout << "Cannot write the permutation file: " << options.permutation << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Reorders an image like the image a permutation file was written for (see Permutation), without
+ * sorting it: each output pixel is gathered from the input pixel the permutation names for its
+ * position. RAW permutations are used straight from the mapped file, DELTA permutations are
+ * decoded along their layout first.
+ *
+ * [in] input       Input image filename.
+ * [in] output      Output image filename.
+ * [in] permutation The open permutation file, of the size of the input image.
+ * [in] comps       Number of color components of the input image: 1 (luma) or 3 (RGB).
+ * [in] settings    Settings of jpg outputs.
+ * [out] tooLarge   Set to true if the output jpg file does not fit into the target size even
+ *                  at quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+bool applyPermutation( char* input, char* output, Permutation* permutation, int comps, const JPGSettings& settings,
+                       bool* tooLarge )
+{
+    Layout* layout = 0;
+    if( permutation->encoding() == Permutation::DELTA ) {
+        layout = centeredLayout( permutation->layoutName(), permutation->width(), permutation->height() );
+    }
+    if( !permutation->load( layout ) ) {
+        return false;
+    }
+
+    int w, h;
+    uint8* pixels = Image::decode( input, comps, 1, &w, &h );
+    if( pixels == 0 ) {
+        return false;
+    }
+    uint8* gathered = ( w == permutation->width() && h == permutation->height() ) ? (uint8*)malloc( (long)w * h * comps ) : 0;
+    bool ok = gathered && permutation->apply( pixels, gathered, comps );
+    free( pixels );
+
+    ok = ok && Image::encode( gathered, w, h, comps, output, settings, tooLarge );
+    free( gathered );
+    return ok;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a color jpg file by its color histogram and writes the result as a jpg file.
+ *
+ * Photos of flat artwork, screenshots and palette images have far fewer distinct colors than
+ * pixels. Instead of sorting every pixel, only the distinct colors are sorted (see ColorHistogram)
+ * and each color is then repeated as many times as it occurs while walking the layout, from the
+ * largest to the smallest key, the same order radialize() uses. The
+ * output is written into the decoded buffer, so no Image objects are created.
+ *
+ * Pixels with equal keys may end up in a different order than with the pixel sorting mode, which
+ * does not order them either.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::decode()).
+ * [in] options Command line options. The layout is used.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradientHistogram( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    int w, h;
+    uint8* pixels = Image::decode( input, 3, scale, &w, &h );
+    if( pixels == 0 ) {
+        return false;
+    }
+
+    ColorHistogram histogram( pixels, (long)w * h );
+    histogram.sort< Key >();
+
+    const unsigned int* order = centeredLayout( options.layout, w, h )->order();
+    int color = histogram.size() - 1;
+    unsigned int left = histogram.count( color );
+    for( long i = 0 ; i < (long)w * h ; i++ ) {
+        while( left == 0 ) left = histogram.count( --color );
+        unsigned int c = histogram.color( color );
+        uint8* px = pixels + (long)order[ i ] * 3;
+        px[ 0 ] = c >> 16;
+        px[ 1 ] = ( c >> 8 ) & 0xFF;
+        px[ 2 ] = c & 0xFF;
+        left--;
+    }
+
+    bool ok = Image::encode( pixels, w, h, 3, output, options.jpg, tooLarge );
+    free( pixels );
+    return ok;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Key histogram gathered while decoding (see gradientCounting() and countKeys()).
+ * ------------------------------------------------------------------------------------------------- */
+struct KeyHistogram
+{
+    std::vector< long > counts;             // Number of pixels per key bucket.
+};
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a color jpg file with a counting sort and writes the result as a jpg file.
+ *
+ * Each sorting key maps a color to one of a small number of buckets (see sortkey.h), so the pixels
+ * can be sorted by counting. The keys are counted by a row callback of the
+ * decoder (see countKeys()), while each row is still in the cache, so no separate pass over the
+ * decoded buffer is needed to compute them. The pixels are then scattered into a second buffer in
+ * key order and written back in the order of the layout from the largest to the smallest key, the
+ * same order radialize() uses.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see Image::decode()).
+ * [in] options Command line options. The layout is used.
+ * [out] tooLarge Set to true if the output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradientCounting( char* input, char* output, int scale, const Options& options, bool* tooLarge )
+{
+    KeyHistogram histogram;
+    histogram.counts.assign( Key::BUCKETS, 0 );
+
+    int w, h;
+    uint8* pixels = Image::decode( input, 3, scale, &w, &h, countKeys< Key >, &histogram );
+    if( pixels == 0 ) {
+        return false;
+    }
+    long n = (long)w * h;
+    uint8* sorted = (uint8*)malloc( n * 3 );
+    if( sorted == 0 ) {
+        free( pixels );
+        return false;
+    }
+
+    Layout* layout = centeredLayout( options.layout, w, h );
+    std::vector< unsigned int > sources( options.permutation.empty() ? 0 : n );
+    radializeByCounts< Key >( pixels, sorted, n, &histogram.counts, layout->order(), sources.empty() ? 0 : &sources[ 0 ] );
+    free( sorted );
+
+    bool ok = Image::encode( pixels, w, h, 3, output, options.jpg, tooLarge );
+    free( pixels );
+    if( ok && !sources.empty() ) {
+        ok = writePermutation( sources, layout, options );
+    }
+    return ok;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts pixels with a counting sort and writes them back in the order of a layout, from the
+ * largest to the smallest key (see gradientCounting()).
+ *
+ * [in]     pixels  Packed RGB pixels. Receives the output pixels.
+ * [in]     sorted  Scratch buffer of the same size as the pixels.
+ * [in]     n       Number of pixels.
+ * [in,out] counts  Number of pixels per key bucket (see countKeys()). Used up by the sort.
+ * [in]     order   Permutation of the layout (see Layout::order()).
+ * [out]    sources Receives the source index of the pixel of each rank of the layout, or a null
+ *                  pointer. Pixels with equal keys follow each other in reverse input order.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+void radializeByCounts( uint8* pixels, uint8* sorted, long n, std::vector< long >* counts,
+                        const unsigned int* order, unsigned int* sources )
+{
+    // Turn the counts into the start offset of each key and scatter the pixels.
+    long offset = 0;
+    for( size_t k = 0 ; k < counts->size() ; k++ ) {
+        long count = ( *counts )[ k ];
+        ( *counts )[ k ] = offset;
+        offset += count;
+    }
+    for( long i = 0 ; i < n ; i++ ) {
+        const uint8* px = pixels + i * 3;
+        long slot = ( *counts )[ Key::bucket( px[ 0 ], px[ 1 ], px[ 2 ] ) ]++;
+        uint8* dst = sorted + slot * 3;
+        dst[ 0 ] = px[ 0 ];
+        dst[ 1 ] = px[ 1 ];
+        dst[ 2 ] = px[ 2 ];
+        if( sources ) {
+            sources[ n - 1 - slot ] = i;
+        }
+    }
+
+    for( long i = 0 ; i < n ; i++ ) {
+        const uint8* px = sorted + ( n - 1 - i ) * 3;
+        uint8* dst = pixels + (long)order[ i ] * 3;
+        dst[ 0 ] = px[ 0 ];
+        dst[ 1 ] = px[ 1 ];
+        dst[ 2 ] = px[ 2 ];
+    }
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * A frame of a sequence on its way through the stages of gradientSequence(). The buffers are
+ * reused by the next frame once the frame is written.
+ * ------------------------------------------------------------------------------------------------- */
+struct Frame
+{
+    std::vector< uint8 > jpg;               // The jpg data of the frame.
+    std::vector< uint8 > pixels;            // Packed RGB pixels, later the output pixels.
+    std::vector< uint8 > sorted;            // Scratch buffer of the sort.
+    KeyHistogram histogram;                 // Key counts of the pixels (see countKeys()).
+    int width;
+    int height;
+    int comps;                              // Number of color components of the jpg data.
+    int index;                              // Number of the frame.
+};
+
+/* -------------------------------------------------------------------------------------------------
+ * State shared by the threads of the decode, sort and encode stages of gradientSequence(). Frames
+ * go from stage to stage through bounded queues, and back to the pool once written. A null frame
+ * tells a thread of the next stage that no more frames follow.
+ * ------------------------------------------------------------------------------------------------- */
+struct FramePipeline
+{
+    FramePipeline( size_t frames, size_t depth ) : pool( frames ), decoded( depth ), sorted( depth ) {}
+
+    FrameSource source;
+    std::mutex sourceLock;                  // Serializes reading the jpg data of the frames.
+    BoundedQueue< Frame* > pool;            // Frames whose buffers are free.
+    BoundedQueue< Frame* > decoded;         // Decoded frames, waiting to be sorted.
+    BoundedQueue< Frame* > sorted;          // Sorted frames, waiting to be written.
+    std::atomic< int > decoders;            // Decoding threads still running.
+    std::atomic< int > sorters;             // Sorting threads still running.
+    std::atomic< bool > failed;             // A frame could not be read, decoded or written.
+    std::atomic< bool > tooLarge;           // A frame did not fit into the target size (see JPGSettings).
+    std::atomic< int > written;             // Number of frames written.
+    int encoders;                           // Number of encoding threads.
+    int scale;                              // Shrink factor applied while decoding (see JPGReader).
+    const char* output;                     // Output frame name pattern.
+    std::string layout;                     // Output layout, see Layout.
+    JPGSettings jpg;                        // Settings of the output frames.
+};
+
+/* -------------------------------------------------------------------------------------------------
+ * Decodes the jpg data of a frame and counts its keys, reusing the buffers of the frame.
+ *
+ * [in]  reader  The jpg reader, which is closed again afterwards.
+ * [in]  scale   Shrink factor applied while decoding (see JPGReader).
+ * [out] frame   The frame, whose jpg data is set.
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool decodeFrame( JPGReader* reader, int scale, Frame* frame )
+{
+    if( !reader->open( &frame->jpg[ 0 ], frame->jpg.size(), 3, scale ) ) {
+        reader->close();
+        return false;
+    }
+    int w = reader->width();
+    int h = reader->height();
+    frame->width = w;
+    frame->height = h;
+    frame->comps = ( reader->components() == 1 ) ? 1 : 3;
+    frame->pixels.resize( (size_t)w * h * 3 );
+    frame->histogram.counts.assign( Key::BUCKETS, 0 );
+    for( int y = 0 ; y < h ; y++ ) {
+        uint8* row = &frame->pixels[ (size_t)y * w * 3 ];
+        if( !reader->read( row ) ) {
+            reader->close();
+            return false;
+        }
+        countKeys< Key >( row, w, y, &frame->histogram );
+    }
+    reader->close();
+    return true;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Thread of the decode stage of gradientSequence(). Takes free frames from the pool, reads and
+ * decodes the next frame of the source into them and passes them on to the sort stage, until the
+ * source ends or fails. The last decoding thread to finish ends the sort stage.
+ *
+ * [in] pipeline    The pipeline.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+void decodeFrames( FramePipeline* pipeline )
+{
+    JPGReader reader;
+    for( ;; ) {
+        Frame* frame = pipeline->pool.pop();
+        bool read;
+        {
+            std::lock_guard< std::mutex > lock( pipeline->sourceLock );
+            read = !pipeline->failed && pipeline->source.next( &frame->jpg );
+            if( read ) {
+                frame->index = pipeline->source.index();
+            }
+            else if( pipeline->source.failed() ) {
+                pipeline->failed = true;
+            }
+        }
+        if( read && !decodeFrame< Key >( &reader, pipeline->scale, frame ) ) {
+            pipeline->failed = true;
+            read = false;
+        }
+        if( !read ) {
+            pipeline->pool.push( frame );
+            break;
+        }
+        pipeline->decoded.push( frame );
+    }
+
+    if( --pipeline->decoders == 0 ) {
+        for( int i = pipeline->sorters ; i > 0 ; i-- ) {
+            pipeline->decoded.push( 0 );
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Thread of the sort stage of gradientSequence(). Sorts and "radializes" the decoded frames like
+ * the counting sorting mode (see gradientCounting()) and passes them on to the encode stage. The
+ * last sorting thread to finish ends the encode stage.
  *
- * [in] px1     First pixel.
- * [in] px2     Second pixel.
+ * [in] pipeline    The pipeline.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+void sortFrames( FramePipeline* pipeline )
+{
+    for( Frame* frame ; ( frame = pipeline->decoded.pop() ) != 0 ; ) {
+        if( !pipeline->failed ) {
+            long n = (long)frame->width * frame->height;
+            frame->sorted.resize( n * 3 );
+            Layout* layout = Layout::acquire( pipeline->layout, frame->width, frame->height,
+                                              0.5 * ( frame->width - 1 ), 0.5 * ( frame->height - 1 ) );
+            radializeByCounts< Key >( &frame->pixels[ 0 ], &frame->sorted[ 0 ], n, &frame->histogram.counts, layout->order(), 0 );
+            Layout::release( layout );
+            if( frame->comps == 1 ) {
+                for( long j = 0 ; j < n ; j++ ) {
+                    frame->pixels[ j ] = frame->pixels[ j * 3 ];
+                }
+            }
+        }
+        pipeline->sorted.push( frame );
+    }
+
+    if( --pipeline->sorters == 0 ) {
+        for( int i = pipeline->encoders ; i > 0 ; i-- ) {
+            pipeline->sorted.push( 0 );
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Thread of the encode stage of gradientSequence(). Writes the sorted frames as numbered jpg files
+ * and returns them to the pool.
  *
- * Returns true if px1's lightness is less than px2's.
+ * [in] pipeline    The pipeline.
  * ------------------------------------------------------------------------------------------------- */
-bool lightnessSorter( RGBPixel* px1, RGBPixel* px2 )
+void encodeFrames( FramePipeline* pipeline )
 {
-    return px1->lightness() < px2->lightness();
+    for( Frame* frame ; ( frame = pipeline->sorted.pop() ) != 0 ; ) {
+        if( !pipeline->failed ) {
+            std::string name = FrameSource::frameName( pipeline->output, frame->index );
+            bool tooLarge = false;
+            if( Image::encode( &frame->pixels[ 0 ], frame->width, frame->height, frame->comps, (char*)name.c_str(), pipeline->jpg, &tooLarge ) ) {
+                pipeline->written++;
+            }
+            else {
+                pipeline->tooLarge = pipeline->tooLarge || tooLarge;
+                pipeline->failed = true;
+            }
+        }
+        pipeline->pool.push( frame );
+    }
 }
 
 /* -------------------------------------------------------------------------------------------------
- * A comparison function to sort two RGBPixel objects by value component in HSV colorspace.
- * This custom function is used by std::sort() function.
+ * Sorts and "radializes" the frames of an animation, numbered jpg files or an MJPEG stream (see
+ * FrameSource), and writes each result as a numbered jpg file.
+ *
+ * Frames are sorted like the counting sorting mode (see gradientCounting()). The work runs in three
+ * stages, each on its own threads: decoding (see decodeFrames()), sorting (see sortFrames()) and
+ * encoding (see encodeFrames()), so that the next frames decode while the current ones are sorted
+ * and the previous ones are encoded, and frames of different sizes keep all stages busy. The
+ * stages are connected by bounded lock-free queues (see BoundedQueue). A fixed pool of frames,
+ * whose buffers are reused from frame to frame, makes a stage which runs ahead wait for the slower
+ * ones, so that the memory stays bounded however long the sequence is. The layout of a size is
+ * only built once (see Layout::acquire()). Frames may be written out of order.
  *
- * [in] px1     First pixel.
- * [in] px2     Second pixel.
+ * [in] input   Input frame name pattern or MJPEG filename.
+ * [in] output  Output frame name pattern. Each frame keeps the number of its input frame.
+ * [in] scale   Shrink factor applied while decoding (see JPGReader).
+ * [in] options Command line options. The layout, the stage threads and the queue depth are used.
+ * [out] tooLarge Set to true if an output jpg file does not fit into the target size even at
+ *                quality 1 (see JPGSettings).
  *
- * Returns true if px1's value is less than px2's.
+ * Returns true if at least one frame was read and all frames were written, otherwise false.
  * ------------------------------------------------------------------------------------------------- */
-bool valueSorter( RGBPixel* px1, RGBPixel* px2)
+template< class Key >
+bool gradientSequence( char* input, char* output, int scale, const Options& options, bool* tooLarge )
 {
-    return px1->value() < px2->value();
+    int decoders = options.stages[ 0 ];
+    int sorters = options.stages[ 1 ];
+    int encoders = options.stages[ 2 ];
+    if( decoders == 0 ) {
+        // Encoding a frame takes longer than decoding it, and the counting sort is the fastest stage.
+        int cores = std::max( 1u, std::thread::hardware_concurrency() );
+        decoders = std::max( 1, cores / 3 );
+        sorters = std::max( 1, cores / 6 );
+        encoders = std::max( 1, cores - decoders - sorters );
+    }
+
+    // Each thread holds at most one frame and each queue at most its depth, so no stage ever waits
+    // for a free frame while another stage could work.
+    size_t frames = decoders + sorters + encoders + 2 * options.queueFrames;
+    FramePipeline pipeline( frames, options.queueFrames );
+    if( !pipeline.source.open( input ) ) {
+        return false;
+    }
+    pipeline.decoders = decoders;
+    pipeline.sorters = sorters;
+    pipeline.encoders = encoders;
+    pipeline.failed = false;
+    pipeline.tooLarge = false;
+    pipeline.written = 0;
+    pipeline.scale = scale;
+    pipeline.output = output;
+    pipeline.layout = options.layout;
+    pipeline.jpg = options.jpg;
+    std::vector< Frame > pool( frames );
+    for( size_t i = 0 ; i < frames ; i++ ) {
+        pipeline.pool.push( &pool[ i ] );
+    }
+
+    std::vector< std::thread > threads;
+    for( int i = 0 ; i < decoders ; i++ ) {
+        threads.push_back( std::thread( decodeFrames< Key >, &pipeline ) );
+    }
+    for( int i = 0 ; i < sorters ; i++ ) {
+        threads.push_back( std::thread( sortFrames< Key >, &pipeline ) );
+    }
+    for( int i = 0 ; i < encoders ; i++ ) {
+        threads.push_back( std::thread( encodeFrames, &pipeline ) );
+    }
+    for( size_t i = 0 ; i < threads.size() ; i++ ) {
+        threads[ i ].join();
+    }
+    *tooLarge = pipeline.tooLarge;
+    return !pipeline.failed && pipeline.written > 0;
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * A pixel of the external sorting mode (see gradientExternal()).
+ * ------------------------------------------------------------------------------------------------- */
+struct PackedPixel
+{
+    uint8 rgb[ 3 ];
+};
+
+/* -------------------------------------------------------------------------------------------------
+ * Orders two pixels of the external sorting mode by descending sorting key.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+struct DescendingKey
+{
+    bool operator()( const PackedPixel& px1, const PackedPixel& px2 ) const
+    {
+        return Key::key( px1.rgb[ 0 ], px1.rgb[ 1 ], px1.rgb[ 2 ] ) > Key::key( px2.rgb[ 0 ], px2.rgb[ 1 ], px2.rgb[ 2 ] );
+    }
+};
+
+/* -------------------------------------------------------------------------------------------------
+ * Sorts and "radializes" a jpg file of any size with bounded memory and writes the result as a jpg
+ * file. No pass holds the whole image in memory:
+ *
+ * 1. The decoded rows are sorted by descending key with an external sort (see ExternalSort), which
+ *    spills sorted runs to a scratch file whenever half of the memory limit is used.
+ * 2. The runs are merged, and each pixel is paired with the next position of the layout, packed
+ *    as position << 24 | RGB. The pairs are sorted by position with a second external sort, which
+ *    gets the other half of the memory limit.
+ * 3. The pairs are merged, which yields the output pixels in row order, and streamed into the jpg
+ *    encoder. The encoder does not cache the whole image for its optimized Huffman tables (see
+ *    Image::jpgParams()). It encodes twice instead, rereading the pairs from the scratch file.
+ *
+ * The spiral layout is walked without tables (see Spiral). Other layouts need their permutation,
+ * which is not bounded by the memory limit (see Layout and --layout-cache). Grayscale files are
+ * sorted like color files and written as grayscale files.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see JPGReader).
+ * [in] options Command line options. The memory limit, scratch directory and layout are used.
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradientExternal( char* input, char* output, int scale, const Options& options )
+{
+    typedef ExternalSort< unsigned long long, std::less< unsigned long long > > PositionSort;
+
+    std::unique_ptr< ImageReader > reader( ImageFormat::openReader( input, 3, scale ) );
+    if( !reader ) {
+        return false;
+    }
+    int w = reader->width();
+    int h = reader->height();
+    int comps = ( reader->components() == 1 ) ? 1 : 3;
+    long n = (long)w * h;
+    size_t memory = (size_t)std::max( options.memLimit / 2, 1024.0 * 1024 );
+    PositionSort byPosition( options.scratch, memory );
+
+    {
+        // 1. Sort the pixels by key.
+        ExternalSort< PackedPixel, DescendingKey< Key > > byKey( options.scratch, memory );
+        std::vector< uint8 > row( w * 3 );
+        for( int y = 0 ; y < h ; y++ ) {
+            if( !reader->read( &row[ 0 ] ) ) {
+                return false;
+            }
+            for( int x = 0 ; x < w ; x++ ) {
+                PackedPixel px;
+                px.rgb[ 0 ] = row[ x * 3 ];
+                px.rgb[ 1 ] = row[ x * 3 + 1 ];
+                px.rgb[ 2 ] = row[ x * 3 + 2 ];
+                if( !byKey.add( px ) ) {
+                    return false;
+                }
+            }
+        }
+        if( !byKey.finish() ) {
+            return false;
+        }
+
+        // 2. Pair the pixels with the positions of the layout.
+        bool spiralLayout = options.layout.compare( "spiral" ) == 0;
+        Spiral spiral( w, h, 0.5 * ( w - 1 ), 0.5 * ( h - 1 ) );
+        const unsigned int* order = spiralLayout ? 0 : centeredLayout( options.layout, w, h )->order();
+        for( long i = 0 ; i < n ; i++ ) {
+            PackedPixel px;
+            if( !byKey.next( &px ) ) {
+                return false;
+            }
+            unsigned long long position;
+            if( spiralLayout ) {
+                int x, y;
+                spiral.next( &x, &y );
+                position = (unsigned long long)y * w + x;
+            }
+            else {
+                position = order[ i ];
+            }
+            if( !byPosition.add( ( position << 24 ) | ( px.rgb[ 0 ] << 16 ) | ( px.rgb[ 1 ] << 8 ) | px.rgb[ 2 ] ) ) {
+                return false;
+            }
+        }
+    }
+    if( !byPosition.finish() ) {
+        return false;
+    }
+
+    // 3. Encode the output rows.
+    jpge::params params = Image::jpgParams( comps, options.jpg );
+    params.m_coefficient_cache_flag = false;
+    std::unique_ptr< ImageWriter > writer( ImageFormat::openWriter( output, w, h, comps, params ) );
+    if( !writer ) {
+        return false;
+    }
+    std::vector< uint8 > line( w * comps );
+    for( int pass = 0 ; pass < writer->passes() ; pass++ ) {
+        if( pass > 0 && !byPosition.rewind() ) {
+            return false;
+        }
+        for( int y = 0 ; y < h ; y++ ) {
+            for( int x = 0 ; x < w ; x++ ) {
+                unsigned long long pair;
+                if( !byPosition.next( &pair ) ) {
+                    return false;
+                }
+                if( comps == 1 ) {
+                    line[ x ] = ( pair >> 16 ) & 0xFF;
+                }
+                else {
+                    line[ x * 3     ] = ( pair >> 16 ) & 0xFF;
+                    line[ x * 3 + 1 ] = ( pair >> 8 ) & 0xFF;
+                    line[ x * 3 + 2 ] = pair & 0xFF;
+                }
+            }
+            if( !writer->write( &line[ 0 ] ) ) {
+                return false;
+            }
+        }
+        if( !writer->endPass() ) {
+            return false;
+        }
+    }
+
+    return writer->close();
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Renders an approximate gradient of a jpg file of any size in constant memory and writes the
+ * result as a jpg file. Meant for previews, where the exact order of the pixels does not matter.
+ *
+ * The decoded rows are summarized by sorting key (see KeyBuckets) in a single pass. The output
+ * rows are then synthesized while they are encoded: the color of a position is the mean color of
+ * the key range which the pixel at that rank of the layout (see Layout::rank()) belongs to. Just
+ * like gradientExternal(), the encoder does not cache the image for its optimized Huffman tables,
+ * the rows are synthesized twice instead.
+ *
+ * The spiral layout computes ranks without tables. Other layouts need their permutation and its
+ * inverse. Grayscale files are written as grayscale files.
+ *
+ * [in] input   Input jpg filename.
+ * [in] output  Output jpg filename.
+ * [in] scale   Shrink factor applied while decoding (see JPGReader).
+ * [in] options Command line options. The layout and detail are used.
+ *
+ * Returns true on success, otherwise false.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+bool gradientApproximate( char* input, char* output, int scale, const Options& options )
+{
+    std::unique_ptr< ImageReader > reader( ImageFormat::openReader( input, 3, scale ) );
+    if( !reader ) {
+        return false;
+    }
+    int w = reader->width();
+    int h = reader->height();
+    int comps = ( reader->components() == 1 ) ? 1 : 3;
+
+    KeyBuckets< Key > buckets( options.detail );
+    std::vector< uint8 > row( w * 3 );
+    for( int y = 0 ; y < h ; y++ ) {
+        if( !reader->read( &row[ 0 ] ) ) {
+            return false;
+        }
+        buckets.add( &row[ 0 ], w );
+    }
+    buckets.finish();
+
+    jpge::params params = Image::jpgParams( comps, options.jpg );
+    params.m_coefficient_cache_flag = false;
+    std::unique_ptr< ImageWriter > writer( ImageFormat::openWriter( output, w, h, comps, params ) );
+    if( !writer ) {
+        return false;
+    }
+    Layout* layout = centeredLayout( options.layout, w, h );
+    std::vector< uint8 > line( w * comps );
+    for( int pass = 0 ; pass < writer->passes() ; pass++ ) {
+        for( int y = 0 ; y < h ; y++ ) {
+            for( int x = 0 ; x < w ; x++ ) {
+                uint8 rgb[ 3 ];
+                buckets.color( layout->rank( x, y ), rgb );
+                if( comps == 1 ) {
+                    line[ x ] = rgb[ 0 ];
+                }
+                else {
+                    line[ x * 3     ] = rgb[ 0 ];
+                    line[ x * 3 + 1 ] = rgb[ 1 ];
+                    line[ x * 3 + 2 ] = rgb[ 2 ];
+                }
+            }
+            if( !writer->write( &line[ 0 ] ) ) {
+                return false;
+            }
+        }
+        if( !writer->endPass() ) {
+            return false;
+        }
+    }
+
+    return writer->close();
+}
+
+/* -------------------------------------------------------------------------------------------------
+ * Row callback of Image::decode() counting the sorting keys of the pixels (see gradientCounting()).
+ *
+ * [in] row     The packed RGB pixels of the row.
+ * [in] width   Number of pixels in the row.
+ * [in] y       Index of the row.
+ * [in] user    The KeyHistogram to update.
+ * ------------------------------------------------------------------------------------------------- */
+template< class Key >
+void countKeys( const uint8* row, int width, int /*y*/, void* user )
+{
+    KeyHistogram* histogram = (KeyHistogram*)user;
+    for( int x = 0 ; x < width ; x++ ) {
+        const uint8* px = row + x * 3;
+        histogram->counts[ Key::bucket( px[ 0 ], px[ 1 ], px[ 2 ] ) ]++;
+    }
 }
@@ -0,0 +1,393 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include "permutation.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define PERMUTATION_SUPPORT_MMAP 1
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#else
+  #define PERMUTATION_SUPPORT_MMAP 0
+#endif
+
+/**
+ * @brief Header of a permutation file. The indices follow the header.
+ */
+struct PermutationHeader
+{
+    char magic[ 8 ];
+    unsigned int byteOrder;
+    unsigned int encoding;
+    unsigned int width;
+    unsigned int height;
+    char layout[ 16 ];
+};
+
+static const char PERMUTATION_MAGIC[ 8 ] = { 'I', 'G', 'P', 'E', 'R', 'M', '0', '1' };
+static const unsigned int PERMUTATION_BYTE_ORDER = 0x01020304;
+
+/**
+ * @brief Number of output pixels gathered as one block by Permutation::apply(). A block of indices
+ *        and output pixels (up to 112 KiB) stays in the L2 cache while the sources are fetched,
+ *        and blocks are large enough that the threads rarely contend for the next one.
+ */
+static const long GATHER_BLOCK = 1 << 14;
+
+/**
+ * @brief Number of pixels the source of an output pixel is prefetched ahead of its gather. The
+ *        sources are scattered over the input image, so each one is a likely cache miss.
+ */
+static const long GATHER_PREFETCH = 16;
+
+/**
+ * @brief Returns the header of a mapped permutation file.
+ */
+static const PermutationHeader* headerOf( const void* mapping )
+{
+    return (const PermutationHeader*)mapping;
+}
+
+/**
+ * @brief Gathers the output pixels of one block.
+ * @param [in]  sources Source index of each output position of the block.
+ * @param [in]  input   Packed pixels of the input image.
+ * @param [out] output  The output pixels of the block.
+ * @param [in]  count   Number of pixels of the block.
+ * @param [in]  n       Number of pixels of the image.
+ * @return True on success, false if a source index is out of range.
+ */
+template< int Comps >
+static bool gatherBlock( const unsigned int* sources, const uint8* input, uint8* output, long count,
+                         unsigned int n )
+{
+    for( long i = 0 ; i < count ; i++ ) {
+#if defined(__GNUC__)
+        if( i + GATHER_PREFETCH < count ) {
+            __builtin_prefetch( input + (size_t)sources[ i + GATHER_PREFETCH ] * Comps );
+        }
+#endif
+        unsigned int source = sources[ i ];
+        if( source >= n ) {
+            return false;
+        }
+        const uint8* src = input + (size_t)source * Comps;
+        for( int c = 0 ; c < Comps ; c++ ) {
+            output[ i * Comps + c ] = src[ c ];
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Gathers blocks of output pixels until none is left. Runs on each thread of
+ *        Permutation::apply(), which hands out the blocks in output order.
+ * @param [in]  sources Source index of each output position, in row order.
+ * @param [in]  input   Packed pixels of the input image.
+ * @param [out] output  Packed pixels of the output image.
+ * @param [in]  comps   Number of color components per pixel: 1 or 3.
+ * @param [in]  n       Number of pixels of the image.
+ * @param [in,out] next Index of the next block to gather, shared by the threads.
+ * @param [out] ok      Set to false if a source index is out of range.
+ */
+static void gatherBlocks( const unsigned int* sources, const uint8* input, uint8* output, int comps,
+                          long n, std::atomic< long >* next, std::atomic< bool >* ok )
+{
+    for( ;; ) {
+        long start = ( *next )++ * GATHER_BLOCK;
+        if( start >= n || !*ok ) {
+            return;
+        }
+        long count = std::min( GATHER_BLOCK, n - start );
+        bool blockOk = ( comps == 1 )
+                       ? gatherBlock< 1 >( sources + start, input, output + start, count, n )
+                       : gatherBlock< 3 >( sources + start, input, output + start * 3, count, n );
+        if( !blockOk ) {
+            *ok = false;
+        }
+    }
+}
+
+/**
+ * @brief Permutation constructor. Constructs an object without an open file.
+ */
+Permutation::Permutation() : mMapping( 0 ), mSize( 0 ), mSources( 0 )
+{
+}
+
+/* Destructor */
+Permutation::~Permutation()
+{
+    close();
+}
+
+/**
+ * @brief Maps (or reads, where memory mapping is not supported) a permutation file and checks
+ *        its header. A file opened before by this object is released first.
+ * @param [in]  filename    The permutation filename.
+ * @return True if the file is a permutation file written on a machine with the same byte
+ *         order and, for RAW files, of the expected size, otherwise false.
+ */
+bool Permutation::open( const char* filename )
+{
+    close();
+#if PERMUTATION_SUPPORT_MMAP
+    int fd = ::open( filename, O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && (size_t)st.st_size >= sizeof( PermutationHeader ) ) {
+        mapping = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    ::close( fd );
+    if( mapping == MAP_FAILED ) {
+        return false;
+    }
+    mMapping = mapping;
+    mSize = st.st_size;
+#else
+    FILE* file = fopen( filename, "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    long size = -1;
+    if( fseek( file, 0, SEEK_END ) == 0 ) {
+        size = ftell( file );
+    }
+    void* mapping = ( size >= (long)sizeof( PermutationHeader ) && fseek( file, 0, SEEK_SET ) == 0 ) ? malloc( size ) : 0;
+    bool ok = mapping && fread( mapping, size, 1, file ) == 1;
+    fclose( file );
+    if( !ok ) {
+        free( mapping );
+        return false;
+    }
+    mMapping = mapping;
+    mSize = size;
+#endif
+
+    const PermutationHeader* header = headerOf( mMapping );
+    unsigned long long n = (unsigned long long)header->width * header->height;
+    bool ok = memcmp( header->magic, PERMUTATION_MAGIC, sizeof( header->magic ) ) == 0 &&
+              header->byteOrder == PERMUTATION_BYTE_ORDER && header->encoding <= DELTA &&
+              n > 0 && n <= 0xFFFFFFFFull && header->layout[ sizeof( header->layout ) - 1 ] == 0;
+    if( ok && header->encoding == RAW ) {
+        ok = mSize == sizeof( PermutationHeader ) + n * sizeof( unsigned int );
+    }
+    if( !ok ) {
+        close();
+    }
+    return ok;
+}
+
+/**
+ * @brief Returns the width of the output image of the permutation.
+ * @return The width in pixels.
+ */
+int Permutation::width()
+{
+    return mMapping ? headerOf( mMapping )->width : 0;
+}
+
+/**
+ * @brief Returns the height of the output image of the permutation.
+ * @return The height in pixels.
+ */
+int Permutation::height()
+{
+    return mMapping ? headerOf( mMapping )->height : 0;
+}
+
+/**
+ * @brief Returns the encoding of the indices in the file.
+ * @return The encoding.
+ */
+Permutation::Encoding Permutation::encoding()
+{
+    return mMapping ? (Encoding)headerOf( mMapping )->encoding : RAW;
+}
+
+/**
+ * @brief Returns the name of the layout of the output image (see Layout::get()).
+ * @return The layout name.
+ */
+std::string Permutation::layoutName()
+{
+    return mMapping ? headerOf( mMapping )->layout : "";
+}
+
+/**
+ * @brief Prepares the source indices for Permutation::apply(). RAW indices are used in place,
+ *        DELTA indices are decoded and scattered to their positions.
+ * @param [in]  layout  The layout named in the header, of width() x height() positions. Only
+ *                      needed for DELTA files, may be a null pointer for RAW files.
+ * @return True on success, false if the indices are truncated or out of range.
+ */
+bool Permutation::load( Layout* layout )
+{
+    if( mMapping == 0 ) {
+        return false;
+    }
+    const uint8* data = (const uint8*)mMapping + sizeof( PermutationHeader );
+    if( encoding() == RAW ) {
+        // The header keeps the indices 4 byte aligned in the page aligned mapping.
+        mSources = (const unsigned int*)data;
+        return true;
+    }
+    if( layout == 0 || layout->width() != width() || layout->height() != height() ) {
+        return false;
+    }
+
+    // Undo the zigzag varints and scatter the ranks to their positions.
+    long n = layout->size();
+    const unsigned int* order = layout->order();
+    const uint8* end = (const uint8*)mMapping + mSize;
+    mDecoded.assign( n, 0 );
+    unsigned int previous = 0;
+    for( long i = 0 ; i < n ; i++ ) {
+        unsigned int value = 0;
+        int shift = 0;
+        do {
+            if( data == end || shift > 28 ) {
+                return false;
+            }
+            value |= (unsigned int)( *data & 0x7F ) << shift;
+            shift += 7;
+        } while( *data++ & 0x80 );
+        previous += ( value >> 1 ) ^ ( 0u - ( value & 1 ) );
+        if( previous >= (unsigned long)n ) {
+            return false;
+        }
+        mDecoded[ order[ i ] ] = previous;
+    }
+    if( data != end ) {
+        return false;
+    }
+    mSources = &mDecoded[ 0 ];
+    return true;
+}
+
+/**
+ * @brief Gathers the pixels of an image of width() x height() pixels into the order of the
+ *        permutation.
+ *
+ * The gather reads every input pixel and writes every output pixel once, at random input
+ * positions, so it is bound by memory latency and bandwidth rather than by computation. The output
+ * is split into blocks of GATHER_BLOCK pixels, which are handed out in order to one thread per
+ * core, so that the threads write to separate cache lines and many sources are fetched at the
+ * same time. The sources of each block are prefetched a few pixels ahead of their use.
+ *
+ * @param [in]  input   Packed pixels of the input image.
+ * @param [out] output  Buffer of the same size as the input, receiving the gathered pixels.
+ * @param [in]  comps   Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @return True on success, false if a source index is out of range.
+ */
+bool Permutation::apply( const uint8* input, uint8* output, int comps )
+{
+    if( mSources == 0 || ( comps != 1 && comps != 3 ) ) {
+        return false;
+    }
+    long n = (long)width() * height();
+    long blocks = ( n + GATHER_BLOCK - 1 ) / GATHER_BLOCK;
+    long threads = std::min( (long)std::thread::hardware_concurrency(), blocks );
+
+    std::atomic< long > next( 0 );
+    std::atomic< bool > ok( true );
+    std::vector< std::thread > workers;
+    for( long t = 1 ; t < threads ; t++ ) {
+        workers.push_back( std::thread( gatherBlocks, mSources, input, output, comps, n, &next, &ok ) );
+    }
+    gatherBlocks( mSources, input, output, comps, n, &next, &ok );
+    for( size_t t = 0 ; t < workers.size() ; t++ ) {
+        workers[ t ].join();
+    }
+    return ok;
+}
+
+/**
+ * @brief Writes a permutation file.
+ * @param [in]  filename    Output filename.
+ * @param [in]  sources     Source index of the pixel of each rank of the layout, width * height
+ *                          indices.
+ * @param [in]  layout      The layout of the output image.
+ * @param [in]  layoutName  Name of the layout (see Layout::get()).
+ * @param [in]  encoding    Encoding of the indices.
+ * @return True on write success, otherwise false.
+ */
+bool Permutation::write( const char* filename, const unsigned int* sources, Layout* layout,
+                         const std::string& layoutName, Encoding encoding )
+{
+    PermutationHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, PERMUTATION_MAGIC, sizeof( header.magic ) );
+    header.byteOrder = PERMUTATION_BYTE_ORDER;
+    header.encoding = encoding;
+    header.width = layout->width();
+    header.height = layout->height();
+    if( layoutName.size() >= sizeof( header.layout ) ) {
+        return false;
+    }
+    memcpy( header.layout, layoutName.c_str(), layoutName.size() );
+
+    FILE* file = fopen( filename, "wb" );
+    if( file == 0 ) {
+        return false;
+    }
+    setvbuf( file, 0, _IOFBF, 1 << 20 );
+    bool ok = fwrite( &header, sizeof( header ), 1, file ) == 1;
+
+    long n = layout->size();
+    if( encoding == RAW ) {
+        // Scatter the ranks to their positions.
+        const unsigned int* order = layout->order();
+        std::vector< unsigned int > byPosition( n );
+        for( long i = 0 ; i < n ; i++ ) {
+            byPosition[ order[ i ] ] = sources[ i ];
+        }
+        ok = ok && fwrite( &byPosition[ 0 ], sizeof( unsigned int ), n, file ) == (size_t)n;
+    }
+    else {
+        unsigned int previous = 0;
+        uint8 buffer[ 5 ];
+        for( long i = 0 ; ok && i < n ; i++ ) {
+            // Zigzag: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+            int delta = (int)( sources[ i ] - previous );
+            unsigned int value = ( (unsigned int)delta << 1 ) ^ (unsigned int)( delta >> 31 );
+            previous = sources[ i ];
+            int length = 0;
+            while( value >= 0x80 ) {
+                buffer[ length++ ] = ( value & 0x7F ) | 0x80;
+                value >>= 7;
+            }
+            buffer[ length++ ] = value;
+            ok = fwrite( buffer, 1, length, file ) == (size_t)length;
+        }
+    }
+
+    return ( fclose( file ) == 0 ) && ok;
+}
+
+/**
+ * @brief Releases the mapped file and the decoded indices.
+ */
+void Permutation::close()
+{
+    if( mMapping ) {
+#if PERMUTATION_SUPPORT_MMAP
+        munmap( mMapping, mSize );
+#else
+        free( mMapping );
+#endif
+    }
+    mMapping = 0;
+    mSize = 0;
+    mSources = 0;
+    std::vector< unsigned int >().swap( mDecoded );
+}
@@ -0,0 +1,142 @@
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include "rgbpixel.h"
+#include "layout.h"
+
+/**
+ * @brief The Permutation class stores where each pixel of a sorted image came from, so that the
+ *        same gradient can be applied to derived images (masks, alpha, other color grades) with a
+ *        single gather pass instead of another sort.
+ *
+ * A permutation file starts with a header (see permutation.cpp), followed by the source indices
+ * (y * width + x in the input image) of the output pixels in one of two encodings:
+ * - RAW: one 32 bit index per output position, in row order and native byte order, so that the
+ *   file can be memory mapped and used as is.
+ * - DELTA: the indices in the order of the layout (see Layout::order()), from the largest key to
+ *   the smallest, as zigzag varints of the difference to the previous index. Pixels with equal keys
+ *   follow each other in input order (or its reverse), so most differences are small and the file
+ *   is a fraction of the size.
+ *   The layout is rebuilt from its name in the header to find the output positions.
+ *
+ * A file is applied to another image of the same size with Permutation::open(), Permutation::load()
+ * and Permutation::apply(), which gathers the pixels of the image into the saved order.
+ */
+class Permutation
+{
+public: /* types */
+    /**
+     * @brief Encodings of the indices.
+     */
+    enum Encoding { RAW = 0, DELTA = 1 };
+
+public: /* methods */
+    /**
+     * @brief Permutation constructor. Constructs an object without an open file.
+     */
+    Permutation();
+
+    /* Destructor */
+    ~Permutation();
+
+    /**
+     * @brief Maps (or reads, where memory mapping is not supported) a permutation file and checks
+     *        its header. A file opened before by this object is released first.
+     * @param [in]  filename    The permutation filename.
+     * @return True if the file is a permutation file written on a machine with the same byte
+     *         order and, for RAW files, of the expected size, otherwise false.
+     */
+    bool open( const char* filename );
+
+    /**
+     * @brief Returns the width of the output image of the permutation.
+     * @return The width in pixels.
+     */
+    int width();
+
+    /**
+     * @brief Returns the height of the output image of the permutation.
+     * @return The height in pixels.
+     */
+    int height();
+
+    /**
+     * @brief Returns the encoding of the indices in the file.
+     * @return The encoding.
+     */
+    Encoding encoding();
+
+    /**
+     * @brief Returns the name of the layout of the output image (see Layout::get()).
+     * @return The layout name.
+     */
+    std::string layoutName();
+
+    /**
+     * @brief Prepares the source indices for Permutation::apply(). RAW indices are used in place,
+     *        DELTA indices are decoded and scattered to their positions.
+     * @param [in]  layout  The layout named in the header, of width() x height() positions. Only
+     *                      needed for DELTA files, may be a null pointer for RAW files.
+     * @return True on success, false if the indices are truncated or out of range.
+     */
+    bool load( Layout* layout );
+
+    /**
+     * @brief Gathers the pixels of an image of width() x height() pixels into the order of the
+     *        permutation. The output is split into blocks, which are handed out to one thread per
+     *        core (see permutation.cpp).
+     * @param [in]  input   Packed pixels of the input image.
+     * @param [out] output  Buffer of the same size as the input, receiving the gathered pixels.
+     * @param [in]  comps   Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @return True on success, false if a source index is out of range.
+     */
+    bool apply( const uint8* input, uint8* output, int comps );
+
+public: /* static methods */
+    /**
+     * @brief Writes a permutation file.
+     * @param [in]  filename    Output filename.
+     * @param [in]  sources     Source index of the pixel of each rank of the layout, width * height
+     *                          indices.
+     * @param [in]  layout      The layout of the output image.
+     * @param [in]  layoutName  Name of the layout (see Layout::get()).
+     * @param [in]  encoding    Encoding of the indices.
+     * @return True on write success, otherwise false.
+     */
+    static bool write( const char* filename, const unsigned int* sources, Layout* layout,
+                       const std::string& layoutName, Encoding encoding );
+
+private: /* methods */
+    /**
+     * @brief Releases the mapped file and the decoded indices.
+     */
+    void close();
+
+private: /* member variables */
+    /**
+     * @brief The mapped file (or the file read into memory, where mapping is not supported),
+     *        including the header, or a null pointer if no file is open.
+     */
+    void* mMapping;
+
+    /**
+     * @brief Size of the mapped file in bytes.
+     */
+    size_t mSize;
+
+    /**
+     * @brief The source index of each output position, in row order, either mapped (RAW) or
+     *        decoded into mDecoded (DELTA), or a null pointer until loaded.
+     */
+    const unsigned int* mSources;
+
+    /**
+     * @brief The decoded source indices of a DELTA file.
+     */
+    std::vector< unsigned int > mDecoded;
+};
+
+#endif // PERMUTATION_H
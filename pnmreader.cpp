@@ -0,0 +1,440 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "pnmreader.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+  #define PNMREADER_SUPPORT_MMAP 1
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#else
+  #define PNMREADER_SUPPORT_MMAP 0
+#endif
+
+/**
+ * @brief Header of a netpbm file.
+ */
+struct PNMHeader
+{
+    int width;
+    int height;
+    int depth;          // Samples per pixel: 1 (gray), 2 (gray and alpha), 3 (RGB) or 4 (RGB and alpha).
+    int maxval;         // Maximum sample value, samples above 255 take two bytes.
+    size_t offset;      // Offset of the first pixel.
+};
+
+/**
+ * @brief Tests for the whitespace characters of netpbm headers.
+ */
+static inline bool isBlank( uint8 c )
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief Skips whitespace and comments, which run from '#' to the end of the line.
+ */
+static void skipBlanks( const uint8* data, size_t size, size_t* pos )
+{
+    size_t i = *pos;
+    while( i < size && ( isBlank( data[ i ] ) || data[ i ] == '#' ) ) {
+        if( data[ i ] == '#' ) {
+            while( i < size && data[ i ] != '\n' ) i++;
+        }
+        else {
+            i++;
+        }
+    }
+    *pos = i;
+}
+
+/**
+ * @brief Reads a decimal number after whitespace and comments.
+ */
+static bool parseNumber( const uint8* data, size_t size, size_t* pos, int* value )
+{
+    skipBlanks( data, size, pos );
+    size_t i = *pos;
+    long v = 0;
+    if( i >= size || data[ i ] < '0' || data[ i ] > '9' ) {
+        return false;
+    }
+    while( i < size && data[ i ] >= '0' && data[ i ] <= '9' ) {
+        v = v * 10 + ( data[ i++ ] - '0' );
+        if( v > 0x7FFFFFFF ) {
+            return false;
+        }
+    }
+    *value = (int)v;
+    *pos = i;
+    return true;
+}
+
+/**
+ * @brief Reads a word of a PAM header line.
+ */
+static std::string parseWord( const uint8* data, size_t size, size_t* pos )
+{
+    size_t i = *pos;
+    while( i < size && data[ i ] == ' ' ) i++;
+    size_t start = i;
+    while( i < size && !isBlank( data[ i ] ) ) i++;
+    *pos = i;
+    return std::string( (const char*)data + start, i - start );
+}
+
+/**
+ * @brief Parses the header of a netpbm file. Only the header has to be in the data.
+ */
+static bool parseHeader( const uint8* data, size_t size, PNMHeader* header )
+{
+    if( size < 3 || data[ 0 ] != 'P' ) {
+        return false;
+    }
+    size_t pos = 2;
+    header->width = header->height = header->depth = header->maxval = 0;
+    if( data[ 1 ] == '5' || data[ 1 ] == '6' ) {
+        header->depth = ( data[ 1 ] == '5' ) ? 1 : 3;
+        if( !parseNumber( data, size, &pos, &header->width ) || !parseNumber( data, size, &pos, &header->height ) ||
+            !parseNumber( data, size, &pos, &header->maxval ) ) {
+            return false;
+        }
+        // A single whitespace character separates the header from the pixels.
+        if( pos >= size || !isBlank( data[ pos ] ) ) {
+            return false;
+        }
+        header->offset = pos + 1;
+    }
+    else if( data[ 1 ] == '7' ) {
+        std::string tupltype;
+        for( ;; ) {
+            skipBlanks( data, size, &pos );
+            std::string name = parseWord( data, size, &pos );
+            if( name.empty() ) {
+                return false;
+            }
+            if( name == "ENDHDR" ) {
+                while( pos < size && data[ pos ] != '\n' ) pos++;
+                if( pos >= size ) {
+                    return false;
+                }
+                header->offset = pos + 1;
+                break;
+            }
+            bool ok = true;
+            if( name == "WIDTH" )           ok = parseNumber( data, size, &pos, &header->width );
+            else if( name == "HEIGHT" )     ok = parseNumber( data, size, &pos, &header->height );
+            else if( name == "DEPTH" )      ok = parseNumber( data, size, &pos, &header->depth );
+            else if( name == "MAXVAL" )     ok = parseNumber( data, size, &pos, &header->maxval );
+            else if( name == "TUPLTYPE" )   tupltype = parseWord( data, size, &pos );
+            else {
+                return false;
+            }
+            if( !ok ) {
+                return false;
+            }
+        }
+        // Without a tuple type, the depth tells the layout.
+        if( ( tupltype == "GRAYSCALE" && header->depth != 1 ) || ( tupltype == "GRAYSCALE_ALPHA" && header->depth != 2 ) ||
+            ( tupltype == "RGB" && header->depth != 3 ) || ( tupltype == "RGB_ALPHA" && header->depth != 4 ) ||
+            !( tupltype.empty() || tupltype == "GRAYSCALE" || tupltype == "GRAYSCALE_ALPHA" ||
+               tupltype == "RGB" || tupltype == "RGB_ALPHA" ) ) {
+            return false;
+        }
+    }
+    else {
+        return false;
+    }
+    return header->width >= 1 && header->width <= 65535 && header->height >= 1 && header->height <= 65535 &&
+           header->depth >= 1 && header->depth <= 4 && header->maxval >= 1 && header->maxval <= 65535;
+}
+
+/**
+ * @brief PNMReader constructor. Constructs a reader without an open file.
+ */
+PNMReader::PNMReader() :
+    mMapping( 0 ), mSize( 0 ), mData( 0 ), mFileWidth( 0 ), mFileHeight( 0 ), mDepth( 0 ), mMaxval( 0 ),
+    mComps( 3 ), mScale( 1 ), mY( 0 )
+{
+}
+
+/* Destructor */
+PNMReader::~PNMReader()
+{
+    close();
+}
+
+/**
+ * @brief Opens a netpbm file and reads its header.
+ * @param [in]  filename    The netpbm filename.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+ *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+ * @return True on success, otherwise false.
+ */
+bool PNMReader::open( const char* filename, int comps, int scale )
+{
+    close();
+#if PNMREADER_SUPPORT_MMAP
+    int fd = ::open( filename, O_RDONLY );
+    if( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    void* mapping = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+        mapping = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    }
+    ::close( fd );
+    if( mapping == MAP_FAILED ) {
+        return false;
+    }
+    mMapping = mapping;
+    mSize = st.st_size;
+#else
+    FILE* file = fopen( filename, "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    long size = -1;
+    if( fseek( file, 0, SEEK_END ) == 0 ) {
+        size = ftell( file );
+    }
+    void* mapping = ( size > 0 && fseek( file, 0, SEEK_SET ) == 0 ) ? malloc( size ) : 0;
+    bool ok = mapping && fread( mapping, size, 1, file ) == 1;
+    fclose( file );
+    if( !ok ) {
+        free( mapping );
+        return false;
+    }
+    mMapping = mapping;
+    mSize = size;
+#endif
+
+    if( !begin( (const uint8*)mMapping, mSize, comps, scale ) ) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Same as PNMReader::open() above, but reads a netpbm file which is already in memory.
+ * @param [in]  data        The netpbm file data.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor (see PNMReader::open() above).
+ * @return True on success, otherwise false.
+ */
+bool PNMReader::open( const uint8* data, size_t size, int comps, int scale )
+{
+    close();
+    return begin( data, size, comps, scale );
+}
+
+/**
+ * @brief Reads the header of the file and sets up the rows.
+ * @param [in]  data        The netpbm file data.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor.
+ * @return True on success, otherwise false.
+ */
+bool PNMReader::begin( const uint8* data, size_t size, int comps, int scale )
+{
+    PNMHeader header;
+    if( !parseHeader( data, size, &header ) ) {
+        return false;
+    }
+    size_t bytes = (size_t)header.width * header.height * header.depth * ( header.maxval > 255 ? 2 : 1 );
+    if( header.offset > size || size - header.offset < bytes ) {
+        return false;
+    }
+
+    mData = data + header.offset;
+    mFileWidth = header.width;
+    mFileHeight = header.height;
+    mDepth = header.depth;
+    mMaxval = header.maxval;
+    mComps = comps;
+    mScale = scale < 1 ? 1 : scale;
+    mY = 0;
+    mLine.assign( (size_t)mFileWidth * mComps, 0 );
+    mSums.assign( (size_t)width() * mComps, 0 );
+    return width() >= 1 && height() >= 1;
+}
+
+/**
+ * @brief Returns the width of the rows.
+ * @return The width in pixels.
+ */
+int PNMReader::width()
+{
+    return mFileWidth / mScale;
+}
+
+/**
+ * @brief Returns the number of rows.
+ * @return The height in pixels.
+ */
+int PNMReader::height()
+{
+    return mFileHeight / mScale;
+}
+
+/**
+ * @brief Returns the number of color components of the file.
+ * @return 1 for grayscale, 3 for color files.
+ */
+int PNMReader::components()
+{
+    return mDepth <= 2 ? 1 : 3;
+}
+
+/**
+ * @brief Returns the pixels of the file without copying them, if they are stored exactly as
+ *        PNMReader::read() would return them.
+ * @return The packed pixels of all rows, or a null pointer if they need to be converted.
+ */
+const uint8* PNMReader::pixels()
+{
+    return ( mData && mMaxval == 255 && mDepth == mComps && mScale == 1 ) ? mData : 0;
+}
+
+/**
+ * @brief Reads the next row.
+ * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+ * @return True on success, false if there are no more rows.
+ */
+bool PNMReader::read( uint8* row )
+{
+    if( mData == 0 || mY + mScale > mFileHeight ) {
+        return false;
+    }
+    size_t rowBytes = (size_t)mFileWidth * mDepth * ( mMaxval > 255 ? 2 : 1 );
+    if( mScale == 1 ) {
+        convert( mData + rowBytes * mY++, row, mFileWidth );
+        return true;
+    }
+
+    // Add the rows of the file to the sums of the row.
+    int w = width();
+    int comps = mComps;
+    for( int y = 0 ; y < mScale ; y++ ) {
+        convert( mData + rowBytes * mY++, &mLine[ 0 ], w * mScale );
+        for( int x = 0 ; x < w * mScale ; x++ ) {
+            unsigned int* sum = &mSums[ ( x / mScale ) * comps ];
+            for( int c = 0 ; c < comps ; c++ ) {
+                sum[ c ] += mLine[ x * comps + c ];
+            }
+        }
+    }
+
+    // After scale rows the row is complete.
+    int area = mScale * mScale;
+    for( int i = 0 ; i < w * comps ; i++ ) {
+        row[ i ] = ( mSums[ i ] + area / 2 ) / area;
+        mSums[ i ] = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads only the header of a netpbm file.
+ * @param [in]  filename    The netpbm filename.
+ * @param [out] width       Width of the image.
+ * @param [out] height      Height of the image.
+ * @param [out] comps       Number of color components: 1 for grayscale, 3 for color files.
+ * @return True if the file is a supported netpbm file, otherwise false.
+ */
+bool PNMReader::probe( const char* filename, int* width, int* height, int* comps )
+{
+    // Headers are short, unless they hold long comments.
+    FILE* file = fopen( filename, "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    std::vector< uint8 > data( 65536 );
+    size_t size = fread( &data[ 0 ], 1, data.size(), file );
+    fclose( file );
+    return probe( &data[ 0 ], size, width, height, comps );
+}
+
+/**
+ * @brief Same as PNMReader::probe() above, but reads the header of a netpbm file in memory.
+ * @param [in]  data        The netpbm file data, or at least its header.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [out] width       Width of the image.
+ * @param [out] height      Height of the image.
+ * @param [out] comps       Number of color components: 1 for grayscale, 3 for color files.
+ * @return True if the data is a supported netpbm file, otherwise false.
+ */
+bool PNMReader::probe( const uint8* data, size_t size, int* width, int* height, int* comps )
+{
+    PNMHeader header;
+    if( !parseHeader( data, size, &header ) ) {
+        return false;
+    }
+    *width = header.width;
+    *height = header.height;
+    *comps = header.depth <= 2 ? 1 : 3;
+    return true;
+}
+
+/**
+ * @brief Converts a row of the file to packed pixels of the requested number of components.
+ * @param [in]  src     The row in the file.
+ * @param [out] dst     Buffer of width * comps bytes.
+ * @param [in]  width   Number of pixels to convert.
+ */
+void PNMReader::convert( const uint8* src, uint8* dst, int width )
+{
+    if( mMaxval == 255 && mDepth == mComps ) {
+        memcpy( dst, src, (size_t)width * mComps );
+        return;
+    }
+
+    int bps = mMaxval > 255 ? 2 : 1;
+    int colors = mDepth <= 2 ? 1 : 3;
+    unsigned int maxval = mMaxval;
+    for( int x = 0 ; x < width ; x++ ) {
+        const uint8* px = src + (size_t)x * mDepth * bps;
+        unsigned int s[ 3 ];
+        for( int c = 0 ; c < colors ; c++ ) {
+            unsigned int v = ( bps == 2 ) ? ( px[ 2 * c ] << 8 ) | px[ 2 * c + 1 ] : px[ c ];
+            if( maxval != 255 ) {
+                v = ( v * 255 + maxval / 2 ) / maxval;
+            }
+            s[ c ] = v > 255 ? 255 : v;
+        }
+        if( mComps == 1 ) {
+            // Same luma weights as JPGReader.
+            dst[ x ] = ( colors == 1 ) ? s[ 0 ] : ( s[ 0 ] * 19595 + s[ 1 ] * 38470 + s[ 2 ] * 7471 + 32768 ) >> 16;
+        }
+        else {
+            dst[ x * 3     ] = s[ 0 ];
+            dst[ x * 3 + 1 ] = s[ colors == 1 ? 0 : 1 ];
+            dst[ x * 3 + 2 ] = s[ colors == 1 ? 0 : 2 ];
+        }
+    }
+}
+
+/**
+ * @brief Releases the mapped file.
+ */
+void PNMReader::close()
+{
+    if( mMapping ) {
+#if PNMREADER_SUPPORT_MMAP
+        munmap( mMapping, mSize );
+#else
+        free( mMapping );
+#endif
+    }
+    mMapping = 0;
+    mSize = 0;
+    mData = 0;
+}
@@ -0,0 +1,175 @@
+#ifndef PNMREADER_H
+#define PNMREADER_H
+
+#include <vector>
+#include <stddef.h>
+#include "rgbpixel.h"
+#include "imageformat.h"
+
+/**
+ * @brief The PNMReader class reads raw netpbm files: binary PGM (P5), binary PPM (P6) and PAM (P7)
+ *        with the GRAYSCALE, GRAYSCALE_ALPHA, RGB and RGB_ALPHA tuple types. Alpha is dropped and
+ *        samples of more than 8 bits are reduced to 8 bits. The file is memory mapped, so that rows
+ *        which need no conversion are handed out without copying (see PNMReader::pixels()). Rows are
+ *        read one at a time and optionally shrunk (see ImageReader).
+ */
+class PNMReader : public ImageReader
+{
+public: /* methods */
+    /**
+     * @brief PNMReader constructor. Constructs a reader without an open file.
+     */
+    PNMReader();
+
+    /* Destructor */
+    ~PNMReader();
+
+    /**
+     * @brief Opens a netpbm file and reads its header.
+     * @param [in]  filename    The netpbm filename.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+     *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int comps, int scale );
+
+    /**
+     * @brief Same as PNMReader::open() above, but reads a netpbm file which is already in memory,
+     *        without copying it. The data must stay valid while the reader is in use.
+     * @param [in]  data        The netpbm file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor (see PNMReader::open() above).
+     * @return True on success, otherwise false.
+     */
+    bool open( const uint8* data, size_t size, int comps, int scale );
+
+    /**
+     * @brief Returns the width of the rows.
+     * @return The width in pixels.
+     */
+    int width();
+
+    /**
+     * @brief Returns the number of rows.
+     * @return The height in pixels.
+     */
+    int height();
+
+    /**
+     * @brief Returns the number of color components of the file.
+     * @return 1 for grayscale, 3 for color files.
+     */
+    int components();
+
+    /**
+     * @brief Returns the pixels of the file without copying them, if they are stored exactly as
+     *        PNMReader::read() would return them: 8 bit samples, as many components as requested,
+     *        no alpha and no shrinking.
+     * @return The packed pixels of all rows, or a null pointer if they need to be converted.
+     */
+    const uint8* pixels();
+
+    /**
+     * @brief Reads the next row.
+     * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+     * @return True on success, false if there are no more rows.
+     */
+    bool read( uint8* row );
+
+public: /* static methods */
+    /**
+     * @brief Reads only the header of a netpbm file.
+     * @param [in]  filename    The netpbm filename.
+     * @param [out] width       Width of the image.
+     * @param [out] height      Height of the image.
+     * @param [out] comps       Number of color components: 1 for grayscale, 3 for color files.
+     * @return True if the file is a supported netpbm file, otherwise false.
+     */
+    static bool probe( const char* filename, int* width, int* height, int* comps );
+
+    /**
+     * @brief Same as PNMReader::probe() above, but reads the header of a netpbm file in memory.
+     * @param [in]  data        The netpbm file data, or at least its header.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [out] width       Width of the image.
+     * @param [out] height      Height of the image.
+     * @param [out] comps       Number of color components: 1 for grayscale, 3 for color files.
+     * @return True if the data is a supported netpbm file, otherwise false.
+     */
+    static bool probe( const uint8* data, size_t size, int* width, int* height, int* comps );
+
+private: /* methods */
+    /**
+     * @brief Reads the header of the file and sets up the rows.
+     * @param [in]  data        The netpbm file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor.
+     * @return True on success, otherwise false.
+     */
+    bool begin( const uint8* data, size_t size, int comps, int scale );
+
+    /**
+     * @brief Converts a row of the file to packed pixels of the requested number of components.
+     * @param [in]  src     The row in the file.
+     * @param [out] dst     Buffer of width * comps bytes.
+     * @param [in]  width   Number of pixels to convert.
+     */
+    void convert( const uint8* src, uint8* dst, int width );
+
+    /**
+     * @brief Releases the mapped file.
+     */
+    void close();
+
+private: /* member variables */
+    /**
+     * @brief The mapped file (or the file read into memory, where mapping is not supported), or a
+     *        null pointer if the data belongs to the caller.
+     */
+    void* mMapping;
+
+    /**
+     * @brief Size of the mapped file in bytes.
+     */
+    size_t mSize;
+
+    /**
+     * @brief The first pixel in the mapped file.
+     */
+    const uint8* mData;
+
+    /**
+     * @brief Width, height, number of samples per pixel and maximum sample value of the file.
+     */
+    int mFileWidth, mFileHeight, mDepth, mMaxval;
+
+    /**
+     * @brief Number of color components per pixel of the rows.
+     */
+    int mComps;
+
+    /**
+     * @brief Shrink factor.
+     */
+    int mScale;
+
+    /**
+     * @brief Index of the next row of the file.
+     */
+    int mY;
+
+    /**
+     * @brief A converted row of the file while shrinking.
+     */
+    std::vector< uint8 > mLine;
+
+    /**
+     * @brief Sums of the input pixels of a row while shrinking.
+     */
+    std::vector< unsigned int > mSums;
+};
+
+#endif // PNMREADER_H
@@ -0,0 +1,75 @@
+#include <cstring>
+#include "pnmwriter.h"
+
+/**
+ * @brief PNMWriter constructor. Constructs a writer without an open file.
+ */
+PNMWriter::PNMWriter() : mFile( 0 ), mRowBytes( 0 ), mRowsLeft( 0 ), mOk( false )
+{
+}
+
+/* Destructor */
+PNMWriter::~PNMWriter()
+{
+    close();
+}
+
+/**
+ * @brief Creates a netpbm file and writes its header.
+ * @param [in]  filename    Output filename.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @return True on success, otherwise false.
+ */
+bool PNMWriter::open( const char* filename, int width, int height, int comps )
+{
+    if( mFile || width < 1 || height < 1 || ( comps != 1 && comps != 3 ) ) {
+        return false;
+    }
+    mFile = ImageFormat::openOutput( filename );
+    if( mFile == 0 ) {
+        return false;
+    }
+
+    size_t length = strlen( filename );
+    if( length >= 4 && strcmp( filename + length - 4, ".pam" ) == 0 ) {
+        mOk = fprintf( mFile, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+                       width, height, comps, comps == 1 ? "GRAYSCALE" : "RGB" ) > 0;
+    }
+    else {
+        mOk = fprintf( mFile, "P%d\n%d %d\n255\n", comps == 1 ? 5 : 6, width, height ) > 0;
+    }
+    mRowBytes = (size_t)width * comps;
+    mRowsLeft = height;
+    return mOk;
+}
+
+/**
+ * @brief Writes the next row.
+ * @param [in]  row     The width * comps packed pixels of the row.
+ * @return True on success, otherwise false.
+ */
+bool PNMWriter::write( const uint8* row )
+{
+    if( mFile == 0 || mRowsLeft == 0 ) {
+        return false;
+    }
+    mOk = mOk && fwrite( row, 1, mRowBytes, mFile ) == mRowBytes;
+    mRowsLeft--;
+    return mOk;
+}
+
+/**
+ * @brief Closes the file.
+ * @return True if all rows were written, otherwise false.
+ */
+bool PNMWriter::close()
+{
+    if( mFile == 0 ) {
+        return false;
+    }
+    bool ok = ImageFormat::closeOutput( mFile ) && mOk && mRowsLeft == 0;
+    mFile = 0;
+    return ok;
+}
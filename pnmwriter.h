@@ -0,0 +1,69 @@
+#ifndef PNMWRITER_H
+#define PNMWRITER_H
+
+#include <cstdio>
+#include "rgbpixel.h"
+#include "imageformat.h"
+
+/**
+ * @brief The PNMWriter class writes raw netpbm files one row at a time, without any encoding:
+ *        binary PGM (P5) for grayscale and binary PPM (P6) for color images, or PAM (P7) if the
+ *        filename ends with ".pam". Only a write buffer is held in memory.
+ */
+class PNMWriter : public ImageWriter
+{
+public: /* methods */
+    /**
+     * @brief PNMWriter constructor. Constructs a writer without an open file.
+     */
+    PNMWriter();
+
+    /* Destructor */
+    ~PNMWriter();
+
+    /**
+     * @brief Creates a netpbm file and writes its header.
+     * @param [in]  filename    Output filename.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int width, int height, int comps );
+
+    /**
+     * @brief Writes the next row.
+     * @param [in]  row     The width * comps packed pixels of the row.
+     * @return True on success, otherwise false.
+     */
+    bool write( const uint8* row );
+
+    /**
+     * @brief Closes the file.
+     * @return True if all rows were written, otherwise false.
+     */
+    bool close();
+
+private: /* member variables */
+    /**
+     * @brief The output file, or a null pointer.
+     */
+    FILE* mFile;
+
+    /**
+     * @brief Number of bytes per row.
+     */
+    size_t mRowBytes;
+
+    /**
+     * @brief Number of rows still to be written.
+     */
+    int mRowsLeft;
+
+    /**
+     * @brief False after a write error.
+     */
+    bool mOk;
+};
+
+#endif // PNMWRITER_H
@@ -0,0 +1,293 @@
+#include <cstring>
+#include "qoireader.h"
+
+/**
+ * @brief Reads the 14 byte header of a QOI file: magic "qoif", width and height (32 bit big
+ *        endian), channels and color space.
+ */
+static bool parseHeader( const uint8* header, int* width, int* height, int* channels )
+{
+    if( memcmp( header, "qoif", 4 ) != 0 ) {
+        return false;
+    }
+    unsigned int w = ( header[ 4 ] << 24 ) | ( header[ 5 ] << 16 ) | ( header[ 6 ] << 8 ) | header[ 7 ];
+    unsigned int h = ( header[ 8 ] << 24 ) | ( header[ 9 ] << 16 ) | ( header[ 10 ] << 8 ) | header[ 11 ];
+    if( w < 1 || w > 65535 || h < 1 || h > 65535 || ( header[ 12 ] != 3 && header[ 12 ] != 4 ) || header[ 13 ] > 1 ) {
+        return false;
+    }
+    *width = w;
+    *height = h;
+    *channels = header[ 12 ];
+    return true;
+}
+
+/**
+ * @brief QOIReader constructor. Constructs a reader without an open file.
+ */
+QOIReader::QOIReader() :
+    mFile( 0 ), mData( 0 ), mPos( 0 ), mEnd( 0 ), mFileWidth( 0 ), mFileHeight( 0 ), mComps( 3 ), mScale( 1 ),
+    mRun( 0 ), mChannels( 3 )
+{
+}
+
+/* Destructor */
+QOIReader::~QOIReader()
+{
+    if( mFile ) {
+        fclose( mFile );
+    }
+}
+
+/**
+ * @brief Opens a QOI file and reads its header.
+ * @param [in]  filename    The QOI filename.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+ *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+ * @return True on success, otherwise false.
+ */
+bool QOIReader::open( const char* filename, int comps, int scale )
+{
+    if( mFile || mData ) {
+        return false;
+    }
+    mFile = fopen( filename, "rb" );
+    if( mFile == 0 ) {
+        return false;
+    }
+    mBuffer.resize( 1 << 16 );
+    mPos = mEnd = 0;
+    return begin( comps, scale );
+}
+
+/**
+ * @brief Same as QOIReader::open() above, but decodes a QOI file which is already in memory.
+ * @param [in]  data        The QOI file data.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor (see QOIReader::open() above).
+ * @return True on success, otherwise false.
+ */
+bool QOIReader::open( const uint8* data, size_t size, int comps, int scale )
+{
+    if( mFile || mData ) {
+        return false;
+    }
+    mData = data;
+    mPos = 0;
+    mEnd = size;
+    return begin( comps, scale );
+}
+
+/**
+ * @brief Reads the header of the file and sets up the decoder.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @param [in]  scale       Shrink factor.
+ * @return True on success, otherwise false.
+ */
+bool QOIReader::begin( int comps, int scale )
+{
+    uint8 header[ 14 ];
+    for( int i = 0 ; i < 14 ; i++ ) {
+        int c = next();
+        if( c < 0 ) {
+            return false;
+        }
+        header[ i ] = c;
+    }
+    if( !parseHeader( header, &mFileWidth, &mFileHeight, &mChannels ) ) {
+        return false;
+    }
+
+    // The decoder starts with opaque black and an index of transparent black.
+    mPixel[ 0 ] = mPixel[ 1 ] = mPixel[ 2 ] = 0;
+    mPixel[ 3 ] = 255;
+    memset( mIndex, 0, sizeof( mIndex ) );
+    mRun = 0;
+    mComps = comps;
+    mScale = scale < 1 ? 1 : scale;
+    mLine.assign( (size_t)mFileWidth * mComps, 0 );
+    mSums.assign( (size_t)width() * mComps, 0 );
+    return width() >= 1 && height() >= 1;
+}
+
+/**
+ * @brief Returns the width of the rows.
+ * @return The width in pixels.
+ */
+int QOIReader::width()
+{
+    return mFileWidth / mScale;
+}
+
+/**
+ * @brief Returns the number of rows.
+ * @return The height in pixels.
+ */
+int QOIReader::height()
+{
+    return mFileHeight / mScale;
+}
+
+/**
+ * @brief Returns the number of color components of the file. QOI files always hold colors.
+ * @return 3.
+ */
+int QOIReader::components()
+{
+    return 3;
+}
+
+/**
+ * @brief Decodes the next row.
+ * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+ * @return True on success, false on a decoding error.
+ */
+bool QOIReader::read( uint8* row )
+{
+    if( mData == 0 && mFile == 0 ) {
+        return false;
+    }
+    if( mScale == 1 ) {
+        return decodeRow( row );
+    }
+
+    // Add the rows of the file to the sums of the row.
+    int w = width();
+    int comps = mComps;
+    for( int y = 0 ; y < mScale ; y++ ) {
+        if( !decodeRow( &mLine[ 0 ] ) ) {
+            return false;
+        }
+        for( int x = 0 ; x < w * mScale ; x++ ) {
+            unsigned int* sum = &mSums[ ( x / mScale ) * comps ];
+            for( int c = 0 ; c < comps ; c++ ) {
+                sum[ c ] += mLine[ x * comps + c ];
+            }
+        }
+    }
+
+    // After scale rows the row is complete.
+    int area = mScale * mScale;
+    for( int i = 0 ; i < w * comps ; i++ ) {
+        row[ i ] = ( mSums[ i ] + area / 2 ) / area;
+        mSums[ i ] = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads only the header of a QOI file.
+ * @param [in]  filename    The QOI filename.
+ * @param [out] width       Width of the image.
+ * @param [out] height      Height of the image.
+ * @return True if the file is a supported QOI file, otherwise false.
+ */
+bool QOIReader::probe( const char* filename, int* width, int* height )
+{
+    FILE* file = fopen( filename, "rb" );
+    if( file == 0 ) {
+        return false;
+    }
+    uint8 header[ 14 ];
+    size_t size = fread( header, 1, sizeof( header ), file );
+    fclose( file );
+    return probe( header, size, width, height );
+}
+
+/**
+ * @brief Same as QOIReader::probe() above, but reads the header of a QOI file in memory.
+ * @param [in]  data        The QOI file data, or at least its header.
+ * @param [in]  size        Size of the data in bytes.
+ * @param [out] width       Width of the image.
+ * @param [out] height      Height of the image.
+ * @return True if the data is a supported QOI file, otherwise false.
+ */
+bool QOIReader::probe( const uint8* data, size_t size, int* width, int* height )
+{
+    int channels;
+    return size >= 14 && parseHeader( data, width, height, &channels );
+}
+
+/**
+ * @brief Decodes the next row of the file. Runs may continue from one row into the next.
+ * @param [out] dst     Buffer of file width * comps bytes.
+ * @return True on success, false on a decoding error.
+ */
+bool QOIReader::decodeRow( uint8* dst )
+{
+    uint8* px = mPixel;
+    for( int x = 0 ; x < mFileWidth ; x++ ) {
+        if( mRun > 0 ) {
+            mRun--;
+        }
+        else {
+            int b1 = next();
+            if( b1 < 0 ) {
+                return false;
+            }
+            if( b1 == 0xFE || b1 == 0xFF ) {
+                // QOI_OP_RGB and QOI_OP_RGBA.
+                for( int c = 0 ; c < ( b1 == 0xFE ? 3 : 4 ) ; c++ ) {
+                    int v = next();
+                    if( v < 0 ) {
+                        return false;
+                    }
+                    px[ c ] = v;
+                }
+            }
+            else if( ( b1 & 0xC0 ) == 0x00 ) {
+                // QOI_OP_INDEX.
+                memcpy( px, mIndex[ b1 ], 4 );
+            }
+            else if( ( b1 & 0xC0 ) == 0x40 ) {
+                // QOI_OP_DIFF: -2..1 for each channel.
+                px[ 0 ] += ( ( b1 >> 4 ) & 0x03 ) - 2;
+                px[ 1 ] += ( ( b1 >> 2 ) & 0x03 ) - 2;
+                px[ 2 ] += ( b1 & 0x03 ) - 2;
+            }
+            else if( ( b1 & 0xC0 ) == 0x80 ) {
+                // QOI_OP_LUMA: green difference -32..31, red and blue relative to it -8..7.
+                int b2 = next();
+                if( b2 < 0 ) {
+                    return false;
+                }
+                int dg = ( b1 & 0x3F ) - 32;
+                px[ 0 ] += dg - 8 + ( ( b2 >> 4 ) & 0x0F );
+                px[ 1 ] += dg;
+                px[ 2 ] += dg - 8 + ( b2 & 0x0F );
+            }
+            else {
+                // QOI_OP_RUN: the previous pixel 1..62 times, including this one.
+                mRun = b1 & 0x3F;
+            }
+            memcpy( mIndex[ ( px[ 0 ] * 3 + px[ 1 ] * 5 + px[ 2 ] * 7 + px[ 3 ] * 11 ) % 64 ], px, 4 );
+        }
+
+        if( mComps == 1 ) {
+            // Same luma weights as JPGReader.
+            dst[ x ] = ( px[ 0 ] * 19595 + px[ 1 ] * 38470 + px[ 2 ] * 7471 + 32768 ) >> 16;
+        }
+        else {
+            dst[ x * 3     ] = px[ 0 ];
+            dst[ x * 3 + 1 ] = px[ 1 ];
+            dst[ x * 3 + 2 ] = px[ 2 ];
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Refills the read buffer.
+ * @return False at the end of the file, or of the data in memory.
+ */
+bool QOIReader::fill()
+{
+    if( mFile == 0 ) {
+        return false;
+    }
+    mData = &mBuffer[ 0 ];
+    mPos = 0;
+    mEnd = fread( &mBuffer[ 0 ], 1, mBuffer.size(), mFile );
+    return mEnd > 0;
+}
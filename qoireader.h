@@ -0,0 +1,183 @@
+#ifndef QOIREADER_H
+#define QOIREADER_H
+
+#include <cstdio>
+#include <vector>
+#include "rgbpixel.h"
+#include "imageformat.h"
+
+/**
+ * @brief The QOIReader class decodes a QOI ("Quite OK Image") file one row at a time, optionally
+ *        shrunk by an integer factor (see ImageReader). QOI is a lossless format which is decoded in
+ *        a single pass over the file, so only the current row and a read buffer are held in memory.
+ *        Alpha is dropped.
+ */
+class QOIReader : public ImageReader
+{
+public: /* methods */
+    /**
+     * @brief QOIReader constructor. Constructs a reader without an open file.
+     */
+    QOIReader();
+
+    /* Destructor */
+    ~QOIReader();
+
+    /**
+     * @brief Opens a QOI file and reads its header.
+     * @param [in]  filename    The QOI filename.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor. Each output pixel is the average of a scale x scale block of
+     *                          input pixels, incomplete blocks on the right and bottom edges are dropped.
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int comps, int scale );
+
+    /**
+     * @brief Same as QOIReader::open() above, but decodes a QOI file which is already in memory.
+     *        The data must stay valid while the reader is in use.
+     * @param [in]  data        The QOI file data.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor (see QOIReader::open() above).
+     * @return True on success, otherwise false.
+     */
+    bool open( const uint8* data, size_t size, int comps, int scale );
+
+    /**
+     * @brief Returns the width of the rows.
+     * @return The width in pixels.
+     */
+    int width();
+
+    /**
+     * @brief Returns the number of rows.
+     * @return The height in pixels.
+     */
+    int height();
+
+    /**
+     * @brief Returns the number of color components of the file. QOI files always hold colors.
+     * @return 3.
+     */
+    int components();
+
+    /**
+     * @brief Decodes the next row.
+     * @param [out] row     Buffer of width() * comps bytes receiving the packed pixels of the row.
+     * @return True on success, false on a decoding error.
+     */
+    bool read( uint8* row );
+
+public: /* static methods */
+    /**
+     * @brief Reads only the header of a QOI file.
+     * @param [in]  filename    The QOI filename.
+     * @param [out] width       Width of the image.
+     * @param [out] height      Height of the image.
+     * @return True if the file is a supported QOI file, otherwise false.
+     */
+    static bool probe( const char* filename, int* width, int* height );
+
+    /**
+     * @brief Same as QOIReader::probe() above, but reads the header of a QOI file in memory.
+     * @param [in]  data        The QOI file data, or at least its header.
+     * @param [in]  size        Size of the data in bytes.
+     * @param [out] width       Width of the image.
+     * @param [out] height      Height of the image.
+     * @return True if the data is a supported QOI file, otherwise false.
+     */
+    static bool probe( const uint8* data, size_t size, int* width, int* height );
+
+private: /* methods */
+    /**
+     * @brief Reads the header of the file and sets up the decoder.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @param [in]  scale       Shrink factor.
+     * @return True on success, otherwise false.
+     */
+    bool begin( int comps, int scale );
+
+    /**
+     * @brief Decodes the next row of the file.
+     * @param [out] dst     Buffer of file width * comps bytes.
+     * @return True on success, false on a decoding error.
+     */
+    bool decodeRow( uint8* dst );
+
+    /**
+     * @brief Returns the next byte of the file.
+     * @return The byte, or -1 at the end of the file.
+     */
+    int next()
+    {
+        if( mPos == mEnd && !fill() ) {
+            return -1;
+        }
+        return mData[ mPos++ ];
+    }
+
+    /**
+     * @brief Refills the read buffer.
+     * @return False at the end of the file, or of the data in memory.
+     */
+    bool fill();
+
+private: /* member variables */
+    /**
+     * @brief The input file, or a null pointer.
+     */
+    FILE* mFile;
+
+    /**
+     * @brief Read buffer of the file.
+     */
+    std::vector< uint8 > mBuffer;
+
+    /**
+     * @brief The bytes being decoded, either the read buffer or the whole file in memory, the
+     *        position of the next byte and the end of the bytes.
+     */
+    const uint8* mData;
+    size_t mPos, mEnd;
+
+    /**
+     * @brief Width and height of the file.
+     */
+    int mFileWidth, mFileHeight;
+
+    /**
+     * @brief Number of color components per pixel of the rows.
+     */
+    int mComps;
+
+    /**
+     * @brief Shrink factor.
+     */
+    int mScale;
+
+    /**
+     * @brief Decoder state: the previous pixel (RGBA), the pixels seen before, indexed by their
+     *        hash, and the number of pixels left in the current run.
+     */
+    uint8 mPixel[ 4 ];
+    uint8 mIndex[ 64 ][ 4 ];
+    int mRun;
+
+    /**
+     * @brief Number of bytes per pixel of the file, 3 (RGB) or 4 (RGBA).
+     */
+    int mChannels;
+
+    /**
+     * @brief A decoded row of the file while shrinking.
+     */
+    std::vector< uint8 > mLine;
+
+    /**
+     * @brief Sums of the input pixels of a row while shrinking.
+     */
+    std::vector< unsigned int > mSums;
+};
+
+#endif // QOIREADER_H
@@ -0,0 +1,142 @@
+#include <cstring>
+#include "qoiwriter.h"
+
+/**
+ * @brief QOIWriter constructor. Constructs a writer without an open file.
+ */
+QOIWriter::QOIWriter() : mFile( 0 ), mWidth( 0 ), mComps( 3 ), mRowsLeft( 0 ), mRun( 0 ), mOk( false )
+{
+}
+
+/* Destructor */
+QOIWriter::~QOIWriter()
+{
+    close();
+}
+
+/**
+ * @brief Creates a QOI file and writes its header.
+ * @param [in]  filename    Output filename.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+ * @return True on success, otherwise false.
+ */
+bool QOIWriter::open( const char* filename, int width, int height, int comps )
+{
+    if( mFile || width < 1 || height < 1 || ( comps != 1 && comps != 3 ) ) {
+        return false;
+    }
+    mFile = ImageFormat::openOutput( filename );
+    if( mFile == 0 ) {
+        return false;
+    }
+
+    // Magic, width, height (32 bit big endian), 3 channels, sRGB.
+    uint8 header[ 14 ] = { 'q', 'o', 'i', 'f',
+                           (uint8)( width >> 24 ), (uint8)( width >> 16 ), (uint8)( width >> 8 ), (uint8)width,
+                           (uint8)( height >> 24 ), (uint8)( height >> 16 ), (uint8)( height >> 8 ), (uint8)height,
+                           3, 0 };
+    mOk = fwrite( header, sizeof( header ), 1, mFile ) == 1;
+
+    // The encoder starts with opaque black and an index of transparent black, which no opaque
+    // pixel matches.
+    mPixel[ 0 ] = mPixel[ 1 ] = mPixel[ 2 ] = 0;
+    memset( mIndex, 0, sizeof( mIndex ) );
+    memset( mIndexUsed, 0, sizeof( mIndexUsed ) );
+    mRun = 0;
+    mWidth = width;
+    mComps = comps;
+    mRowsLeft = height;
+    mChunk.resize( (size_t)width * 4 + 1 );
+    return mOk;
+}
+
+/**
+ * @brief Encodes the next row. Runs continue from one row into the next.
+ * @param [in]  row     The width * comps packed pixels of the row.
+ * @return True on success, otherwise false.
+ */
+bool QOIWriter::write( const uint8* row )
+{
+    if( mFile == 0 || mRowsLeft == 0 ) {
+        return false;
+    }
+    uint8* out = &mChunk[ 0 ];
+    uint8* prev = mPixel;
+    for( int x = 0 ; x < mWidth ; x++ ) {
+        const uint8* src = row + x * mComps;
+        uint8 px[ 3 ] = { src[ 0 ], src[ mComps == 1 ? 0 : 1 ], src[ mComps == 1 ? 0 : 2 ] };
+        if( px[ 0 ] == prev[ 0 ] && px[ 1 ] == prev[ 1 ] && px[ 2 ] == prev[ 2 ] ) {
+            // QOI_OP_RUN, at most 62 pixels.
+            if( ++mRun == 62 ) {
+                *out++ = 0xC0 | ( mRun - 1 );
+                mRun = 0;
+            }
+            continue;
+        }
+        if( mRun > 0 ) {
+            *out++ = 0xC0 | ( mRun - 1 );
+            mRun = 0;
+        }
+
+        // The alpha of all pixels is 255, which is part of the hash.
+        int hash = ( px[ 0 ] * 3 + px[ 1 ] * 5 + px[ 2 ] * 7 + 255 * 11 ) % 64;
+        if( mIndexUsed[ hash ] && memcmp( mIndex[ hash ], px, 3 ) == 0 ) {
+            // QOI_OP_INDEX.
+            *out++ = hash;
+        }
+        else {
+            memcpy( mIndex[ hash ], px, 3 );
+            mIndexUsed[ hash ] = true;
+            signed char dr = px[ 0 ] - prev[ 0 ];
+            signed char dg = px[ 1 ] - prev[ 1 ];
+            signed char db = px[ 2 ] - prev[ 2 ];
+            signed char dgr = dr - dg;
+            signed char dgb = db - dg;
+            if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 ) {
+                // QOI_OP_DIFF.
+                *out++ = 0x40 | ( ( dr + 2 ) << 4 ) | ( ( dg + 2 ) << 2 ) | ( db + 2 );
+            }
+            else if( dgr >= -8 && dgr <= 7 && dg >= -32 && dg <= 31 && dgb >= -8 && dgb <= 7 ) {
+                // QOI_OP_LUMA.
+                *out++ = 0x80 | ( dg + 32 );
+                *out++ = ( ( dgr + 8 ) << 4 ) | ( dgb + 8 );
+            }
+            else {
+                // QOI_OP_RGB.
+                *out++ = 0xFE;
+                *out++ = px[ 0 ];
+                *out++ = px[ 1 ];
+                *out++ = px[ 2 ];
+            }
+        }
+        memcpy( prev, px, 3 );
+    }
+
+    size_t size = out - &mChunk[ 0 ];
+    mOk = mOk && ( size == 0 || fwrite( &mChunk[ 0 ], 1, size, mFile ) == size );
+    mRowsLeft--;
+    return mOk;
+}
+
+/**
+ * @brief Ends the last run, writes the end marker and closes the file.
+ * @return True if all rows were written, otherwise false.
+ */
+bool QOIWriter::close()
+{
+    if( mFile == 0 ) {
+        return false;
+    }
+    if( mRun > 0 ) {
+        uint8 run = 0xC0 | ( mRun - 1 );
+        mOk = mOk && fwrite( &run, 1, 1, mFile ) == 1;
+        mRun = 0;
+    }
+    static const uint8 end[ 8 ] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    mOk = mOk && fwrite( end, sizeof( end ), 1, mFile ) == 1;
+    bool ok = ImageFormat::closeOutput( mFile ) && mOk && mRowsLeft == 0;
+    mFile = 0;
+    return ok;
+}
@@ -0,0 +1,84 @@
+#ifndef QOIWRITER_H
+#define QOIWRITER_H
+
+#include <cstdio>
+#include <vector>
+#include "rgbpixel.h"
+#include "imageformat.h"
+
+/**
+ * @brief The QOIWriter class encodes a QOI ("Quite OK Image") file one row at a time. QOI is
+ *        lossless and encodes in a single pass. Its runs and small differences suit the smooth
+ *        sorted outputs well. Grayscale rows are written as RGB, since QOI has no grayscale mode.
+ */
+class QOIWriter : public ImageWriter
+{
+public: /* methods */
+    /**
+     * @brief QOIWriter constructor. Constructs a writer without an open file.
+     */
+    QOIWriter();
+
+    /* Destructor */
+    ~QOIWriter();
+
+    /**
+     * @brief Creates a QOI file and writes its header.
+     * @param [in]  filename    Output filename.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel of the rows: 1 (luma) or 3 (RGB).
+     * @return True on success, otherwise false.
+     */
+    bool open( const char* filename, int width, int height, int comps );
+
+    /**
+     * @brief Encodes the next row.
+     * @param [in]  row     The width * comps packed pixels of the row.
+     * @return True on success, otherwise false.
+     */
+    bool write( const uint8* row );
+
+    /**
+     * @brief Ends the last run, writes the end marker and closes the file.
+     * @return True if all rows were written, otherwise false.
+     */
+    bool close();
+
+private: /* member variables */
+    /**
+     * @brief The output file, or a null pointer.
+     */
+    FILE* mFile;
+
+    /**
+     * @brief Width of the image and number of color components per pixel of the rows.
+     */
+    int mWidth, mComps;
+
+    /**
+     * @brief Number of rows still to be written.
+     */
+    int mRowsLeft;
+
+    /**
+     * @brief Encoder state: the previous pixel (RGB), the pixels seen before, indexed by their
+     *        hash, and the length of the current run.
+     */
+    uint8 mPixel[ 3 ];
+    uint8 mIndex[ 64 ][ 3 ];
+    bool mIndexUsed[ 64 ];
+    int mRun;
+
+    /**
+     * @brief The encoded bytes of a row.
+     */
+    std::vector< uint8 > mChunk;
+
+    /**
+     * @brief False after a write error.
+     */
+    bool mOk;
+};
+
+#endif // QOIWRITER_H
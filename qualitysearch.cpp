@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <thread>
+#include "qualitysearch.h"
+#include "imageformat.h"
+
+/**
+ * @brief Encodes a packed pixel buffer at the highest quality whose file fits into a size.
+ *
+ * The first trial uses the quality of the parameters, so a budget which the default quality
+ * already meets only costs the scan for higher qualities. Each round then runs one trial per core
+ * at qualities spread evenly over the range left, and keeps the range between the best trial which
+ * fits and the next one, since the size grows with the quality. With n cores a round cuts the
+ * range into n + 1 parts, where a binary search would cut it in 2.
+ *
+ * @param [in]  pixels      Pixel buffer of width * height * comps bytes.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @param [in]  params      Compression parameters (see Image::jpgParams()). The quality is the
+ *                          first one tried.
+ * @param [in]  target      Maximum size of the file in bytes.
+ * @param [out] data        The encoded file.
+ * @param [out] quality     Quality of the encoded file, 0 if the file does not fit even at
+ *                          quality 1, or a null pointer.
+ * @return True on success, false on an encoding error or if the file does not fit even at
+ *         quality 1.
+ */
+bool QualitySearch::encode( const uint8* pixels, int width, int height, int comps, const jpge::params& params,
+                            size_t target, std::vector< uint8 >* data, int* quality )
+{
+    // The first trial encodes the pixels and records the DCT coefficients of their blocks.
+    jpge::dct_cache cache;
+    std::vector< uint8 > first;
+    BufferStream stream( &first );
+    jpge::jpeg_encoder encoder;
+    bool ok = encoder.init( &stream, width, height, comps, params ) && encoder.set_dct_cache( &cache );
+    for( unsigned int pass = 0 ; ok && pass < encoder.get_total_passes() ; pass++ ) {
+        for( int y = 0 ; ok && y < height ; y++ ) {
+            ok = encoder.process_scanline( pixels + (size_t)y * width * comps );
+        }
+        ok = ok && encoder.process_scanline( 0 );
+    }
+    encoder.deinit();
+    if( !ok || !cache.is_filled() ) {
+        return false;
+    }
+
+    int best = 0;
+    int lo = 1;
+    int hi = params.m_quality - 1;
+    if( first.size() <= target ) {
+        best = params.m_quality;
+        data->swap( first );
+        lo = best + 1;
+        hi = 100;
+    }
+
+    bool done[ 64 ];
+    int threads = std::max( 1, std::min( (int)std::thread::hardware_concurrency(), (int)( sizeof( done ) / sizeof( done[ 0 ] ) ) ) );
+    while( lo <= hi ) {
+        int n = std::min( threads, hi - lo + 1 );
+        std::vector< int > qualities( n );
+        std::vector< std::vector< uint8 > > results( n );
+        std::vector< std::thread > workers;
+        jpge::params trialParams = params;
+        for( int t = 0 ; t < n ; t++ ) {
+            qualities[ t ] = lo + ( t + 1 ) * ( hi - lo + 2 ) / ( n + 1 ) - 1;
+            trialParams.m_quality = qualities[ t ];
+            if( t > 0 ) {
+                workers.push_back( std::thread( trial, &cache, width, height, comps, trialParams, &results[ t ], &done[ t ] ) );
+            }
+        }
+        trialParams.m_quality = qualities[ 0 ];
+        trial( &cache, width, height, comps, trialParams, &results[ 0 ], &done[ 0 ] );
+        for( size_t t = 0 ; t < workers.size() ; t++ ) {
+            workers[ t ].join();
+        }
+
+        int fit = -1;
+        for( int t = 0 ; t < n ; t++ ) {
+            if( !done[ t ] ) {
+                return false;
+            }
+            if( results[ t ].size() <= target ) {
+                fit = t;
+            }
+        }
+        if( fit >= 0 ) {
+            best = qualities[ fit ];
+            data->swap( results[ fit ] );
+            lo = best + 1;
+        }
+        if( fit + 1 < n ) {
+            hi = qualities[ fit + 1 ] - 1;
+        }
+    }
+
+    if( best == 0 ) {
+        if( quality ) {
+            *quality = 0;
+        }
+        return false;
+    }
+    if( quality ) {
+        *quality = best;
+    }
+    return true;
+}
+
+/**
+ * @brief Same as QualitySearch::encode(), but writes the file.
+ * @param [in]  pixels      Pixel buffer of width * height * comps bytes.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @param [in]  params      Compression parameters (see Image::jpgParams()).
+ * @param [in]  target      Maximum size of the file in bytes.
+ * @param [in]  filename    Output filename, or "-" for the standard output.
+ * @param [out] tooLarge    Set to true if the file does not fit even at quality 1, or a null
+ *                          pointer.
+ * @return True on write success, otherwise false. Nothing is written if the file does not fit.
+ */
+bool QualitySearch::write( const uint8* pixels, int width, int height, int comps, const jpge::params& params,
+                           size_t target, const char* filename, bool* tooLarge )
+{
+    std::vector< uint8 > data;
+    int quality = -1;
+    if( !encode( pixels, width, height, comps, params, target, &data, &quality ) ) {
+        if( tooLarge ) {
+            *tooLarge = quality == 0;
+        }
+        return false;
+    }
+    FILE* file = ImageFormat::openOutput( filename );
+    if( file == 0 ) {
+        return false;
+    }
+    bool ok = data.empty() || fwrite( &data[ 0 ], data.size(), 1, file ) == 1;
+    return ImageFormat::closeOutput( file ) && ok;
+}
+
+/**
+ * @brief Encodes a trial from the DCT coefficients of a previous encode. Runs on its own thread.
+ * @param [in]  cache       The recorded DCT coefficients, which the trial only reads.
+ * @param [in]  width       Image width.
+ * @param [in]  height      Image height.
+ * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+ * @param [in]  params      Compression parameters, with the quality of the trial.
+ * @param [out] data        The encoded file.
+ * @param [out] ok          Set to true on success, otherwise false.
+ */
+void QualitySearch::trial( jpge::dct_cache* cache, int width, int height, int comps, jpge::params params,
+                           std::vector< uint8 >* data, bool* ok )
+{
+    BufferStream stream( data );
+    jpge::jpeg_encoder encoder;
+    *ok = encoder.init( &stream, width, height, comps, params ) &&
+          encoder.set_dct_cache( cache ) && encoder.process_dct_cache();
+    encoder.deinit();
+}
+
+/**
+ * @brief Appends encoded data to the buffer.
+ * @param [in]  buf     The data.
+ * @param [in]  len     Size of the data in bytes.
+ * @return Always true.
+ */
+bool QualitySearch::BufferStream::put_buf( const void* buf, int len )
+{
+    const uint8* bytes = (const uint8*)buf;
+    mData->insert( mData->end(), bytes, bytes + len );
+    return true;
+}
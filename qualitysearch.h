@@ -0,0 +1,83 @@
+#ifndef QUALITYSEARCH_H
+#define QUALITYSEARCH_H
+
+#include <vector>
+#include <stddef.h>
+#include <jpgd/jpge.h>
+#include "rgbpixel.h"
+
+/**
+ * @brief The QualitySearch class writes jpg files of at most a given size, at the highest quality
+ *        which fits. The image is transformed once: the first trial encode, at the quality of the
+ *        compression parameters, records the DCT coefficients of all blocks (see jpge::dct_cache).
+ *        The other trials only redo quantization and entropy coding from them. They run in memory,
+ *        one per core at the same time, each narrowing the range of qualities left to try, so that
+ *        the search takes a few rounds of encodes instead of one encode per step of a binary search.
+ */
+class QualitySearch
+{
+public: /* static methods */
+    /**
+     * @brief Encodes a packed pixel buffer at the highest quality whose file fits into a size.
+     * @param [in]  pixels      Pixel buffer of width * height * comps bytes.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [in]  params      Compression parameters (see Image::jpgParams()). The quality is the
+     *                          first one tried.
+     * @param [in]  target      Maximum size of the file in bytes.
+     * @param [out] data        The encoded file.
+     * @param [out] quality     Quality of the encoded file, 0 if the file does not fit even at
+     *                          quality 1, or a null pointer.
+     * @return True on success, false on an encoding error or if the file does not fit even at
+     *         quality 1.
+     */
+    static bool encode( const uint8* pixels, int width, int height, int comps, const jpge::params& params,
+                        size_t target, std::vector< uint8 >* data, int* quality );
+
+    /**
+     * @brief Same as QualitySearch::encode(), but writes the file.
+     * @param [in]  pixels      Pixel buffer of width * height * comps bytes.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [in]  params      Compression parameters (see Image::jpgParams()).
+     * @param [in]  target      Maximum size of the file in bytes.
+     * @param [in]  filename    Output filename, or "-" for the standard output.
+     * @param [out] tooLarge    Set to true if the file does not fit even at quality 1, or a null
+     *                          pointer.
+     * @return True on write success, otherwise false. Nothing is written if the file does not fit.
+     */
+    static bool write( const uint8* pixels, int width, int height, int comps, const jpge::params& params,
+                       size_t target, const char* filename, bool* tooLarge );
+
+private: /* types */
+    /**
+     * @brief Output stream of the encoder into a growing buffer.
+     */
+    class BufferStream : public jpge::output_stream
+    {
+    public:
+        BufferStream( std::vector< uint8 >* data ) : mData( data ) {}
+        bool put_buf( const void* buf, int len );
+
+    private:
+        std::vector< uint8 >* mData;
+    };
+
+private: /* static methods */
+    /**
+     * @brief Encodes a trial from the DCT coefficients of a previous encode. Runs on its own thread.
+     * @param [in]  cache       The recorded DCT coefficients, which the trial only reads.
+     * @param [in]  width       Image width.
+     * @param [in]  height      Image height.
+     * @param [in]  comps       Number of color components per pixel: 1 (luma) or 3 (RGB).
+     * @param [in]  params      Compression parameters, with the quality of the trial.
+     * @param [out] data        The encoded file.
+     * @param [out] ok          Set to true on success, otherwise false.
+     */
+    static void trial( jpge::dct_cache* cache, int width, int height, int comps, jpge::params params,
+                       std::vector< uint8 >* data, bool* ok );
+};
+
+#endif // QUALITYSEARCH_H
@@ -0,0 +1,248 @@
+#ifndef SORTKEY_H
+#define SORTKEY_H
+
+#include <string>
+#include "rgbpixel.h"
+#include "keytable.h"
+
+/*
+ * Sorting keys. Each key is a policy struct which the sorting engines are instantiated with at
+ * compile time, so that computing and comparing keys is inlined into the sorting loops. A key
+ * policy provides:
+ *
+ * - name():            The name of the key on the command line.
+ * - key( r, g, b ):    The key of a color, used by the comparison based engines.
+ * - bucket( r, g, b ): The key of a color as an integer from 0 to BUCKETS - 1, used by the counting
+ *                      sort. It must never decrease when key() increases. Keys which are not integers
+ *                      by nature are quantized, so colors with almost equal keys may share a bucket.
+ *
+ * Keys which are expensive to compute are looked up in a precomputed table instead (see KeyTable).
+ *
+ * To add a key, write its policy struct and add its name to SORT_KEY_NAMES and to the dispatch
+ * in main.cpp.
+ */
+
+/**
+ * @brief Names of all sorting keys, terminated by a null pointer.
+ */
+static const char* const SORT_KEY_NAMES[] = { "lightness", "value", "luma", "hue", "saturation", "chroma", "cielab", "oklab", 0 };
+
+/**
+ * @brief Returns the largest color component.
+ */
+static inline uint8 maxComponent( uint8 r, uint8 g, uint8 b )
+{
+    uint8 M = r > g ? r : g;
+    return M > b ? M : b;
+}
+
+/**
+ * @brief Returns the smallest color component.
+ */
+static inline uint8 minComponent( uint8 r, uint8 g, uint8 b )
+{
+    uint8 m = r < g ? r : g;
+    return m < b ? m : b;
+}
+
+/**
+ * @brief Lightness component in HSL colorspace: (max + min) / 2 (see RGBPixel::lightness()).
+ */
+struct LightnessKey
+{
+    static const char* name() { return "lightness"; }
+    static const int BUCKETS = 511;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return 0.5 * ( maxComponent( r, g, b ) + minComponent( r, g, b ) );
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        return maxComponent( r, g, b ) + minComponent( r, g, b );
+    }
+};
+
+/**
+ * @brief Value component in HSV colorspace: max (see RGBPixel::value()).
+ */
+struct ValueKey
+{
+    static const char* name() { return "value"; }
+    static const int BUCKETS = 256;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return maxComponent( r, g, b );
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        return maxComponent( r, g, b );
+    }
+};
+
+/**
+ * @brief Luma with the Rec. 709 weights: 0.2126 R + 0.7152 G + 0.0722 B.
+ *        Buckets are 1/256 of a luma level wide.
+ */
+struct LumaKey
+{
+    static const char* name() { return "luma"; }
+    static const int BUCKETS = 65536;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return 0.2126 * r + 0.7152 * g + 0.0722 * b;
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        // The same weights in 16 bit fixed point, they add up to 65536.
+        return ( 13933 * r + 46871 * g + 4732 * b ) >> 8;
+    }
+};
+
+/**
+ * @brief Hue component in HSV colorspace, in degrees from 0 (red) to 360. Grays have hue 0.
+ *        Buckets are 1/256 of a color wheel sector (60 degrees) wide.
+ */
+struct HueKey
+{
+    static const char* name() { return "hue"; }
+    static const int BUCKETS = 6 * 256;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        int M = maxComponent( r, g, b );
+        int c = M - minComponent( r, g, b );
+        if( c == 0 ) {
+            return 0;
+        }
+        double h;
+        if( M == r ) {
+            h = (double)( g - b ) / c;
+            if( h < 0 ) h += 6;
+        }
+        else if( M == g ) {
+            h = (double)( b - r ) / c + 2;
+        }
+        else {
+            h = (double)( r - g ) / c + 4;
+        }
+        return 60 * h;
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        int i = (int)( key( r, g, b ) * ( BUCKETS / 360.0 ) );
+        return i < BUCKETS ? i : BUCKETS - 1;
+    }
+};
+
+/**
+ * @brief Saturation component in HSV colorspace: (max - min) / max, from 0 to 1. Black has
+ *        saturation 0. Buckets are 1/1023 wide.
+ */
+struct SaturationKey
+{
+    static const char* name() { return "saturation"; }
+    static const int BUCKETS = 1024;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        int M = maxComponent( r, g, b );
+        return M ? (double)( M - minComponent( r, g, b ) ) / M : 0;
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        int M = maxComponent( r, g, b );
+        return M ? ( M - minComponent( r, g, b ) ) * ( BUCKETS - 1 ) / M : 0;
+    }
+};
+
+/**
+ * @brief Chroma: max - min.
+ */
+struct ChromaKey
+{
+    static const char* name() { return "chroma"; }
+    static const int BUCKETS = 256;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return maxComponent( r, g, b ) - minComponent( r, g, b );
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        return maxComponent( r, g, b ) - minComponent( r, g, b );
+    }
+};
+
+/**
+ * @brief CIE 1976 lightness L*, looked up in a KeyTable (see cieLightness()).
+ */
+struct CieLightnessKey
+{
+    static const char* name() { return "cielab"; }
+    static const int BUCKETS = 65536;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return table().at( r, g, b );
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        return table().at( r, g, b );
+    }
+    static const KeyTable& table()
+    {
+        static KeyTable t( name(), cieLightness );
+        return t;
+    }
+};
+
+/**
+ * @brief OKLab lightness L, looked up in a KeyTable (see oklabLightness()).
+ */
+struct OklabLightnessKey
+{
+    static const char* name() { return "oklab"; }
+    static const int BUCKETS = 65536;
+    static inline double key( uint8 r, uint8 g, uint8 b )
+    {
+        return table().at( r, g, b );
+    }
+    static inline int bucket( uint8 r, uint8 g, uint8 b )
+    {
+        return table().at( r, g, b );
+    }
+    static const KeyTable& table()
+    {
+        static KeyTable t( name(), oklabLightness );
+        return t;
+    }
+};
+
+/**
+ * @brief Returns true if a sorting key is looked up in a KeyTable, which takes KeyTable::BYTES of memory.
+ */
+static inline bool isTableKey( const std::string& name )
+{
+    return name.compare( CieLightnessKey::name() ) == 0 || name.compare( OklabLightnessKey::name() ) == 0;
+}
+
+/**
+ * @brief Comparison of two RGBPixel objects by a sorting key, to be used with std::sort().
+ */
+template< class Key >
+struct PixelOrder
+{
+    bool operator()( RGBPixel* px1, RGBPixel* px2 ) const
+    {
+        return Key::key( px1->r(), px1->g(), px1->b() ) < Key::key( px2->r(), px2->g(), px2->b() );
+    }
+};
+
+/**
+ * @brief Returns true if a name is the name of a sorting key (see SORT_KEY_NAMES).
+ */
+static inline bool isSortKey( const std::string& name )
+{
+    for( int i = 0 ; SORT_KEY_NAMES[ i ] ; i++ ) {
+        if( name.compare( SORT_KEY_NAMES[ i ] ) == 0 ) return true;
+    }
+    return false;
+}
+
+#endif // SORTKEY_H
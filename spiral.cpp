@@ -0,0 +1,167 @@
+#include "spiral.h"
+
+/**
+ * @brief Returns the number of integers in both [a, b] and [lo, hi].
+ */
+static inline long overlap( int a, int b, int lo, int hi )
+{
+    if( a < lo ) a = lo;
+    if( b > hi ) b = hi;
+    return ( b >= a ) ? b - a + 1 : 0;
+}
+
+/**
+ * @brief Spiral constructor. Prepares a walk over a canvas with specified width and height.
+ * @param [in]  width   Canvas width.
+ * @param [in]  height  Canvas height.
+ * @param [in]  x       Start position in x axis.
+ * @param [in]  y       Start position in y axis.
+ */
+Spiral::Spiral( int width, int height, int x, int y ) :
+    mWidth( width ), mHeight( height ), mX( x ), mY( y ),
+    mDir( RIGHT ), mSteps( 0 ), mStep( 0 ), mRemaining( (long)width * height ), mFirst( true )
+{
+}
+
+/**
+ * @brief Moves to the next position inside the canvas. The first call returns the start position.
+ * @param [out] x       Value in x-axis.
+ * @param [out] y       Value in y-axis.
+ * @return False if all positions of the canvas have been visited, otherwise true.
+ */
+bool Spiral::next( int* x, int* y )
+{
+    // -------------------------------------------------------------------------------------------------
+    // Define the directions first. Basically the radial movement is:
+    //                           RIGHT -> DOWN -> LEFT -> UP -> repeat.
+    //
+    // We define the first direction is RIGHT and the movement step is 0, which will be incremented
+    // AFTER each DOWN and UP steps.
+    //
+    // Movement example (5 x 5) pixels from the middle of canvas:
+    //
+    // Empty          0 step         1 step RIGHT   1 step DOWN    2 steps LEFT   2 steps UP     3 steps RIGHT
+    // pixels         (step = 0)     (step = 1)     (step = 1)     (step = 2)     (step = 2)     (step = 3)
+    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .
+    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . 6 . . .      . 6 7 8 9
+    // . . . . .  ->  . . 0 . .  ->  . . 0 1 .  ->  . . 0 1 .  ->  . . 0 1 .  ->  . 5 0 1 .  ->  . 5 0 1 .  ->  and so on..
+    // . . . . .      . . . . .      . . . . .      . . . 2 .      . 4 3 2 .      . 4 3 2 .      . 4 3 2 .
+    // . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .      . . . . .
+    //
+    // -------------------------------------------------------------------------------------------------
+    if( mRemaining == 0 ) {
+        return false;
+    }
+
+    bool inside;
+    if( mFirst ) {
+        mFirst = false;
+        inside = ( mX >= 0 && mX < mWidth && mY >= 0 && mY < mHeight );
+    }
+    else {
+        inside = false;
+    }
+
+    // Walk until we are on a position inside the canvas. Positions outside of the canvas are walked
+    // over but not returned.
+    while( !inside ) {
+        // Change direction after walking all steps: RIGHT -> DOWN -> LEFT -> UP -> repeat.
+        // If after going down or going up, the number of steps should be incremented.
+        while( mStep == mSteps ) {
+            if( mDir == DOWN || mDir == UP ) mSteps++;
+
+            if      ( mDir == RIGHT  ) mDir = DOWN;
+            else if ( mDir == DOWN   ) mDir = LEFT;
+            else if ( mDir == LEFT   ) mDir = UP;
+            else if ( mDir == UP     ) mDir = RIGHT;
+            mStep = 0;
+        }
+
+        // Set the x and y position based on the direction.
+        if      ( mDir == RIGHT  )  mX++;
+        else if ( mDir == DOWN   )  mY++;
+        else if ( mDir == LEFT   )  mX--;
+        else if ( mDir == UP     )  mY--;
+        mStep++;
+
+        inside = ( mX >= 0 && mX < mWidth && mY >= 0 && mY < mHeight );
+    }
+
+    mRemaining--;
+    *x = mX;
+    *y = mY;
+    return true;
+}
+
+/**
+ * @brief Returns the number of canvas positions a spiral visits before it reaches a position,
+ *        which makes it the inverse of Spiral::next(). The result is computed in closed form,
+ *        without walking the spiral.
+ * @param [in]  width   Canvas width.
+ * @param [in]  height  Canvas height.
+ * @param [in]  x       Start position of the spiral in x axis.
+ * @param [in]  y       Start position of the spiral in y axis.
+ * @param [in]  px      Position inside the canvas in x axis.
+ * @param [in]  py      Position inside the canvas in y axis.
+ * @return The 0-based visiting order of the position.
+ */
+long Spiral::rank( int width, int height, int x, int y, int px, int py )
+{
+    // Work in coordinates relative to the start position and mirrored through it, (u, v) = (x - px, y - py).
+    // The spiral then walks 1 step right, 1 down, 2 left, 2 up, 3 right, 3 down, ... and after k * k steps
+    // it has covered the k x k square
+    //     [-m, m] x [-m, m]           for odd k = 2m + 1,
+    //     [1 - m, m] x [1 - m, m]     for even k = 2m.
+    // Square k is square k - 1 plus an L-shaped shell of two legs:
+    //     even k: down along u = m from v = 1 - m to m, then left along v = m from u = m - 1 to 1 - m,
+    //     odd k:  up along u = -m from v = m to -m, then right along v = -m from u = 1 - m to m.
+    // The rank is the number of canvas positions in square k - 1, plus those walked earlier in the shell.
+    int u = x - px;
+    int v = y - py;
+    int uLo = x - width + 1, uHi = x;
+    int vLo = y - height + 1, vHi = y;
+
+    // Find the smallest square which holds (u, v).
+    int au = u < 0 ? -u : u;
+    int av = v < 0 ? -v : v;
+    int oddM = au > av ? au : av;
+    int evenM = u;
+    if( v > evenM ) evenM = v;
+    if( 1 - u > evenM ) evenM = 1 - u;
+    if( 1 - v > evenM ) evenM = 1 - v;
+    int k = ( 2 * oddM + 1 < 2 * evenM ) ? 2 * oddM + 1 : 2 * evenM;
+    if( k == 1 ) {
+        return 0;
+    }
+
+    // Canvas positions in square k - 1.
+    int j = k - 1;
+    int lo = ( j % 2 ) ? -( j / 2 ) : 1 - j / 2;
+    int hi = j / 2;
+    long r = overlap( lo, hi, uLo, uHi ) * overlap( lo, hi, vLo, vHi );
+
+    // Canvas positions walked earlier in the shell of square k.
+    if( k % 2 == 0 ) {
+        int m = k / 2;
+        long uIn = overlap( m, m, uLo, uHi );
+        if( u == m ) {
+            r += uIn * overlap( 1 - m, v - 1, vLo, vHi );
+        }
+        else {
+            r += uIn * overlap( 1 - m, m, vLo, vHi );
+            r += overlap( u + 1, m - 1, uLo, uHi ) * overlap( m, m, vLo, vHi );
+        }
+    }
+    else {
+        int m = k / 2;
+        long uIn = overlap( -m, -m, uLo, uHi );
+        if( u == -m ) {
+            r += uIn * overlap( v + 1, m, vLo, vHi );
+        }
+        else {
+            r += uIn * overlap( -m, m, vLo, vHi );
+            r += overlap( 1 - m, u - 1, uLo, uHi ) * overlap( -m, -m, vLo, vHi );
+        }
+    }
+    return r;
+}
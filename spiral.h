@@ -0,0 +1,96 @@
+#ifndef SPIRAL_H
+#define SPIRAL_H
+
+/**
+ * @brief The Spiral class walks all positions of a canvas in a square spiral around a start position.
+ *        Positions outside of the canvas are skipped, so each position inside the canvas is
+ *        visited exactly once.
+ */
+class Spiral
+{
+public: /* methods */
+    /**
+     * @brief Spiral constructor. Prepares a walk over a canvas with specified width and height.
+     * @param [in]  width   Canvas width.
+     * @param [in]  height  Canvas height.
+     * @param [in]  x       Start position in x axis.
+     * @param [in]  y       Start position in y axis.
+     */
+    Spiral( int width, int height, int x, int y );
+
+    /**
+     * @brief Moves to the next position inside the canvas. The first call returns the start position.
+     * @param [out] x       Value in x-axis.
+     * @param [out] y       Value in y-axis.
+     * @return False if all positions of the canvas have been visited, otherwise true.
+     */
+    bool next( int* x, int* y );
+
+public: /* static methods */
+    /**
+     * @brief Returns the number of canvas positions a spiral visits before it reaches a position,
+     *        which makes it the inverse of Spiral::next(). The result is computed in closed form,
+     *        without walking the spiral.
+     * @param [in]  width   Canvas width.
+     * @param [in]  height  Canvas height.
+     * @param [in]  x       Start position of the spiral in x axis.
+     * @param [in]  y       Start position of the spiral in y axis.
+     * @param [in]  px      Position inside the canvas in x axis.
+     * @param [in]  py      Position inside the canvas in y axis.
+     * @return The 0-based visiting order of the position.
+     */
+    static long rank( int width, int height, int x, int y, int px, int py );
+
+private: /* member variables */
+    /**
+     * @brief The movement directions, in the order in which they are taken.
+     */
+    enum Direction { RIGHT, DOWN, LEFT, UP };
+
+    /**
+     * @brief Canvas width.
+     */
+    int mWidth;
+
+    /**
+     * @brief Canvas height.
+     */
+    int mHeight;
+
+    /**
+     * @brief Current position in x axis.
+     */
+    int mX;
+
+    /**
+     * @brief Current position in y axis.
+     */
+    int mY;
+
+    /**
+     * @brief Current movement direction.
+     */
+    Direction mDir;
+
+    /**
+     * @brief Number of steps to walk in the current direction.
+     */
+    int mSteps;
+
+    /**
+     * @brief Number of steps already walked in the current direction.
+     */
+    int mStep;
+
+    /**
+     * @brief Number of canvas positions not visited yet.
+     */
+    long mRemaining;
+
+    /**
+     * @brief True until the start position has been returned.
+     */
+    bool mFirst;
+};
+
+#endif // SPIRAL_H
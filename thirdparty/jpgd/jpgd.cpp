@@ -12,6 +12,15 @@
 #include "jpgd.h"
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+  #define JPGD_SUPPORT_MMAP 1
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#else
+  #define JPGD_SUPPORT_MMAP 0
+#endif
+
 #include <assert.h>
 #define JPGD_ASSERT(x) assert(x)
 
@@ -874,7 +883,7 @@ void *jpeg_decoder::alloc(size_t nSize, bool zero)
   }
   if (!rv)
   {
-    int capacity = JPGD_MAX(32768 - 256, (nSize + 2047) & ~2047);
+    size_t capacity = JPGD_MAX((size_t)(32768 - 256), (nSize + 2047) & ~(size_t)2047);
     mem_block *b = (mem_block*)jpgd_malloc(sizeof(mem_block) + capacity);
     if (!b) { stop_decoding(JPGD_NOTENOUGHMEM); }
     b->m_pNext = m_pMem_blocks; m_pMem_blocks = b;
@@ -908,6 +917,21 @@ void jpeg_decoder::prep_in_buffer()
   if (m_eof_flag)
     return;
 
+  // Consume the stream's memory in place if it offers it. No padding is written here, as the memory right after the
+  // returned block may belong to the next one (get_char() and get_bits_no_markers() never read past m_in_buf_left anyway).
+  uint8 *pIn_place = NULL;
+  int bytes_in_place = m_pStream->read_in_place(&pIn_place, 1 << 30, &m_eof_flag);
+  if (bytes_in_place == -1)
+    stop_decoding(JPGD_STREAM_READ);
+  if ((bytes_in_place > 0) || (m_eof_flag))
+  {
+    if (bytes_in_place > 0)
+      m_pIn_buf_ofs = pIn_place;
+    m_in_buf_left = bytes_in_place;
+    m_total_bytes_read += bytes_in_place;
+    return;
+  }
+
   do
   {
     int bytes_read = m_pStream->read(m_in_buf + m_in_buf_left, JPGD_IN_BUF_SIZE - m_in_buf_left, &m_eof_flag);
@@ -2584,14 +2608,15 @@ jpeg_decoder::coeff_buf* jpeg_decoder::coeff_buf_open(int block_num_x, int block
   cb->block_len_x = block_len_x;
   cb->block_len_y = block_len_y;
   cb->block_size = (block_len_x * block_len_y) * sizeof(jpgd_block_t);
-  cb->pData = (uint8 *)alloc(cb->block_size * block_num_x * block_num_y, true);
+  cb->row_size = (size_t)cb->block_size * block_num_x;
+  cb->pData = (uint8 *)alloc(cb->row_size * block_num_y, true);
   return cb;
 }
 
 inline jpgd_block_t *jpeg_decoder::coeff_buf_getp(coeff_buf *cb, int block_x, int block_y)
 {
   JPGD_ASSERT((block_x < cb->block_num_x) && (block_y < cb->block_num_y));
-  return (jpgd_block_t *)(cb->pData + block_x * cb->block_size + block_y * (cb->block_size * cb->block_num_x));
+  return (jpgd_block_t *)(cb->pData + (size_t)block_x * cb->block_size + block_y * cb->row_size);
 }
 
 // The following methods decode the various types of m_blocks encountered
@@ -3027,6 +3052,114 @@ int jpeg_decoder_file_stream::read(uint8 *pBuf, int max_bytes_to_read, bool *pEO
   return bytes_read;
 }
 
+jpeg_decoder_mmap_stream::jpeg_decoder_mmap_stream()
+{
+  m_pMap = NULL;
+  m_map_size = 0;
+  m_pSrc_data = NULL;
+  m_ofs = 0;
+  m_size = 0;
+}
+
+jpeg_decoder_mmap_stream::~jpeg_decoder_mmap_stream()
+{
+  close();
+}
+
+void jpeg_decoder_mmap_stream::close()
+{
+#if JPGD_SUPPORT_MMAP
+  if (m_pMap)
+    munmap(m_pMap, m_map_size);
+#endif
+  m_pMap = NULL;
+  m_map_size = 0;
+  m_pSrc_data = NULL;
+  m_ofs = 0;
+  m_size = 0;
+
+  jpeg_decoder_file_stream::close();
+}
+
+bool jpeg_decoder_mmap_stream::open(const char *Pfilename)
+{
+  close();
+
+  if (!jpeg_decoder_file_stream::open(Pfilename))
+    return false;
+
+#if JPGD_SUPPORT_MMAP
+  struct stat st;
+  const int fd = fileno(m_pFile);
+  if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)) || (st.st_size <= 0))
+    return true; // Pipe, device or empty file: use buffered reads.
+
+  // Reserve one guard page in front of the file (the decoder may put back bytes it has already read) and one after it,
+  // then map the file privately on top of the reservation so those writes never reach the file.
+  const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t file_size = static_cast<size_t>(st.st_size);
+  const size_t map_size = page_size + ((file_size + page_size - 1) / page_size) * page_size + page_size;
+
+  void *pMap = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (pMap == MAP_FAILED)
+    return true;
+
+  uint8 *pFile_data = static_cast<uint8*>(pMap) + page_size;
+  if (mmap(pFile_data, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    munmap(pMap, map_size);
+    return true;
+  }
+  madvise(pFile_data, file_size, MADV_SEQUENTIAL);
+
+  m_pMap = static_cast<uint8*>(pMap);
+  m_map_size = map_size;
+  m_pSrc_data = pFile_data;
+  m_size = file_size;
+
+  // The mapping stays valid after the file is closed.
+  jpeg_decoder_file_stream::close();
+#endif
+
+  return true;
+}
+
+int jpeg_decoder_mmap_stream::read(uint8 *pBuf, int max_bytes_to_read, bool *pEOF_flag)
+{
+  if (!m_pMap)
+    return jpeg_decoder_file_stream::read(pBuf, max_bytes_to_read, pEOF_flag);
+
+  size_t bytes_remaining = m_size - m_ofs;
+  if ((size_t)max_bytes_to_read >= bytes_remaining)
+  {
+    max_bytes_to_read = static_cast<int>(bytes_remaining);
+    *pEOF_flag = true;
+  }
+
+  memcpy(pBuf, m_pSrc_data + m_ofs, max_bytes_to_read);
+  m_ofs += max_bytes_to_read;
+
+  return max_bytes_to_read;
+}
+
+int jpeg_decoder_mmap_stream::read_in_place(uint8 **ppBuf, int max_bytes_to_read, bool *pEOF_flag)
+{
+  if (!m_pMap)
+    return 0;
+
+  size_t bytes_remaining = m_size - m_ofs;
+  if ((size_t)max_bytes_to_read >= bytes_remaining)
+  {
+    max_bytes_to_read = static_cast<int>(bytes_remaining);
+    *pEOF_flag = true;
+  }
+
+  *ppBuf = m_pSrc_data + m_ofs;
+  m_ofs += max_bytes_to_read;
+
+  return max_bytes_to_read;
+}
+
 bool jpeg_decoder_mem_stream::open(const uint8 *pSrc_data, uint size)
 {
   close();
@@ -3082,7 +3215,7 @@ unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, i
 
   const int dst_bpl = image_width * req_comps;
 
-  uint8 *pImage_data = (uint8*)jpgd_malloc(dst_bpl * image_height);
+  uint8 *pImage_data = (uint8*)jpgd_malloc((size_t)dst_bpl * image_height);
   if (!pImage_data)
     return NULL;
 
@@ -3096,7 +3229,7 @@ unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, i
       return NULL;
     }
 
-    uint8 *pDst = pImage_data + y * dst_bpl;
+    uint8 *pDst = pImage_data + (size_t)y * dst_bpl;
 
     if (((req_comps == 1) && (decoder.get_num_components() == 1)) || ((req_comps == 4) && (decoder.get_num_components() == 3)))
       memcpy(pDst, pScan_line, dst_bpl);
@@ -3163,10 +3296,41 @@ unsigned char *decompress_jpeg_image_from_memory(const unsigned char *pSrc_data,
 
 unsigned char *decompress_jpeg_image_from_file(const char *pSrc_filename, int *width, int *height, int *actual_comps, int req_comps)
 {
-  jpgd::jpeg_decoder_file_stream file_stream;
+  jpgd::jpeg_decoder_mmap_stream file_stream;
   if (!file_stream.open(pSrc_filename))
     return NULL;
   return decompress_jpeg_image_from_stream(&file_stream, width, height, actual_comps, req_comps);
 }
 
-} // namespace jpgd
\ No newline at end of file
+bool probe_jpeg_header_from_stream(jpeg_decoder_stream *pStream, jpeg_header_info *pInfo)
+{
+  if ((!pStream) || (!pInfo))
+    return false;
+
+  // The constructor stops right after the SOF marker, begin_decoding() is what allocates the coefficient and sample buffers.
+  jpeg_decoder decoder(pStream);
+  if (decoder.get_error_code() != JPGD_SUCCESS)
+    return false;
+
+  pInfo->m_width = decoder.get_width();
+  pInfo->m_height = decoder.get_height();
+  pInfo->m_comps = decoder.get_num_components();
+  pInfo->m_progressive_flag = decoder.is_progressive();
+  return true;
+}
+
+bool probe_jpeg_header_from_memory(const unsigned char *pSrc_data, int src_data_size, jpeg_header_info *pInfo)
+{
+  jpgd::jpeg_decoder_mem_stream mem_stream(pSrc_data, src_data_size);
+  return probe_jpeg_header_from_stream(&mem_stream, pInfo);
+}
+
+bool probe_jpeg_header_from_file(const char *pSrc_filename, jpeg_header_info *pInfo)
+{
+  jpgd::jpeg_decoder_mmap_stream file_stream;
+  if (!file_stream.open(pSrc_filename))
+    return false;
+  return probe_jpeg_header_from_stream(&file_stream, pInfo);
+}
+
+} // namespace jpgd
\ No newline at end of file
@@ -64,6 +64,13 @@ namespace jpgd
     // Returns -1 on error, otherwise return the number of bytes actually written to the buffer (which may be 0).
     // Notes: This method will be called in a loop until you set *pEOF_flag to true or the internal buffer is full.
     virtual int read(uint8 *pBuf, int max_bytes_to_read, bool *pEOF_flag) = 0;
+
+    // Optional zero-copy interface, tried by the decoder before read() each time its input is exhausted.
+    // Streams whose data already sits in memory may set *ppBuf to the next max_bytes_to_read (or fewer) bytes and skip past them, and the decoder
+    // will consume those bytes in place instead of copying them into its internal buffer. The decoder may put back bytes it has already
+    // consumed, so all memory handed out this way must be contiguous, writable, preceded by at least 128 writable bytes, and stay valid until the decoder is destroyed.
+    // Returns -1 on error, otherwise the number of bytes available at *ppBuf. Returning 0 without setting *pEOF_flag makes the decoder use read() instead.
+    virtual int read_in_place(uint8 **ppBuf, int max_bytes_to_read, bool *pEOF_flag) { (void)ppBuf; (void)max_bytes_to_read; (void)pEOF_flag; return 0; }
   };
 
   // stdio FILE stream class.
@@ -72,6 +79,7 @@ namespace jpgd
     jpeg_decoder_file_stream(const jpeg_decoder_file_stream &);
     jpeg_decoder_file_stream &operator =(const jpeg_decoder_file_stream &);
 
+  protected:
     FILE *m_pFile;
     bool m_eof_flag, m_error_flag;
 
@@ -85,6 +93,36 @@ namespace jpgd
     virtual int read(uint8 *pBuf, int max_bytes_to_read, bool *pEOF_flag);
   };
 
+  // Memory-mapped file stream class. The decoder reads the mapped file in place, which saves a read() call and a copy per input buffer refill.
+  // Falls back to buffered stdio reads (see jpeg_decoder_file_stream) for pipes and anything else that can't be mapped, or if the platform lacks mmap().
+  class jpeg_decoder_mmap_stream : public jpeg_decoder_file_stream
+  {
+    jpeg_decoder_mmap_stream(const jpeg_decoder_mmap_stream &);
+    jpeg_decoder_mmap_stream &operator =(const jpeg_decoder_mmap_stream &);
+
+    uint8 *m_pMap;
+    size_t m_map_size;
+    uint8 *m_pSrc_data;
+    size_t m_ofs, m_size;
+
+  public:
+    jpeg_decoder_mmap_stream();
+    virtual ~jpeg_decoder_mmap_stream();
+
+    bool open(const char *Pfilename);
+    void close();
+
+    // True if the file is mapped, false if reads go through stdio.
+    inline bool is_mapped() const { return m_pMap != NULL; }
+
+    // The mapped file data and its size, or NULL if the file is not mapped.
+    inline const uint8 *get_data() const { return m_pMap ? m_pSrc_data : NULL; }
+    inline size_t get_size() const { return m_size; }
+
+    virtual int read(uint8 *pBuf, int max_bytes_to_read, bool *pEOF_flag);
+    virtual int read_in_place(uint8 **ppBuf, int max_bytes_to_read, bool *pEOF_flag);
+  };
+
   // Memory stream class.
   class jpeg_decoder_mem_stream : public jpeg_decoder_stream
   {
@@ -106,10 +144,24 @@ namespace jpgd
   // Loads JPEG file from a jpeg_decoder_stream.
   unsigned char *decompress_jpeg_image_from_stream(jpeg_decoder_stream *pStream, int *width, int *height, int *actual_comps, int req_comps);
 
+  // Image properties read from the start of frame (SOF) marker.
+  struct jpeg_header_info
+  {
+    int m_width, m_height;
+    int m_comps;              // 1 (grayscale) or 3 (YCbCr)
+    bool m_progressive_flag;
+  };
+
+  // Reads a JPEG stream's markers up to and including the SOF marker, without allocating or decoding any image data.
+  // Use this to check an image's dimensions before committing memory to it. Returns false if the stream isn't a supported JPEG.
+  bool probe_jpeg_header_from_stream(jpeg_decoder_stream *pStream, jpeg_header_info *pInfo);
+  bool probe_jpeg_header_from_memory(const unsigned char *pSrc_data, int src_data_size, jpeg_header_info *pInfo);
+  bool probe_jpeg_header_from_file(const char *pSrc_filename, jpeg_header_info *pInfo);
+
   enum 
   { 
     JPGD_IN_BUF_SIZE = 8192, JPGD_MAX_BLOCKS_PER_MCU = 10, JPGD_MAX_HUFF_TABLES = 8, JPGD_MAX_QUANT_TABLES = 4, 
-    JPGD_MAX_COMPONENTS = 4, JPGD_MAX_COMPS_IN_SCAN = 4, JPGD_MAX_BLOCKS_PER_ROW = 8192, JPGD_MAX_HEIGHT = 16384, JPGD_MAX_WIDTH = 16384 
+    JPGD_MAX_COMPONENTS = 4, JPGD_MAX_COMPS_IN_SCAN = 4, JPGD_MAX_BLOCKS_PER_ROW = 32768, JPGD_MAX_HEIGHT = 65535, JPGD_MAX_WIDTH = 65535 
   };
           
   typedef int16 jpgd_quant_t;
@@ -143,6 +195,8 @@ namespace jpgd
 
     inline int get_num_components() const { return m_comps_in_frame; }
 
+    inline bool is_progressive() const { return m_progressive_flag != 0; }
+
     inline int get_bytes_per_pixel() const { return m_dest_bytes_per_pixel; }
     inline int get_bytes_per_scan_line() const { return m_image_x_size * get_bytes_per_pixel(); }
 
@@ -170,6 +224,7 @@ namespace jpgd
       int block_num_x, block_num_y;
       int block_len_x, block_len_y;
       int block_size;
+      size_t row_size;
     };
 
     struct mem_block
@@ -20,10 +20,11 @@
 namespace jpge {
 
 static inline void *jpge_malloc(size_t nSize) { return malloc(nSize); }
+static inline void *jpge_realloc(void *p, size_t nSize) { return realloc(p, nSize); }
 static inline void jpge_free(void *p) { free(p); }
 
 // Various JPEG enums and tables.
-enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+enum { M_SOF0 = 0xC0, M_SOF2 = 0xC2, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
 enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
 static uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
@@ -288,7 +289,7 @@ void jpeg_encoder::emit_dqt()
 // Emit start of frame marker
 void jpeg_encoder::emit_sof()
 {
-  emit_marker(M_SOF0);                           /* baseline */
+  emit_marker(m_params.m_progressive_flag ? M_SOF2 : M_SOF0);   /* progressive or baseline */
   emit_word(3 * m_num_components + 2 + 5 + 1);
   emit_byte(8);                                  /* precision */
   emit_word(m_image_y);
@@ -352,6 +353,31 @@ void jpeg_encoder::emit_sos()
   emit_byte(0);
 }
 
+// emit start of scan of a progressive JPEG: the components of the scan, the spectral band and the successive approximation bits
+void jpeg_encoder::emit_sos(int num_comps, const uint8 *pComps, int ss, int se, int ah, int al)
+{
+  emit_marker(M_SOS);
+  emit_word(2 * num_comps + 2 + 1 + 3);
+  emit_byte(static_cast<uint8>(num_comps));
+  for (int i = 0; i < num_comps; i++)
+  {
+    emit_byte(static_cast<uint8>(pComps[i] + 1));
+    emit_byte(pComps[i] ? ((1 << 4) + 1) : ((0 << 4) + 0));
+  }
+  emit_byte(static_cast<uint8>(ss));
+  emit_byte(static_cast<uint8>(se));
+  emit_byte(static_cast<uint8>((ah << 4) + al));
+}
+
+// Emit define restart interval marker, if restart markers are enabled.
+void jpeg_encoder::emit_dri()
+{
+  if (!m_restart_rows) return;
+  emit_marker(M_DRI);
+  emit_word(4);
+  emit_word(m_restart_rows * m_mcus_per_row);
+}
+
 // Emit all markers at beginning of image file.
 void jpeg_encoder::emit_markers()
 {
@@ -360,6 +386,7 @@ void jpeg_encoder::emit_markers()
   emit_dqt();
   emit_sof();
   emit_dhts();
+  emit_dri();
   emit_sos();
 }
 
@@ -418,6 +445,8 @@ void jpeg_encoder::first_pass_init()
   m_bit_buffer = 0; m_bits_in = 0;
   memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
   m_mcu_y_ofs = 0;
+  m_mcu_row = 0; m_next_restart_num = 0;
+  m_dct_cache_ofs = 0;
   m_pass_num = 1;
 }
 
@@ -481,6 +510,7 @@ bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
   m_image_bpl_xlt  = m_image_x * m_num_components;
   m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
   m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
+  m_restart_rows   = m_params.m_progressive_flag ? 0 : JPGE_MIN(m_params.m_restart_rows, 65535 / m_mcus_per_row);
 
   if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) return false;
   for (int i = 1; i < m_mcu_y; i++)
@@ -492,9 +522,33 @@ bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
   m_out_buf_left = JPGE_OUT_BUF_SIZE;
   m_pOut_buf = m_out_buf;
 
-  if (m_params.m_two_pass_flag)
+  if (m_params.m_progressive_flag)
+  {
+    // Keep every block of every component, padded to whole MCUs as the interleaved DC scans code them. Single component
+    // scans only code the blocks covering the component (see code_scan()).
+    for (int c = 0; c < m_num_components; c++)
+    {
+      const int comp_x = (m_image_x * m_comp_h_samp[c] + m_comp_h_samp[0] - 1) / m_comp_h_samp[0];
+      const int comp_y = (m_image_y * m_comp_v_samp[c] + m_comp_v_samp[0] - 1) / m_comp_v_samp[0];
+      m_prog_blocks_x[c] = m_mcus_per_row * m_comp_h_samp[c];
+      m_prog_blocks_w[c] = (comp_x + 7) >> 3;
+      m_prog_blocks_h[c] = (comp_y + 7) >> 3;
+      const size_t num_blocks = (size_t)m_prog_blocks_x[c] * (m_image_y_mcu / m_mcu_y) * m_comp_v_samp[c];
+      if ((m_pProg_coeffs[c] = static_cast<int16*>(jpge_malloc(num_blocks * 64 * sizeof(int16)))) == NULL) return false;
+    }
+    first_pass_init();
+  }
+  else if (m_params.m_two_pass_flag)
   {
     clear_obj(m_huff_count);
+    if (m_params.m_coefficient_cache_flag)
+    {
+      // Start with room for roughly one byte per pixel and let it grow - most quantized blocks are far smaller than that.
+      m_coeff_cache_capacity = JPGE_MAX((size_t)m_image_x_mcu * m_image_y_mcu, (size_t)65536);
+      m_pCoeff_cache = static_cast<uint8*>(jpge_malloc(m_coeff_cache_capacity));
+      m_coeff_cache_flag = (m_pCoeff_cache != NULL);
+      if (!m_coeff_cache_flag) m_coeff_cache_capacity = 0;
+    }
     first_pass_init();
   }
   else
@@ -615,6 +669,17 @@ void jpeg_encoder::put_bits(uint bits, uint len)
   }
 }
 
+// Ends the current restart interval: pads the last byte with 1 bits, writes the next RSTn marker and resets the DC predictions.
+void jpeg_encoder::emit_restart()
+{
+  put_bits(0x7F, 7);
+  m_bit_buffer = 0; m_bits_in = 0;
+  JPGE_PUT_BYTE(0xFF);
+  JPGE_PUT_BYTE(static_cast<uint8>(M_RST0 + m_next_restart_num));
+  m_next_restart_num = (m_next_restart_num + 1) & 7;
+  memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+}
+
 void jpeg_encoder::code_coefficients_pass_one(int component_num)
 {
   if (component_num >= 3) return; // just to shut up static analysis
@@ -718,18 +783,154 @@ void jpeg_encoder::code_coefficients_pass_two(int component_num)
     put_bits(codes[1][0], code_sizes[1][0]);
 }
 
-void jpeg_encoder::code_block(int component_num)
+// Forward DCT of the block in m_sample_array, recorded into the DCT cache. When replaying the cache the block is taken
+// from it instead.
+void jpeg_encoder::transform_block()
 {
+  if (m_dct_replay_flag)
+  {
+    const int16 *pSrc = m_pDct_cache->m_pBlocks + m_dct_cache_ofs;
+    for (int i = 0; i < 64; i++)
+      m_sample_array[i] = pSrc[i];
+    m_dct_cache_ofs += 64;
+    return;
+  }
   DCT2D(m_sample_array);
+  if (m_dct_record_flag)
+  {
+    int16 *pDst = m_pDct_cache->m_pBlocks + m_dct_cache_ofs;
+    for (int i = 0; i < 64; i++)
+      pDst[i] = static_cast<int16>(m_sample_array[i]);
+    m_dct_cache_ofs += 64;
+  }
+}
+
+void jpeg_encoder::code_block(int component_num)
+{
+  transform_block();
   load_quantized_coefficients(component_num);
   if (m_pass_num == 1)
+  {
     code_coefficients_pass_one(component_num);
+    if (m_coeff_cache_flag)
+      cache_coefficients(component_num);
+  }
   else
     code_coefficients_pass_two(component_num);
 }
 
+// Appends the quantized block in m_coefficient_array to the coefficient cache. Each block is stored as one byte holding
+// (component_num << 6) | number of nonzero AC coefficients, the DC coefficient, then a (zig-zag index, value) pair per nonzero AC coefficient.
+// Coefficients are stored as little endian int16's, so a typical block takes a handful of bytes instead of 128.
+void jpeg_encoder::cache_coefficients(int component_num)
+{
+  if (m_coeff_cache_capacity - m_coeff_cache_size < 3 + 63 * 3)
+  {
+    uint8 *pNew_cache = static_cast<uint8*>(jpge_realloc(m_pCoeff_cache, m_coeff_cache_capacity * 2));
+    if (!pNew_cache)
+    {
+      // Out of memory: drop the cache, get_total_passes() will now ask the caller for a real second pass.
+      free_coefficient_cache();
+      m_coeff_cache_flag = false;
+      return;
+    }
+    m_pCoeff_cache = pNew_cache;
+    m_coeff_cache_capacity *= 2;
+  }
+
+  uint8 *pHeader = m_pCoeff_cache + m_coeff_cache_size;
+  uint8 *pDst = pHeader + 1;
+  uint num_ac = 0;
+  *pDst++ = static_cast<uint8>(m_coefficient_array[0] & 0xFF); *pDst++ = static_cast<uint8>((m_coefficient_array[0] >> 8) & 0xFF);
+  for (int i = 1; i < 64; i++)
+  {
+    const int16 c = m_coefficient_array[i];
+    if (c)
+    {
+      *pDst++ = static_cast<uint8>(i); *pDst++ = static_cast<uint8>(c & 0xFF); *pDst++ = static_cast<uint8>((c >> 8) & 0xFF);
+      num_ac++;
+    }
+  }
+  *pHeader = static_cast<uint8>((component_num << 6) | num_ac);
+  m_coeff_cache_size = pDst - m_pCoeff_cache;
+}
+
+// Starts a new restart interval at the current MCU row. The first pass only resets the DC predictions, so that the
+// statistics match the second pass, and marks the restart in the coefficient cache with a block header of component 3.
+void jpeg_encoder::restart()
+{
+  if (m_pass_num != 1)
+  {
+    emit_restart();
+    return;
+  }
+  memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+  if (!m_coeff_cache_flag)
+    return;
+  if (m_coeff_cache_size == m_coeff_cache_capacity)
+  {
+    uint8 *pNew_cache = static_cast<uint8*>(jpge_realloc(m_pCoeff_cache, m_coeff_cache_capacity * 2));
+    if (!pNew_cache)
+    {
+      free_coefficient_cache();
+      m_coeff_cache_flag = false;
+      return;
+    }
+    m_pCoeff_cache = pNew_cache;
+    m_coeff_cache_capacity *= 2;
+  }
+  m_pCoeff_cache[m_coeff_cache_size++] = 3 << 6;
+}
+
+// Runs the second pass from the coefficient cache: entropy coding only, no color conversion, DCT or quantization.
+bool jpeg_encoder::code_cached_coefficients()
+{
+  const uint8 *pSrc = m_pCoeff_cache, *pEnd = m_pCoeff_cache + m_coeff_cache_size;
+  while (pSrc < pEnd)
+  {
+    if (pSrc[0] == (3 << 6))
+    {
+      emit_restart();
+      pSrc++;
+      continue;
+    }
+    const int component_num = pSrc[0] >> 6;
+    const uint num_ac = pSrc[0] & 63;
+    clear_obj(m_coefficient_array);
+    m_coefficient_array[0] = static_cast<int16>(pSrc[1] | (pSrc[2] << 8));
+    pSrc += 3;
+    for (uint i = 0; i < num_ac; i++, pSrc += 3)
+      m_coefficient_array[pSrc[0]] = static_cast<int16>(pSrc[1] | (pSrc[2] << 8));
+    code_coefficients_pass_two(component_num);
+  }
+  free_coefficient_cache();
+  return terminate_pass_two();
+}
+
+void jpeg_encoder::free_coefficient_cache()
+{
+  jpge_free(m_pCoeff_cache);
+  m_pCoeff_cache = NULL;
+  m_coeff_cache_size = m_coeff_cache_capacity = 0;
+}
+
 void jpeg_encoder::process_mcu_row()
 {
+  if ((m_restart_rows) && (m_mcu_row) && ((m_mcu_row % m_restart_rows) == 0))
+    restart();
+  m_mcu_row++;
+
+  if (m_dct_replay_flag)
+  {
+    replay_mcu_row();
+    return;
+  }
+  if (m_params.m_progressive_flag)
+  {
+    process_mcu_row_progressive();
+    return;
+  }
+
   if (m_num_components == 1)
   {
     for (int i = 0; i < m_mcus_per_row; i++)
@@ -763,6 +964,304 @@ void jpeg_encoder::process_mcu_row()
   }
 }
 
+// Codes the blocks of an MCU row from the DCT cache, in the order process_mcu_row() loads them.
+void jpeg_encoder::replay_mcu_row()
+{
+  const int mcu_y = m_mcu_row - 1;
+  for (int i = 0; i < m_mcus_per_row; i++)
+  {
+    for (int c = 0; c < m_num_components; c++)
+    {
+      for (int v = 0; v < m_comp_v_samp[c]; v++)
+      {
+        for (int h = 0; h < m_comp_h_samp[c]; h++)
+        {
+          if (m_params.m_progressive_flag)
+            store_block(c, i * m_comp_h_samp[c] + h, mcu_y * m_comp_v_samp[c] + v);
+          else
+            code_block(c);
+        }
+      }
+    }
+  }
+}
+
+// Progressive JPEG encoding. The blocks are transformed and quantized as they arrive and kept until the end of the image,
+// then each scan of the scan script is coded twice over all blocks: once to gather the symbol statistics of its Huffman
+// tables, once to emit it. The scans follow libjpeg's jpeg_simple_progression(), see code_ac_refine() for the trickiest.
+void jpeg_encoder::store_block(int component_num, int bx, int by)
+{
+  transform_block();
+  load_quantized_coefficients(component_num);
+  memcpy(m_pProg_coeffs[component_num] + ((size_t)by * m_prog_blocks_x[component_num] + bx) * 64, m_coefficient_array, sizeof(m_coefficient_array));
+}
+
+void jpeg_encoder::process_mcu_row_progressive()
+{
+  const int mcu_y = m_mcu_row - 1;
+  for (int i = 0; i < m_mcus_per_row; i++)
+  {
+    if (m_num_components == 1)
+    {
+      load_block_8_8_grey(i); store_block(0, i, mcu_y);
+    }
+    else if ((m_comp_h_samp[0] == 1) && (m_comp_v_samp[0] == 1))
+    {
+      load_block_8_8(i, 0, 0); store_block(0, i, mcu_y); load_block_8_8(i, 0, 1); store_block(1, i, mcu_y); load_block_8_8(i, 0, 2); store_block(2, i, mcu_y);
+    }
+    else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 1))
+    {
+      load_block_8_8(i * 2 + 0, 0, 0); store_block(0, i * 2 + 0, mcu_y); load_block_8_8(i * 2 + 1, 0, 0); store_block(0, i * 2 + 1, mcu_y);
+      load_block_16_8_8(i, 1); store_block(1, i, mcu_y); load_block_16_8_8(i, 2); store_block(2, i, mcu_y);
+    }
+    else if ((m_comp_h_samp[0] == 2) && (m_comp_v_samp[0] == 2))
+    {
+      load_block_8_8(i * 2 + 0, 0, 0); store_block(0, i * 2 + 0, mcu_y * 2 + 0); load_block_8_8(i * 2 + 1, 0, 0); store_block(0, i * 2 + 1, mcu_y * 2 + 0);
+      load_block_8_8(i * 2 + 0, 1, 0); store_block(0, i * 2 + 0, mcu_y * 2 + 1); load_block_8_8(i * 2 + 1, 1, 0); store_block(0, i * 2 + 1, mcu_y * 2 + 1);
+      load_block_16_8(i, 1); store_block(1, i, mcu_y); load_block_16_8(i, 2); store_block(2, i, mcu_y);
+    }
+  }
+}
+
+void jpeg_encoder::prog_symbol(int table_num, int sym)
+{
+  if (m_prog_gather_flag)
+    m_huff_count[table_num][sym]++;
+  else
+    put_bits(m_huff_codes[table_num][sym], m_huff_code_sizes[table_num][sym]);
+}
+
+void jpeg_encoder::prog_bits(uint bits, int len)
+{
+  if (!m_prog_gather_flag)
+    put_bits(bits & ((1 << len) - 1), len);
+}
+
+// Emits the pending run of end of blocks, followed by the correction bits buffered for the blocks of the run.
+void jpeg_encoder::emit_eobrun(int table_num)
+{
+  if (!m_eobrun) return;
+  int nbits = 0;
+  for (uint temp = m_eobrun; temp >>= 1; ) nbits++;
+  prog_symbol(table_num, nbits << 4);
+  if (nbits) prog_bits(m_eobrun, nbits);
+  m_eobrun = 0;
+  emit_corr_bits(m_corr_bits, m_corr_bits_in);
+  m_corr_bits_in = 0;
+}
+
+void jpeg_encoder::emit_corr_bits(const uint8 *pBits, uint len)
+{
+  for (uint i = 0; i < len; i++)
+    prog_bits(pBits[i], 1);
+}
+
+// First DC scan: the DC coefficient shifted right by al bits, coded as a difference like in a baseline scan.
+void jpeg_encoder::code_dc_first(const int16 *pBlock, int component_num, int al)
+{
+  int temp1, temp2, nbits = 0;
+  const int dc = pBlock[0] >> al;
+  temp1 = temp2 = dc - m_last_dc_val[component_num];
+  m_last_dc_val[component_num] = dc;
+  if (temp1 < 0)
+  {
+    temp1 = -temp1; temp2--;
+  }
+  while (temp1)
+  {
+    nbits++; temp1 >>= 1;
+  }
+  prog_symbol(0 + (component_num > 0), nbits);
+  if (nbits) prog_bits(temp2, nbits);
+}
+
+// First AC scan of a spectral band: the coefficients shifted right by al bits, runs of empty blocks coded as one EOBn symbol.
+void jpeg_encoder::code_ac_first(const int16 *pBlock, int table_num, int ss, int se, int al)
+{
+  int run_len = 0;
+  for (int k = ss; k <= se; k++)
+  {
+    int temp1 = pBlock[k], temp2;
+    if (temp1 < 0)
+    {
+      temp1 = -temp1 >> al; temp2 = ~temp1;
+    }
+    else
+    {
+      temp1 >>= al; temp2 = temp1;
+    }
+    if (temp1 == 0)
+    {
+      run_len++;
+      continue;
+    }
+    emit_eobrun(table_num);
+    while (run_len > 15)
+    {
+      prog_symbol(table_num, 0xF0);
+      run_len -= 16;
+    }
+    int nbits = 1;
+    while (temp1 >>= 1) nbits++;
+    prog_symbol(table_num, (run_len << 4) + nbits);
+    prog_bits(temp2, nbits);
+    run_len = 0;
+  }
+  if ((run_len) && (++m_eobrun == 0x7FFF))
+    emit_eobrun(table_num);
+}
+
+// AC refinement scan: coefficients becoming nonzero at bit al are coded like in a first scan (with a sign bit instead of
+// the magnitude), coefficients which already were nonzero only send their bit al, as correction bits following the next
+// symbol. Correction bits of blocks without new coefficients wait in m_corr_bits until their end of block run is emitted.
+void jpeg_encoder::code_ac_refine(const int16 *pBlock, int table_num, int ss, int se, int al)
+{
+  int abs_values[64], eob = 0;
+  for (int k = ss; k <= se; k++)
+  {
+    int temp = pBlock[k];
+    if (temp < 0) temp = -temp;
+    abs_values[k] = temp >>= al;
+    if (temp == 1) eob = k;
+  }
+
+  int run_len = 0;
+  uint8 *pBits = m_corr_bits + m_corr_bits_in;
+  uint num_bits = 0;
+  for (int k = ss; k <= se; k++)
+  {
+    const int temp = abs_values[k];
+    if (temp == 0)
+    {
+      run_len++;
+      continue;
+    }
+    while ((run_len > 15) && (k <= eob))
+    {
+      emit_eobrun(table_num);
+      prog_symbol(table_num, 0xF0);
+      run_len -= 16;
+      emit_corr_bits(pBits, num_bits);
+      pBits = m_corr_bits; num_bits = 0;
+    }
+    if (temp > 1)
+    {
+      pBits[num_bits++] = static_cast<uint8>(temp & 1);
+      continue;
+    }
+    emit_eobrun(table_num);
+    prog_symbol(table_num, (run_len << 4) + 1);
+    prog_bits(pBlock[k] < 0 ? 0 : 1, 1);
+    emit_corr_bits(pBits, num_bits);
+    pBits = m_corr_bits; num_bits = 0;
+    run_len = 0;
+  }
+  if ((run_len) || (num_bits))
+  {
+    m_eobrun++;
+    m_corr_bits_in += num_bits;
+    if ((m_eobrun == 0x7FFF) || (m_corr_bits_in > MAX_CORR_BITS - 64 + 1))
+      emit_eobrun(table_num);
+  }
+}
+
+// Codes one scan over all blocks of its components: interleaved scans in MCU order, single component scans in the raster
+// order of the component's own blocks.
+void jpeg_encoder::code_scan(int num_comps, const uint8 *pComps, int ss, int se, int ah, int al)
+{
+  m_bit_buffer = 0; m_bits_in = 0;
+  memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+  m_eobrun = 0; m_corr_bits_in = 0;
+  const int table_num = 2 + (pComps[0] > 0);
+  if (num_comps > 1)
+  {
+    for (int mcu_y = 0; mcu_y < m_image_y_mcu / m_mcu_y; mcu_y++)
+      for (int mcu_x = 0; mcu_x < m_mcus_per_row; mcu_x++)
+        for (int i = 0; i < num_comps; i++)
+        {
+          const int c = pComps[i];
+          for (int v = 0; v < m_comp_v_samp[c]; v++)
+            for (int h = 0; h < m_comp_h_samp[c]; h++)
+            {
+              const int16 *pBlock = m_pProg_coeffs[c] + ((size_t)(mcu_y * m_comp_v_samp[c] + v) * m_prog_blocks_x[c] + mcu_x * m_comp_h_samp[c] + h) * 64;
+              if (ah) prog_bits(pBlock[0] >> al, 1); else code_dc_first(pBlock, c, al);
+            }
+        }
+    return;
+  }
+
+  const int c = pComps[0];
+  for (int by = 0; by < m_prog_blocks_h[c]; by++)
+    for (int bx = 0; bx < m_prog_blocks_w[c]; bx++)
+    {
+      const int16 *pBlock = m_pProg_coeffs[c] + ((size_t)by * m_prog_blocks_x[c] + bx) * 64;
+      if (ss == 0)
+      {
+        if (ah) prog_bits(pBlock[0] >> al, 1); else code_dc_first(pBlock, c, al);
+      }
+      else if (ah)
+        code_ac_refine(pBlock, table_num, ss, se, al);
+      else
+        code_ac_first(pBlock, table_num, ss, se, al);
+    }
+  emit_eobrun(table_num);
+}
+
+// Writes the whole progressive JPEG, after the last block has been stored.
+bool jpeg_encoder::encode_progressive()
+{
+  // Scan script: components, spectral selection start and end, successive approximation high and low bit.
+  struct scan { uint8 num_comps, comps[3], ss, se, ah, al; };
+  static const scan s_color_scans[] =
+  {
+    { 3, { 0, 1, 2 }, 0, 0, 0, 1 }, { 1, { 0 }, 1, 5, 0, 2 }, { 1, { 2 }, 1, 63, 0, 1 }, { 1, { 1 }, 1, 63, 0, 1 },
+    { 1, { 0 }, 6, 63, 0, 2 }, { 1, { 0 }, 1, 63, 2, 1 }, { 3, { 0, 1, 2 }, 0, 0, 1, 0 }, { 1, { 2 }, 1, 63, 1, 0 },
+    { 1, { 1 }, 1, 63, 1, 0 }, { 1, { 0 }, 1, 63, 1, 0 }
+  };
+  static const scan s_grey_scans[] =
+  {
+    { 1, { 0 }, 0, 0, 0, 1 }, { 1, { 0 }, 1, 5, 0, 2 }, { 1, { 0 }, 6, 63, 0, 2 }, { 1, { 0 }, 1, 63, 2, 1 },
+    { 1, { 0 }, 0, 0, 1, 0 }, { 1, { 0 }, 1, 63, 1, 0 }
+  };
+  const scan *pScans = (m_num_components == 3) ? s_color_scans : s_grey_scans;
+  const int num_scans = (m_num_components == 3) ? (int)(sizeof(s_color_scans) / sizeof(scan)) : (int)(sizeof(s_grey_scans) / sizeof(scan));
+
+  emit_marker(M_SOI);
+  emit_jfif_app0();
+  emit_dqt();
+  emit_sof();
+  for (int i = 0; i < num_scans && m_all_stream_writes_succeeded; i++)
+  {
+    const scan &sc = pScans[i];
+    // DC refinement scans are raw bits, all other scans get Huffman tables optimized for their symbols.
+    if ((sc.ss != 0) || (sc.ah == 0))
+    {
+      clear_obj(m_huff_count);
+      m_prog_gather_flag = true;
+      code_scan(sc.num_comps, sc.comps, sc.ss, sc.se, sc.ah, sc.al);
+      for (int t = 0; t < 2; t++)
+      {
+        const int table_num = (sc.ss ? 2 : 0) + t;
+        bool used = false;
+        for (int j = 0; j < sc.num_comps; j++)
+          used = used || ((sc.comps[j] > 0) == (t > 0));
+        if (!used) continue;
+        optimize_huffman_table(table_num, sc.ss ? AC_LUM_CODES : DC_LUM_CODES);
+        compute_huffman_table(&m_huff_codes[table_num][0], &m_huff_code_sizes[table_num][0], m_huff_bits[table_num], m_huff_val[table_num]);
+        emit_dht(m_huff_bits[table_num], m_huff_val[table_num], t, sc.ss != 0);
+      }
+    }
+    emit_sos(sc.num_comps, sc.comps, sc.ss, sc.se, sc.ah, sc.al);
+    m_prog_gather_flag = false;
+    code_scan(sc.num_comps, sc.comps, sc.ss, sc.se, sc.ah, sc.al);
+    put_bits(0x7F, 7);
+    flush_output_buffer();
+  }
+  emit_marker(M_EOI);
+  m_pass_num = 3; // the image is complete, like after terminate_pass_two()
+  return m_all_stream_writes_succeeded;
+}
+
 bool jpeg_encoder::terminate_pass_one()
 {
   optimize_huffman_table(0+0, DC_LUM_CODES); optimize_huffman_table(2+0, AC_LUM_CODES);
@@ -770,7 +1269,10 @@ bool jpeg_encoder::terminate_pass_one()
   {
     optimize_huffman_table(0+1, DC_CHROMA_CODES); optimize_huffman_table(2+1, AC_CHROMA_CODES);
   }
-  return second_pass_init();
+  if (!second_pass_init()) return false;
+  if (m_coeff_cache_flag)
+    return code_cached_coefficients();
+  return true;
 }
 
 bool jpeg_encoder::terminate_pass_two()
@@ -795,6 +1297,13 @@ bool jpeg_encoder::process_end_of_image()
     process_mcu_row();
   }
 
+  if (m_dct_record_flag)
+  {
+    m_pDct_cache->m_filled = true;
+    m_dct_record_flag = false;
+  }
+  if (m_params.m_progressive_flag)
+    return encode_progressive();
   if (m_pass_num == 1)
     return terminate_pass_one();
   else
@@ -851,6 +1360,16 @@ void jpeg_encoder::clear()
   m_mcu_lines[0] = NULL;
   m_pass_num = 0;
   m_all_stream_writes_succeeded = true;
+  m_coeff_cache_flag = false;
+  m_pCoeff_cache = NULL;
+  m_coeff_cache_size = m_coeff_cache_capacity = 0;
+  m_restart_rows = m_mcu_row = m_next_restart_num = 0;
+  m_pProg_coeffs[0] = m_pProg_coeffs[1] = m_pProg_coeffs[2] = NULL;
+  m_prog_gather_flag = false;
+  m_eobrun = m_corr_bits_in = 0;
+  m_pDct_cache = NULL;
+  m_dct_cache_ofs = 0;
+  m_dct_record_flag = m_dct_replay_flag = false;
 }
 
 jpeg_encoder::jpeg_encoder()
@@ -866,7 +1385,8 @@ jpeg_encoder::~jpeg_encoder()
 bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
 {
   deinit();
-  if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+  // The frame header stores the dimensions in 16 bits.
+  if (((!pStream) || (width < 1) || (height < 1) || (width > 65535) || (height > 65535)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
   m_pStream = pStream;
   m_params = comp_params;
   return jpg_open(width, height, src_channels);
@@ -875,6 +1395,9 @@ bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_c
 void jpeg_encoder::deinit()
 {
   jpge_free(m_mcu_lines[0]);
+  jpge_free(m_pCoeff_cache);
+  for (int c = 0; c < 3; c++)
+    jpge_free(m_pProg_coeffs[c]);
   clear();
 }
 
@@ -895,57 +1418,86 @@ bool jpeg_encoder::process_scanline(const void* pScanline)
   return m_all_stream_writes_succeeded;
 }
 
-// Higher level wrappers/examples (optional).
-#include <stdio.h>
-
-class cfile_stream : public output_stream
+bool jpeg_encoder::set_dct_cache(dct_cache *pCache)
 {
-   cfile_stream(const cfile_stream &);
-   cfile_stream &operator= (const cfile_stream &);
+  if ((!pCache) || (m_pass_num < 1) || (m_mcu_row) || (m_mcu_y_ofs)) return false;
+  if (pCache->m_filled)
+  {
+    if ((pCache->m_image_x != m_image_x) || (pCache->m_image_y != m_image_y) || (pCache->m_num_components != m_num_components) ||
+        (pCache->m_h_samp != m_comp_h_samp[0]) || (pCache->m_v_samp != m_comp_v_samp[0])) return false;
+    m_pDct_cache = pCache;
+    return true;
+  }
+  int blocks_per_mcu = 0;
+  for (int c = 0; c < m_num_components; c++)
+    blocks_per_mcu += m_comp_h_samp[c] * m_comp_v_samp[c];
+  pCache->clear();
+  pCache->m_num_blocks = (size_t)m_mcus_per_row * (m_image_y_mcu / m_mcu_y) * blocks_per_mcu;
+  if ((pCache->m_pBlocks = static_cast<int16*>(jpge_malloc(pCache->m_num_blocks * 64 * sizeof(int16)))) == NULL) return false;
+  pCache->m_image_x = m_image_x; pCache->m_image_y = m_image_y; pCache->m_num_components = m_num_components;
+  pCache->m_h_samp = m_comp_h_samp[0]; pCache->m_v_samp = m_comp_v_samp[0];
+  m_pDct_cache = pCache;
+  m_dct_record_flag = true;
+  return true;
+}
 
-   FILE* m_pFile;
-   bool m_bStatus;
+bool jpeg_encoder::process_dct_cache()
+{
+  if ((!m_pDct_cache) || (!m_pDct_cache->m_filled) || (m_dct_record_flag) || (m_mcu_row) || (m_mcu_y_ofs)) return false;
+  m_dct_replay_flag = true;
+  // Each pass codes every MCU row, the last one ends with m_pass_num past 2 (see terminate_pass_two()).
+  while ((m_pass_num == 1) || (m_pass_num == 2))
+  {
+    if (!m_all_stream_writes_succeeded) return false;
+    for (int i = m_image_y_mcu / m_mcu_y; i > 0; i--)
+      process_mcu_row();
+    if (!process_end_of_image()) return false;
+  }
+  return m_all_stream_writes_succeeded;
+}
 
-public:
-   cfile_stream() : m_pFile(NULL), m_bStatus(false) { }
+void dct_cache::clear()
+{
+  jpge_free(m_pBlocks);
+  m_pBlocks = NULL;
+  m_num_blocks = 0;
+  m_filled = false;
+}
 
-   virtual ~cfile_stream()
-   {
-      close();
-   }
+// Higher level wrappers/examples (optional).
+#include <stdio.h>
 
-   bool open(const char *pFilename)
-   {
-      close();
-      m_pFile = fopen(pFilename, "wb");
-      m_bStatus = (m_pFile != NULL);
-      return m_bStatus;
-   }
+bool cfile_stream::open(const char *pFilename)
+{
+   close();
+   m_pFile = fopen(pFilename, "wb");
+   m_bStatus = (m_pFile != NULL);
+   return m_bStatus;
+}
 
-   bool close()
+bool cfile_stream::close()
+{
+   if (m_pFile)
    {
-      if (m_pFile)
+      if (fclose(m_pFile) == EOF)
       {
-         if (fclose(m_pFile) == EOF)
-         {
-            m_bStatus = false;
-         }
-         m_pFile = NULL;
+         m_bStatus = false;
       }
-      return m_bStatus;
+      m_pFile = NULL;
    }
+   return m_bStatus;
+}
 
-   virtual bool put_buf(const void* pBuf, int len)
-   {
-      m_bStatus = m_bStatus && (fwrite(pBuf, len, 1, m_pFile) == 1);
-      return m_bStatus;
-   }
+bool cfile_stream::put_buf(const void* pBuf, int len)
+{
+   m_bStatus = m_bStatus && (fwrite(pBuf, len, 1, m_pFile) == 1);
+   return m_bStatus;
+}
 
-   uint get_size() const
-   {
-      return m_pFile ? ftell(m_pFile) : 0;
-   }
-};
+uint cfile_stream::get_size() const
+{
+   return m_pFile ? ftell(m_pFile) : 0;
+}
 
 // Writes JPEG image to file.
 bool compress_image_to_jpeg_file(const char *pFilename, int width, int height, int num_channels, const uint8 *pImage_data, const params &comp_params)
@@ -962,7 +1514,7 @@ bool compress_image_to_jpeg_file(const char *pFilename, int width, int height, i
   {
     for (int i = 0; i < height; i++)
     {
-       const uint8* pBuf = pImage_data + i * width * num_channels;
+       const uint8* pBuf = pImage_data + (size_t)i * width * num_channels;
        if (!dst_image.process_scanline(pBuf))
           return false;
     }
@@ -1021,7 +1573,7 @@ bool compress_image_to_jpeg_file_in_memory(void *pDstBuf, int &buf_size, int wid
    {
      for (int i = 0; i < height; i++)
      {
-        const uint8* pScanline = pImage_data + i * width * num_channels;
+        const uint8* pScanline = pImage_data + (size_t)i * width * num_channels;
         if (!dst_image.process_scanline(pScanline))
            return false;
      }
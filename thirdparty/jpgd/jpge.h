@@ -4,6 +4,9 @@
 #ifndef JPEG_ENCODER_H
 #define JPEG_ENCODER_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 namespace jpge
 {
   typedef unsigned char  uint8;
@@ -19,12 +22,13 @@ namespace jpge
   // JPEG compression parameters structure.
   struct params
   {
-    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false) { }
+    inline params() : m_quality(85), m_subsampling(H2V2), m_no_chroma_discrim_flag(false), m_two_pass_flag(false), m_coefficient_cache_flag(true), m_restart_rows(0), m_progressive_flag(false) { }
 
     inline bool check() const
     {
       if ((m_quality < 1) || (m_quality > 100)) return false;
       if ((uint)m_subsampling > (uint)H2V2) return false;
+      if (m_restart_rows < 0) return false;
       return true;
     }
 
@@ -42,7 +46,22 @@ namespace jpge
     // If true, the Y quantization table is also used for the CbCr channels.
     bool m_no_chroma_discrim_flag;
 
+    // Generates optimized Huffman tables, at the cost of a second pass over the image.
     bool m_two_pass_flag;
+
+    // Only used with m_two_pass_flag. If true, the quantized coefficients of the first pass are kept in a compact
+    // in-memory cache and the second pass is entropy coding only, so each scanline only has to be supplied once
+    // (get_total_passes() returns 1). If the cache can't be allocated the encoder falls back to asking for a real second pass.
+    bool m_coefficient_cache_flag;
+
+    // Number of MCU rows between restart markers (DRI/RSTn), 0 for none. Each restart interval can be decoded on its own,
+    // so decoders may seek to a row or decode the intervals in parallel. Limited to 65535 MCUs per interval.
+    int m_restart_rows;
+
+    // Writes a progressive JPEG: a coarse image first (DC coefficients and low frequencies at reduced precision), refined
+    // by later scans, each with its own optimized Huffman tables. The quantized coefficients of the whole image are kept
+    // in memory (2 bytes per sample) until the last scanline is supplied. m_two_pass_flag and m_restart_rows are ignored.
+    bool m_progressive_flag;
   };
   
   // Writes JPEG image to a file. 
@@ -63,7 +82,51 @@ namespace jpge
     virtual bool put_buf(const void* Pbuf, int len) = 0;
     template<class T> inline bool put_obj(const T& obj) { return put_buf(&obj, sizeof(T)); }
   };
+
+  // stdio FILE output stream class. Use with jpeg_encoder to write a file scanline by scanline.
+  class cfile_stream : public output_stream
+  {
+    cfile_stream(const cfile_stream &);
+    cfile_stream &operator= (const cfile_stream &);
+
+    FILE* m_pFile;
+    bool m_bStatus;
+
+  public:
+    cfile_stream() : m_pFile(NULL), m_bStatus(false) { }
+    virtual ~cfile_stream() { close(); }
+
+    bool open(const char *pFilename);
+    bool close();
+
+    virtual bool put_buf(const void* pBuf, int len);
+
+    uint get_size() const;
+  };
     
+  // Forward DCT output of all blocks of an image in coding order, before quantization (2 bytes per sample). Filled by one
+  // encoder (see jpeg_encoder::set_dct_cache()), then shared read-only by any number of encoders of the same image, for
+  // example trial encodes at different qualities.
+  class dct_cache
+  {
+    dct_cache(const dct_cache &);
+    dct_cache &operator= (const dct_cache &);
+
+  public:
+    dct_cache() : m_pBlocks(NULL), m_num_blocks(0), m_image_x(0), m_image_y(0), m_num_components(0), m_h_samp(0), m_v_samp(0), m_filled(false) { }
+    ~dct_cache() { clear(); }
+
+    void clear();
+    bool is_filled() const { return m_filled; }
+
+  private:
+    friend class jpeg_encoder;
+    int16 *m_pBlocks;
+    size_t m_num_blocks;
+    int m_image_x, m_image_y, m_num_components, m_h_samp, m_v_samp;
+    bool m_filled;
+  };
+
   // Lower level jpeg_encoder class - useful if more control is needed than the above helper functions.
   class jpeg_encoder
   {
@@ -84,7 +147,9 @@ namespace jpge
     // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
     void deinit();
 
-    uint get_total_passes() const { return m_params.m_two_pass_flag ? 2 : 1; }
+    // Number of times the caller must supply all scanlines. Query again after each pass, as this may change
+    // from 1 to 2 if the coefficient cache runs out of memory during the first pass.
+    uint get_total_passes() const { return (m_params.m_two_pass_flag && !m_params.m_progressive_flag && !m_coeff_cache_flag) ? 2 : 1; }
     inline uint get_cur_pass() { return m_pass_num; }
 
     // Call this method with each source scanline.
@@ -92,6 +157,16 @@ namespace jpge
     // You must call with NULL after all scanlines are processed to finish compression.
     // Returns false on out of memory or if a stream write fails.
     bool process_scanline(const void* pScanline);
+
+    // Call after init(), before the first scanline. An empty cache records the forward DCT of every block while the
+    // scanlines are processed. A cache filled by an encoder of an image with the same dimensions, components and
+    // subsampling lets process_dct_cache() replace the scanlines.
+    // Returns false on out of memory or if a filled cache doesn't match the image.
+    bool set_dct_cache(dct_cache *pCache);
+
+    // Encodes all passes from the filled cache given to set_dct_cache(), without scanlines: only quantization and entropy
+    // coding are redone. Returns false if the cache isn't filled or if a stream write fails.
+    bool process_dct_cache();
         
   private:
     jpeg_encoder(const jpeg_encoder &);
@@ -127,6 +202,19 @@ namespace jpge
     uint m_bits_in;
     uint8 m_pass_num;
     bool m_all_stream_writes_succeeded;
+    bool m_coeff_cache_flag;
+    int m_restart_rows, m_mcu_row, m_next_restart_num;
+    uint8 *m_pCoeff_cache;
+    size_t m_coeff_cache_size, m_coeff_cache_capacity;
+    enum { MAX_CORR_BITS = 1000 };
+    int16 *m_pProg_coeffs[3];
+    int m_prog_blocks_x[3], m_prog_blocks_w[3], m_prog_blocks_h[3];
+    bool m_prog_gather_flag;
+    uint m_eobrun, m_corr_bits_in;
+    uint8 m_corr_bits[MAX_CORR_BITS];
+    dct_cache *m_pDct_cache;
+    size_t m_dct_cache_ofs;
+    bool m_dct_record_flag, m_dct_replay_flag;
         
     void optimize_huffman_table(int table_num, int table_len);
     void emit_byte(uint8 i);
@@ -138,6 +226,9 @@ namespace jpge
     void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
     void emit_dhts();
     void emit_sos();
+    void emit_sos(int num_comps, const uint8 *pComps, int ss, int se, int ah, int al);
+    void emit_dri();
+    void emit_restart();
     void emit_markers();
     void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val);
     void compute_quant_table(int32 *dst, int16 *src);
@@ -155,6 +246,23 @@ namespace jpge
     void code_coefficients_pass_one(int component_num);
     void code_coefficients_pass_two(int component_num);
     void code_block(int component_num);
+    void cache_coefficients(int component_num);
+    void restart();
+    void transform_block();
+    void replay_mcu_row();
+    void store_block(int component_num, int bx, int by);
+    void process_mcu_row_progressive();
+    void prog_symbol(int table_num, int sym);
+    void prog_bits(uint bits, int len);
+    void emit_eobrun(int table_num);
+    void emit_corr_bits(const uint8 *pBits, uint len);
+    void code_dc_first(const int16 *pBlock, int component_num, int al);
+    void code_ac_first(const int16 *pBlock, int table_num, int ss, int se, int al);
+    void code_ac_refine(const int16 *pBlock, int table_num, int ss, int se, int al);
+    void code_scan(int num_comps, const uint8 *pComps, int ss, int se, int ah, int al);
+    bool encode_progressive();
+    bool code_cached_coefficients();
+    void free_coefficient_cache();
     void process_mcu_row();
     bool terminate_pass_one();
     bool terminate_pass_two();